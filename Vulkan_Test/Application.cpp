@@ -1,18 +1,25 @@
 
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb_image.h>
-
 #include "Application.h"
+#include <filesystem>
+#include <cmath>
 
 
 
 Application::Application(GLFWwindow* window)
 {
 	this->m_Window = window;
+	this->m_Headless = window == nullptr;
+	this->m_ThreadPool.Start(std::thread::hardware_concurrency());
 
 	if (this->DetectVulkan()) {
 		if (!CheckValidationSupport()) {
-			throw std::runtime_error("Validation layers are not available");
+			if (!this->m_Headless) {
+				throw std::runtime_error("Validation layers are not available");
+			}
+
+			// Benchmark machines usually only have the runtime installed
+			printf("Validation layers are not available, running without them\n");
+			this->m_ValidationEnabled = false;
 		}
 	}
 	else {
@@ -23,61 +30,95 @@ Application::Application(GLFWwindow* window)
 Application::~Application()
 {
 	this->CleanupSwapChain();
+
+	vkDestroyPipeline(this->m_Device, this->m_GraphicsPipeLine, nullptr);
+	vkDestroyPipeline(this->m_Device, this->m_DepthEqualPipeline, nullptr);
+	vkDestroyPipeline(this->m_Device, this->m_DepthPrepassPipeline, nullptr);
+	vkDestroyPipelineLayout(this->m_Device, this->m_PipelineLayout, nullptr);
+	vkDestroyRenderPass(this->m_Device, this->m_RenderPass, nullptr);
+	vkDestroyRenderPass(this->m_Device, this->m_DepthEqualRenderPass, nullptr);
+	vkDestroyRenderPass(this->m_Device, this->m_DepthPrepassRenderPass, nullptr);
+
+	if (this->m_SwapChain != VK_NULL_HANDLE) {
+		vkDestroySwapchainKHR(this->m_Device, this->m_SwapChain, nullptr);
+	}
+
+	for (size_t i = 0; i < this->m_OffscreenImageMemory.size(); i++) {
+		DestroyImage(this->m_SwapChainImages[i], this->m_OffscreenImageMemory[i]);
+	}
+
+	for (size_t i = 0; i < this->m_ReadbackBuffers.size(); i++) {
+		DestroyBuffer(this->m_ReadbackBuffers[i], this->m_ReadbackMemory[i]);
+	}
 	
 	vkDestroySampler(this->m_Device, this->m_TextureSampler, nullptr);
-	vkDestroyImageView(this->m_Device, this->m_TextureImageView, nullptr);
-
-	vkDestroyImage(this->m_Device, this->m_TextureImage, nullptr);
-	vkFreeMemory(this->m_Device, this->m_TextureImageMemory, nullptr);
 
+	vkDestroyDescriptorPool(this->m_Device, this->m_DescriptorPool, nullptr);
 	vkDestroyDescriptorSetLayout(this->m_Device, this->m_DescriptorSetLayout, nullptr);
 
-	vkDestroyBuffer(this->m_Device, this->m_IndexBuffer, nullptr);
-	vkFreeMemory(this->m_Device, this->m_IndexBufferMemory, nullptr);
+	DestroyBuffer(this->m_UniformBuffer, this->m_UniformBufferMemory);
+
+	DestroyBuffer(this->m_IndexBuffer, this->m_IndexBufferMemory);
+	DestroyBuffer(this->m_InstanceBuffer, this->m_InstanceBufferMemory);
+	DestroyBuffer(this->m_IndirectBuffer, this->m_IndirectBufferMemory);
+	DestroyBuffer(this->m_TextureSlotBuffer, this->m_TextureSlotMemory);
+	DestroyBuffer(this->m_VertexBuffer, this->m_VertexBufferMemory);
+	DestroyBuffer(this->m_PositionBuffer, this->m_PositionBufferMemory);
+	DestroyBuffer(this->m_VertexGroupBuffer, this->m_VertexGroupMemory);
+	DestroyBuffer(this->m_GroupStateBuffer, this->m_GroupStateMemory);
 
-	vkDestroyBuffer(this->m_Device, this->m_VertexBuffer, nullptr);
-	vkFreeMemory(this->m_Device, this->m_VertexBufferMemory, nullptr);
+	vkDestroyPipeline(this->m_Device, this->m_AnimationPipeline, nullptr);
+	vkDestroyPipelineLayout(this->m_Device, this->m_AnimationPipelineLayout, nullptr);
+	vkDestroyDescriptorPool(this->m_Device, this->m_AnimationDescriptorPool, nullptr);
+	vkDestroyDescriptorSetLayout(this->m_Device, this->m_AnimationSetLayout, nullptr);
 
-	for (size_t i = 0; i < this->MAX_FRAMES_IN_FLIGHT; i++) {
+	for (size_t i = 0; i < this->m_FramesInFlight; i++) {
 		vkDestroySemaphore(this->m_Device, this->m_RenderFinishedSemaphore[i], nullptr);
 		vkDestroySemaphore(this->m_Device, this->m_ImageAvailableSemaphore[i], nullptr);
-		vkDestroyFence(this->m_Device, this->m_InFlightFences[i], nullptr);
+	}
+
+	this->m_FrameTimeline.Destroy();
+
+	for (auto pool : this->m_FrameCommandPools) {
+		vkDestroyCommandPool(this->m_Device, pool, nullptr);
+	}
+
+	for (auto& pools : this->m_SecondaryCommandPools) {
+		for (auto pool : pools) {
+			vkDestroyCommandPool(this->m_Device, pool, nullptr);
+		}
 	}
 
 	vkDestroyCommandPool(this->m_Device, this->m_CommandPool, nullptr);
+	this->m_TextureManager.Destroy();
+	this->m_UploadManager.Destroy();
+	this->m_Profiler.Destroy();
+	this->m_PipelineCache.PrintStatistics();
+	this->m_PipelineCache.Destroy();
+	this->m_Allocator.PrintStatistics();
+	this->m_Allocator.Destroy();
 	vkDestroyDevice(this->m_Device, nullptr);
-	vkDestroySurfaceKHR(this->m_Instance, this->m_Surface, nullptr);
+
+	if (this->m_Surface != VK_NULL_HANDLE) {
+		vkDestroySurfaceKHR(this->m_Instance, this->m_Surface, nullptr);
+	}
+
 	vkDestroyInstance(this->m_Instance, nullptr);	
 }
 
 bool Application::CleanupSwapChain() {
 
-	vkDestroyImageView(this->m_Device, this->m_DepthImageView, nullptr);
-	vkDestroyImage(this->m_Device, this->m_DepthImage, nullptr);
-	vkFreeMemory(this->m_Device, this->m_DepthImageMemory, nullptr);
-
-	for (auto framebuffer : this->m_SwapChainFramebuffers) {
-		vkDestroyFramebuffer(this->m_Device, framebuffer, nullptr);
-	}
+	// The depth buffer is a transient of the graph and goes with it
+	this->m_RenderGraph.Destroy();
+	this->m_DepthImageView = VK_NULL_HANDLE;
+	this->m_SceneColorView = VK_NULL_HANDLE;
 
-	vkFreeCommandBuffers(this->m_Device, this->m_CommandPool, static_cast<uint32_t>(this->m_CommandBuffers.size()), this->m_CommandBuffers.data());
-	vkDestroyPipeline(this->m_Device, this->m_GraphicsPipeLine, nullptr);
-	vkDestroyPipelineLayout(this->m_Device, this->m_PipelineLayout, nullptr);
-	vkDestroyRenderPass(this->m_Device, this->m_RenderPass, nullptr);
+	DestroyFrameBuffers();
 
 	for (auto view : this->m_SwapChainImageViews) {
 		vkDestroyImageView(this->m_Device, view, nullptr);
 	}
 
-	vkDestroySwapchainKHR(this->m_Device, this->m_SwapChain, nullptr);
-
-	for (size_t i = 0; i < this->m_SwapChainImages.size(); i++) {
-		vkDestroyBuffer(this->m_Device, this->m_UniformBuffers[i], nullptr);
-		vkFreeMemory(this->m_Device, this->m_UniformBufferMemory[i], nullptr);
-	}
-
-	vkDestroyDescriptorPool(this->m_Device, this->m_DescriptorPool, nullptr);
-
 	return true;
 }
 
@@ -138,16 +179,21 @@ VkResult Application::InitVulkan() {
 	uint32_t glfwExtensionsCount = 0;
 	VkApplicationInfo appInfo = this->CreateAppInfo();
 	VkInstanceCreateInfo createInfo = this->CreateCreateInfo(appInfo);
+	std::vector<const char*> reqExtensions;
 
-	glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionsCount);
+	if (!this->m_Headless) {
+		glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionsCount);
+		reqExtensions.assign(glfwExtensions, glfwExtensions + glfwExtensionsCount);
+	}
 
-	std::vector<const char*> reqExtensions(glfwExtensions, glfwExtensions + glfwExtensionsCount);
+	if (this->m_ValidationEnabled) {
+		reqExtensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+		createInfo.enabledLayerCount = static_cast<uint32_t>(m_ValidationLayers.size());
+		createInfo.ppEnabledLayerNames = m_ValidationLayers.data();
+	}
 
-	reqExtensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
 	createInfo.enabledExtensionCount = static_cast<uint32_t>(reqExtensions.size());
 	createInfo.ppEnabledExtensionNames = reqExtensions.data();
-	createInfo.enabledLayerCount = static_cast<uint32_t>(m_ValidationLayers.size());
-	createInfo.ppEnabledLayerNames = m_ValidationLayers.data();
 	
 	return vkCreateInstance(&createInfo, nullptr, &m_Instance);
 }
@@ -160,7 +206,7 @@ VkApplicationInfo Application::CreateAppInfo() {
 	appInfo.applicationVersion = VK_MAKE_VERSION(0, 1, 0);
 	appInfo.pEngineName = "NO ENGINE";
 	appInfo.engineVersion = VK_MAKE_VERSION(0, 1, 0);
-	appInfo.apiVersion = VK_API_VERSION_1_0;
+	appInfo.apiVersion = VK_API_VERSION_1_1;
 
 	return appInfo;
 }
@@ -214,6 +260,11 @@ bool Application::IsDeviceSuitable(VkPhysicalDevice device) {
 	vkGetPhysicalDeviceProperties(device, &deviceProperties);
 	vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
 
+	// Headless runs have to work on software implementations such as lavapipe, so any device type will do
+	if (this->m_Headless) {
+		return FindDeviceQueFamilies(device).graphicsFamily.has_value() && deviceFeatures.samplerAnisotropy;
+	}
+
 	if (!(deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU && deviceFeatures.geometryShader)) {
 		return false;
 	}
@@ -244,6 +295,90 @@ bool Application::CheckDeviceExtensionSupport(VkPhysicalDevice device) {
 	return requiredExtensions.empty();
 }
 
+bool Application::IsDeviceExtensionSupported(VkPhysicalDevice device, const char* extensionName) {
+	uint32_t extensionCount;
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+	for (const auto& extension : availableExtensions) {
+		if (strcmp(extension.extensionName, extensionName) == 0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+#ifdef VK_EXT_descriptor_indexing
+// Fills in the indexing features the bindless table needs and sizes the table from the update-after-bind limits
+bool Application::QueryBindlessSupport(VkPhysicalDeviceDescriptorIndexingFeaturesEXT& enabled) {
+	VkPhysicalDeviceProperties properties;
+
+	vkGetPhysicalDeviceProperties(this->m_PhysicalDevice, &properties);
+
+	if (properties.apiVersion < VK_API_VERSION_1_1 || !IsDeviceExtensionSupported(this->m_PhysicalDevice, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME)) {
+		return false;
+	}
+
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT supported = {};
+	VkPhysicalDeviceFeatures2 features = {};
+
+	supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+	features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features.pNext = &supported;
+
+	vkGetPhysicalDeviceFeatures2(this->m_PhysicalDevice, &features);
+
+	if (!supported.runtimeDescriptorArray || !supported.shaderSampledImageArrayNonUniformIndexing || !supported.descriptorBindingPartiallyBound || !supported.descriptorBindingSampledImageUpdateAfterBind || !supported.descriptorBindingUpdateUnusedWhilePending) {
+		return false;
+	}
+
+	VkPhysicalDeviceDescriptorIndexingPropertiesEXT limits = {};
+	VkPhysicalDeviceProperties2 properties2 = {};
+
+	limits.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+	properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	properties2.pNext = &limits;
+
+	vkGetPhysicalDeviceProperties2(this->m_PhysicalDevice, &properties2);
+
+	this->m_BindlessCapacity = std::min({ this->MAX_BINDLESS_TEXTURES, limits.maxPerStageDescriptorUpdateAfterBindSampledImages, limits.maxDescriptorSetUpdateAfterBindSampledImages });
+
+	enabled.runtimeDescriptorArray = VK_TRUE;
+	enabled.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+	enabled.descriptorBindingPartiallyBound = VK_TRUE;
+	enabled.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+	enabled.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+
+	return this->m_BindlessCapacity > 0;
+}
+#endif
+
+#ifdef VK_KHR_timeline_semaphore
+bool Application::QueryTimelineSemaphoreSupport() {
+	VkPhysicalDeviceProperties properties;
+
+	vkGetPhysicalDeviceProperties(this->m_PhysicalDevice, &properties);
+
+	if (properties.apiVersion < VK_API_VERSION_1_1 || !IsDeviceExtensionSupported(this->m_PhysicalDevice, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME)) {
+		return false;
+	}
+
+	VkPhysicalDeviceTimelineSemaphoreFeaturesKHR supported = {};
+	VkPhysicalDeviceFeatures2 features = {};
+
+	supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+	features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features.pNext = &supported;
+
+	vkGetPhysicalDeviceFeatures2(this->m_PhysicalDevice, &features);
+
+	return supported.timelineSemaphore == VK_TRUE;
+}
+#endif
+
 QueueFamilyIndices Application::FindDeviceQueFamilies(VkPhysicalDevice device) {
 	QueueFamilyIndices indices;
 
@@ -255,32 +390,44 @@ QueueFamilyIndices Application::FindDeviceQueFamilies(VkPhysicalDevice device) {
 
 	int i = 0;
 	for (const auto& queueFamily : queueFamilies) {
-		if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+		if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT && !indices.graphicsFamily.has_value()) {
 			indices.graphicsFamily = i;
 		}
 
 		VkBool32 presentSupport = false;
-		vkGetPhysicalDeviceSurfaceSupportKHR(device, i, this->m_Surface, &presentSupport);
 
-		if (queueFamily.queueCount > 0 && presentSupport) {
+		if (this->m_Surface != VK_NULL_HANDLE) {
+			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, this->m_Surface, &presentSupport);
+		}
+
+		if (queueFamily.queueCount > 0 && presentSupport && !indices.presentFamily.has_value()) {
 			indices.presentFamily = i;
 		}
 
-		if (indices.isComplete()) {
-			break;
+		// A transfer-only family maps to the copy engine on discrete GPUs
+		if (queueFamily.queueCount > 0 && (queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) && !(queueFamily.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+			indices.transferFamily = i;
 		}
 
 		i++;
 	}
 
+	if (!indices.transferFamily.has_value()) {
+		indices.transferFamily = indices.graphicsFamily;
+	}
+
+	if (this->m_Headless) {
+		indices.presentFamily = indices.graphicsFamily;
+	}
+
 	return indices;
 }
 
-bool Application::CreateLogicalDevice() {
+bool Application::CreateLogicalDevice(bool bindlessTextures) {
 	QueueFamilyIndices indices = FindDeviceQueFamilies(this->m_PhysicalDevice); 
 
 	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-	std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.presentFamily.value() };
+	std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.presentFamily.value(), indices.transferFamily.value() };
 
 	float queuePriority = 1.0f;
 	for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -293,8 +440,16 @@ bool Application::CreateLogicalDevice() {
 	}
 
 	VkPhysicalDeviceFeatures deviceFeatures = {};
-	
+	VkPhysicalDeviceFeatures supportedFeatures;
+
+	vkGetPhysicalDeviceFeatures(this->m_PhysicalDevice, &supportedFeatures);
+
+	// Compressed texture families are enabled whenever the device has them, KTX2 files may use any of them
 	deviceFeatures.samplerAnisotropy = VK_TRUE;
+	deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+	deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
+	deviceFeatures.textureCompressionETC2 = supportedFeatures.textureCompressionETC2;
+	deviceFeatures.textureCompressionASTC_LDR = supportedFeatures.textureCompressionASTC_LDR;
 
 	VkDeviceCreateInfo createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -304,24 +459,115 @@ bool Application::CreateLogicalDevice() {
 
 	createInfo.pEnabledFeatures = &deviceFeatures;
 
-	createInfo.enabledExtensionCount = static_cast<uint32_t>(this->m_DeviceExtensions.size());
-	createInfo.ppEnabledExtensionNames = this->m_DeviceExtensions.data();
+	std::vector<const char*> extensions;
+
+	if (!this->m_Headless) {
+		extensions.assign(this->m_DeviceExtensions.begin(), this->m_DeviceExtensions.end());
+	}
 
+#ifdef VK_EXT_descriptor_indexing
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures = {};
+	VkPhysicalDeviceFeatures2 enabledFeatures = {};
 
-	createInfo.enabledLayerCount = static_cast<uint32_t>(this->m_ValidationLayers.size());
-	createInfo.ppEnabledLayerNames = this->m_ValidationLayers.data();
-	
+	indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+
+	if (bindlessTextures && QueryBindlessSupport(indexingFeatures)) {
+		extensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+
+		// Features2 replaces pEnabledFeatures so the indexing features can ride along in its chain
+		enabledFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		enabledFeatures.pNext = &indexingFeatures;
+		enabledFeatures.features = deviceFeatures;
+		createInfo.pNext = &enabledFeatures;
+		createInfo.pEnabledFeatures = nullptr;
+		this->m_BindlessTextures = true;
+	}
+#endif
+
+	if (bindlessTextures && !this->m_BindlessTextures) {
+		printf("Descriptor indexing is not available, textures are bound per draw\n");
+	}
+
+#ifdef VK_KHR_draw_indirect_count
+	bool drawIndirectCount = IsDeviceExtensionSupported(this->m_PhysicalDevice, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+
+	if (drawIndirectCount) {
+		extensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+	}
+#endif
+
+#ifdef VK_KHR_timeline_semaphore
+	VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineFeatures = {};
+
+	timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+	this->m_TimelineSemaphore = QueryTimelineSemaphoreSupport();
+
+	if (this->m_TimelineSemaphore) {
+		extensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+
+		// Sits in front of whatever chain descriptor indexing set up, the device create info accepts either
+		timelineFeatures.timelineSemaphore = VK_TRUE;
+		timelineFeatures.pNext = const_cast<void*>(createInfo.pNext);
+		createInfo.pNext = &timelineFeatures;
+	}
+#endif
+
+	this->m_MultiDrawIndirect = supportedFeatures.multiDrawIndirect == VK_TRUE;
+
+#ifdef VK_EXT_pipeline_creation_feedback
+	this->m_PipelineFeedbackSupported = IsDeviceExtensionSupported(this->m_PhysicalDevice, VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+
+	if (this->m_PipelineFeedbackSupported) {
+		extensions.push_back(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+	}
+#endif
+
+	createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+	createInfo.ppEnabledExtensionNames = extensions.data();
+
+
+	if (this->m_ValidationEnabled) {
+		createInfo.enabledLayerCount = static_cast<uint32_t>(this->m_ValidationLayers.size());
+		createInfo.ppEnabledLayerNames = this->m_ValidationLayers.data();
+	}
 
 	if (vkCreateDevice(this->m_PhysicalDevice, &createInfo, nullptr, &this->m_Device) != VK_SUCCESS) {
 		return false;
 	}
 
+	vkGetPhysicalDeviceProperties(this->m_PhysicalDevice, &this->m_DeviceProperties);
+	this->m_Allocator.Init(this->m_PhysicalDevice, this->m_Device);
+	this->m_RenderGraph.Init(this->m_Device, &this->m_Allocator);
+
+#ifdef VK_KHR_draw_indirect_count
+	if (drawIndirectCount) {
+		this->m_CmdDrawIndexedIndirectCount = (PFN_vkCmdDrawIndexedIndirectCountKHR)vkGetDeviceProcAddr(this->m_Device, "vkCmdDrawIndexedIndirectCountKHR");
+	}
+#endif
+
 	vkGetDeviceQueue(this->m_Device, indices.graphicsFamily.value(), 0, &this->m_GraphicsQueue);
 	vkGetDeviceQueue(this->m_Device, indices.presentFamily.value(), 0, &this->m_PresentQue);
+	vkGetDeviceQueue(this->m_Device, indices.transferFamily.value(), 0, &this->m_TransferQueue);
+
+	if (!this->m_UploadManager.Init(this->m_Device, &this->m_Allocator, indices.graphicsFamily.value(), this->m_GraphicsQueue, indices.transferFamily.value(), this->m_TransferQueue)) {
+		return false;
+	}
+
+	if (!this->m_TextureManager.Init(this->m_Device, &this->m_Allocator, &this->m_UploadManager, &this->m_ThreadPool, this->m_BindlessTextures ? this->m_BindlessCapacity : 0)) {
+		return false;
+	}
+
+	if (!this->m_Profiler.Init(this->m_PhysicalDevice, this->m_Device, indices.graphicsFamily.value(), this->m_FramesInFlight)) {
+		return false;
+	}
 
 	return true;
 }
 
+bool Application::CreatePipelineCache(bool enabled) {
+	return this->m_PipelineCache.Init(this->m_PhysicalDevice, this->m_Device, "pipeline_cache.bin", enabled, this->m_PipelineFeedbackSupported);
+}
+
 bool Application::CreateSurface() {
 	if (glfwCreateWindowSurface(this->m_Instance, this->m_Window, nullptr, &this->m_Surface) != VK_SUCCESS) {
 		return false;
@@ -379,6 +625,11 @@ bool Application::CreateSwapChain(uint32_t width, uint32_t height, bool vsync) {
 	createInfo.imageArrayLayers = 1;
 	createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 
+	// Dynamic resolution blits the scaled scene into the swap chain image
+	if (scDetails.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT) {
+		createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	}
+
 	QueueFamilyIndices indices = FindDeviceQueFamilies(this->m_PhysicalDevice);
 	uint32_t queueFamilyIndices[] = { indices.graphicsFamily.value(), indices.presentFamily.value() };
 
@@ -397,23 +648,101 @@ bool Application::CreateSwapChain(uint32_t width, uint32_t height, bool vsync) {
 	createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 	createInfo.presentMode = presentMode;
 	createInfo.clipped = VK_TRUE;
-	createInfo.oldSwapchain = VK_NULL_HANDLE;
+	createInfo.oldSwapchain = this->m_SwapChain;
+
+	VkSwapchainKHR newSwapChain;
 
-	if (vkCreateSwapchainKHR(this->m_Device, &createInfo, nullptr, &this->m_SwapChain) != VK_SUCCESS) {
+	if (vkCreateSwapchainKHR(this->m_Device, &createInfo, nullptr, &newSwapChain) != VK_SUCCESS) {
 		return false;
 	}
 
+	// Handing the old swap chain over lets the presentation engine reuse its resources during a resize
+	if (this->m_SwapChain != VK_NULL_HANDLE) {
+		vkDestroySwapchainKHR(this->m_Device, this->m_SwapChain, nullptr);
+	}
+
+	this->m_SwapChain = newSwapChain;
+
 	vkGetSwapchainImagesKHR(this->m_Device, this->m_SwapChain, &imageCount, nullptr);
 	this->m_SwapChainImages.resize(imageCount);
 	vkGetSwapchainImagesKHR(this->m_Device, this->m_SwapChain, &imageCount, this->m_SwapChainImages.data());
 	this->m_SwapChainImageFormat = surfaceFormat.format;
 	this->m_SwapChainExtent = extent;
+	this->m_SwapChainBlitTarget = (createInfo.imageUsage & VK_IMAGE_USAGE_TRANSFER_DST_BIT) != 0;
+	this->m_PresentModeStale = false;
+
+	// Latency and pacing are reported per present mode, a resize keeps adding to the current one
+	if (presentMode != this->m_PresentMode) {
+		printf("Present mode: %s\n", GetPresentModeName(presentMode));
+		this->m_Profiler.BeginPresentMode(GetPresentModeName(presentMode));
+	}
+
+	this->m_PresentMode = presentMode;
+
+
+	return true;
+}
+
+bool Application::CreateOffscreenTarget(uint32_t width, uint32_t height, const std::string& dumpDirectory) {
+	VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+	VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+
+	this->m_WindowWidth = width;
+	this->m_WindowHeight = height;
+	this->m_SwapChainImageFormat = format;
+	this->m_SwapChainExtent = { width, height };
+	this->m_SwapChainBlitTarget = true;
+	this->m_DumpDirectory = dumpDirectory;
+
+	// One color target per frame in flight stands in for the swap chain images, the frame index doubles as the image index
+	this->m_SwapChainImages.resize(this->m_FramesInFlight);
+	this->m_OffscreenImageMemory.resize(this->m_FramesInFlight);
+
+	for (size_t i = 0; i < this->m_FramesInFlight; i++) {
+		CreateImage(width, height, 1, format, VK_IMAGE_TILING_OPTIMAL, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->m_SwapChainImages[i], this->m_OffscreenImageMemory[i]);
+	}
+
+	if (dumpDirectory.empty()) {
+		return true;
+	}
+
+	std::error_code error;
+	std::filesystem::create_directories(dumpDirectory, error);
+
+	if (error) {
+		printf("Failed to create %s: %s\n", dumpDirectory.c_str(), error.message().c_str());
+		return false;
+	}
+
+	this->m_ReadbackBuffers.resize(this->m_FramesInFlight);
+	this->m_ReadbackMemory.resize(this->m_FramesInFlight);
+	this->m_PendingDumpFrame.resize(this->m_FramesInFlight, -1);
+
+	for (size_t i = 0; i < this->m_FramesInFlight; i++) {
+		VkDeviceSize size = static_cast<VkDeviceSize>(width) * height * 4;
 
+		if (!CreateBuffers(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, this->m_ReadbackBuffers[i], this->m_ReadbackMemory[i])) {
+			return false;
+		}
+	}
 
 	return true;
 }
 
+bool Application::IsHeadless() {
+	return this->m_Headless;
+}
+
+bool Application::IsValidationEnabled() {
+	return this->m_ValidationEnabled;
+}
+
 VkPresentModeKHR Application::ChooseSwapPresentMode(const std::vector<VkPresentModeKHR> availablePresentModes, bool vsync) {
+	// A mode set through SetPresentMode wins over the vsync flag while the surface still offers it
+	if (std::find(availablePresentModes.begin(), availablePresentModes.end(), this->m_RequestedPresentMode) != availablePresentModes.end()) {
+		return this->m_RequestedPresentMode;
+	}
+
 	if (vsync) {
 		return VK_PRESENT_MODE_FIFO_KHR;
 	}
@@ -459,7 +788,7 @@ bool Application::CreateImageViews() {
 	this->m_SwapChainImageViews.resize(this->m_SwapChainImages.size());
 
 	for (size_t i = 0; i < this->m_SwapChainImages.size(); i++) {
-		this->m_SwapChainImageViews[i] = CreateImageView(this->m_SwapChainImages[i], this->m_SwapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT);
+		this->m_SwapChainImageViews[i] = this->m_Allocator.CreateImageView(this->m_SwapChainImages[i], this->m_SwapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
 	}
 
 	return true;
@@ -470,7 +799,7 @@ bool Application::CreateDescriptorSetLayout() {
 	VkDescriptorSetLayoutBinding uboLayoutBinding = {};
 
 	uboLayoutBinding.binding = 0;
-	uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	uboLayoutBinding.descriptorCount = 1;
 	uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 	uboLayoutBinding.pImmutableSamplers = nullptr;
@@ -483,7 +812,15 @@ bool Application::CreateDescriptorSetLayout() {
 	samplerLayoutBinding.pImmutableSamplers = nullptr;
 	samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-	std::array<VkDescriptorSetLayoutBinding, 2> bindings = { uboLayoutBinding, samplerLayoutBinding };
+	VkDescriptorSetLayoutBinding textureSlotBinding = {};
+
+	textureSlotBinding.binding = 2;
+	textureSlotBinding.descriptorCount = 1;
+	textureSlotBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	textureSlotBinding.pImmutableSamplers = nullptr;
+	textureSlotBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+	std::array<VkDescriptorSetLayoutBinding, 3> bindings = { uboLayoutBinding, samplerLayoutBinding, textureSlotBinding };
 
 	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
 	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -499,15 +836,13 @@ bool Application::CreateDescriptorSetLayout() {
 
 bool Application::CreateGraphicsPipeline() {
 	auto vertShaderCode = ReadFile("shaders/vert.spv");
-	auto fragShaderCode = ReadFile("shaders/frag.spv");
+	auto fragShaderCode = ReadFile(this->m_BindlessTextures ? "shaders/frag_bindless.spv" : "shaders/frag.spv");
 	VkShaderModule vertShaderModule = CreateShaderModule(vertShaderCode);
 	VkShaderModule fragShaderModule = CreateShaderModule(fragShaderCode);
 	VkPipelineShaderStageCreateInfo vi = {};
 	VkPipelineShaderStageCreateInfo fi = {};
 	VkPipelineVertexInputStateCreateInfo vInputInfo = {};
 	VkPipelineInputAssemblyStateCreateInfo inputAsm = {};
-	VkViewport viewport = {};
-	VkRect2D scissor = {};
 	VkPipelineViewportStateCreateInfo viewportState = {};
 	VkPipelineRasterizationStateCreateInfo rasterizer = {};
 	VkPipelineMultisampleStateCreateInfo multisampling = {};
@@ -520,7 +855,7 @@ bool Application::CreateGraphicsPipeline() {
 
 	VkDynamicState dynamicStates[] = {
 		VK_DYNAMIC_STATE_VIEWPORT,
-		VK_DYNAMIC_STATE_LINE_WIDTH
+		VK_DYNAMIC_STATE_SCISSOR
 	};
 
 	vi.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -534,14 +869,18 @@ bool Application::CreateGraphicsPipeline() {
 	fi.pName = "main";
 
 	VkPipelineShaderStageCreateInfo shaderStages[] = { vi, fi };
-	auto bindingDescription = Vertex::GetBindingDescription();
-	auto attributeDescription = Vertex::getAttributeDescriptions();
+	std::array<VkVertexInputBindingDescription, 2> bindingDescription = { Vertex::GetBindingDescription(this->m_VertexFormat), InstanceData::GetBindingDescription() };
+	auto vertexAttributes = Vertex::getAttributeDescriptions(this->m_VertexFormat);
+	auto instanceAttributes = InstanceData::getAttributeDescriptions();
+	std::vector<VkVertexInputAttributeDescription> attributeDescription(vertexAttributes.begin(), vertexAttributes.end());
+
+	attributeDescription.insert(attributeDescription.end(), instanceAttributes.begin(), instanceAttributes.end());
 
 
 
 	vInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vInputInfo.vertexBindingDescriptionCount = 1;
-	vInputInfo.pVertexBindingDescriptions = &bindingDescription;
+	vInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescription.size());
+	vInputInfo.pVertexBindingDescriptions = bindingDescription.data();
 	vInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescription.size());
 	vInputInfo.pVertexAttributeDescriptions = attributeDescription.data();
 
@@ -549,21 +888,12 @@ bool Application::CreateGraphicsPipeline() {
 	inputAsm.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 	inputAsm.primitiveRestartEnable = VK_FALSE;
 
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = (float)this->m_SwapChainExtent.width;
-	viewport.height = (float)this->m_SwapChainExtent.height;
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
-
-	scissor.offset = { 0, 0 };
-	scissor.extent = this->m_SwapChainExtent;
-
+	// Viewport and scissor are dynamic, so the pipeline does not depend on the swap chain extent
 	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 	viewportState.viewportCount = 1;
-	viewportState.pViewports = &viewport;
+	viewportState.pViewports = nullptr;
 	viewportState.scissorCount = 1;
-	viewportState.pScissors = &scissor;
+	viewportState.pScissors = nullptr;
 
 	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
 	rasterizer.depthClampEnable = VK_FALSE;
@@ -614,6 +944,14 @@ bool Application::CreateGraphicsPipeline() {
 	pipelineLayoutInfo.pushConstantRangeCount = 0; 
 	pipelineLayoutInfo.pPushConstantRanges = nullptr; 
 
+	// Bindless draws add the texture table as set 1, each instance picks its slot through the texture slot buffer
+	std::array<VkDescriptorSetLayout, 2> setLayouts = { this->m_DescriptorSetLayout, this->m_TextureManager.GetBindlessSetLayout() };
+
+	if (this->m_BindlessTextures) {
+		pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+		pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+	}
+
 	depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
 	depthStencil.depthTestEnable = VK_TRUE;
 	depthStencil.depthWriteEnable = VK_TRUE;
@@ -639,17 +977,57 @@ bool Application::CreateGraphicsPipeline() {
 	pipelineInfo.pMultisampleState = &multisampling;
 	pipelineInfo.pDepthStencilState = &depthStencil; // Optional
 	pipelineInfo.pColorBlendState = &colorBlending;
-	pipelineInfo.pDynamicState = nullptr; //&dynamicState; // Optional
+	pipelineInfo.pDynamicState = &dynamicState;
 	pipelineInfo.layout = this->m_PipelineLayout;
 	pipelineInfo.renderPass = this->m_RenderPass;
 	pipelineInfo.subpass = 0;
 	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
 	pipelineInfo.basePipelineIndex = -1; // Optional
 
-	if (vkCreateGraphicsPipelines(this->m_Device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &this->m_GraphicsPipeLine) != VK_SUCCESS) {
+	if (this->m_PipelineCache.CreateGraphicsPipeline(pipelineInfo, this->m_GraphicsPipeLine) != VK_SUCCESS) {
+		return false;
+	}
+
+	// Color pass after the depth pre-pass: depth is final already, so each pixel is shaded once
+	depthStencil.depthWriteEnable = VK_FALSE;
+	depthStencil.depthCompareOp = VK_COMPARE_OP_EQUAL;
+
+	if (this->m_PipelineCache.CreateGraphicsPipeline(pipelineInfo, this->m_DepthEqualPipeline) != VK_SUCCESS) {
+		return false;
+	}
+
+	// The pre-pass itself fetches only positions and instance transforms and has no fragment stage
+	auto depthShaderCode = ReadFile("shaders/depth_vert.spv");
+	VkShaderModule depthShaderModule = CreateShaderModule(depthShaderCode);
+	std::array<VkVertexInputBindingDescription, 2> positionBindings = { Vertex::GetPositionBindingDescription(this->m_VertexFormat), InstanceData::GetBindingDescription() };
+	std::vector<VkVertexInputAttributeDescription> positionAttributes(1, Vertex::GetPositionAttributeDescription(this->m_VertexFormat));
+	VkPipelineVertexInputStateCreateInfo positionInputInfo = vInputInfo;
+	VkPipelineColorBlendStateCreateInfo noColorBlending = colorBlending;
+
+	positionAttributes.insert(positionAttributes.end(), instanceAttributes.begin(), instanceAttributes.end());
+	positionInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(positionBindings.size());
+	positionInputInfo.pVertexBindingDescriptions = positionBindings.data();
+	positionInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(positionAttributes.size());
+	positionInputInfo.pVertexAttributeDescriptions = positionAttributes.data();
+
+	noColorBlending.attachmentCount = 0;
+	noColorBlending.pAttachments = nullptr;
+
+	vi.module = depthShaderModule;
+	depthStencil.depthWriteEnable = VK_TRUE;
+	depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+
+	pipelineInfo.stageCount = 1;
+	pipelineInfo.pStages = &vi;
+	pipelineInfo.pVertexInputState = &positionInputInfo;
+	pipelineInfo.pColorBlendState = &noColorBlending;
+	pipelineInfo.renderPass = this->m_DepthPrepassRenderPass;
+
+	if (this->m_PipelineCache.CreateGraphicsPipeline(pipelineInfo, this->m_DepthPrepassPipeline) != VK_SUCCESS) {
 		return false;
 	}
 
+	vkDestroyShaderModule(this->m_Device, depthShaderModule, nullptr);
 	vkDestroyShaderModule(this->m_Device, fragShaderModule, nullptr);
 	vkDestroyShaderModule(this->m_Device, vertShaderModule, nullptr);
 
@@ -661,7 +1039,7 @@ bool Application::CreateFrameBuffers() {
 
 	for (size_t i = 0; i < this->m_SwapChainImageViews.size(); i++) {
 		std::array<VkImageView, 2> attachments{
-			this->m_SwapChainImageViews[i],
+			this->m_SceneColorView != VK_NULL_HANDLE ? this->m_SceneColorView : this->m_SwapChainImageViews[i],
 			this->m_DepthImageView
 		};
 
@@ -670,8 +1048,8 @@ bool Application::CreateFrameBuffers() {
 		framebufferInfo.renderPass = this->m_RenderPass;
 		framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
 		framebufferInfo.pAttachments = attachments.data();
-		framebufferInfo.width = this->m_SwapChainExtent.width; 
-		framebufferInfo.height = this->m_SwapChainExtent.height;
+		framebufferInfo.width = this->m_SceneExtent.width;
+		framebufferInfo.height = this->m_SceneExtent.height;
 		framebufferInfo.layers = 1;
 
 		if (vkCreateFramebuffer(this->m_Device, &framebufferInfo, nullptr, &this->m_SwapChainFramebuffers[i]) != VK_SUCCESS) {
@@ -679,9 +1057,39 @@ bool Application::CreateFrameBuffers() {
 		}
 	}
 
+	// The pre-pass only has the depth attachment, which every swap chain image shares
+	if (this->m_DepthPrepass) {
+		VkFramebufferCreateInfo framebufferInfo = {};
+
+		framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		framebufferInfo.renderPass = this->m_DepthPrepassRenderPass;
+		framebufferInfo.attachmentCount = 1;
+		framebufferInfo.pAttachments = &this->m_DepthImageView;
+		framebufferInfo.width = this->m_SceneExtent.width;
+		framebufferInfo.height = this->m_SceneExtent.height;
+		framebufferInfo.layers = 1;
+
+		if (vkCreateFramebuffer(this->m_Device, &framebufferInfo, nullptr, &this->m_DepthPrepassFramebuffer) != VK_SUCCESS) {
+			return false;
+		}
+	}
+
 	return true;
 }
 
+void Application::DestroyFrameBuffers() {
+	for (auto framebuffer : this->m_SwapChainFramebuffers) {
+		vkDestroyFramebuffer(this->m_Device, framebuffer, nullptr);
+	}
+
+	this->m_SwapChainFramebuffers.clear();
+
+	if (this->m_DepthPrepassFramebuffer != VK_NULL_HANDLE) {
+		vkDestroyFramebuffer(this->m_Device, this->m_DepthPrepassFramebuffer, nullptr);
+		this->m_DepthPrepassFramebuffer = VK_NULL_HANDLE;
+	}
+}
+
 bool Application::CreateCommandPool() {
 	QueueFamilyIndices indices = FindDeviceQueFamilies(this->m_PhysicalDevice);
 	VkCommandPoolCreateInfo poolInfo = {};
@@ -698,39 +1106,47 @@ bool Application::CreateCommandPool() {
 }
 
 bool Application::CreateDescriptorSets() {
-	std::vector<VkDescriptorSetLayout> layouts(this->m_SwapChainImages.size(), this->m_DescriptorSetLayout);
+	std::vector<VkDescriptorSetLayout> layouts(this->m_FramesInFlight, this->m_DescriptorSetLayout);
 	VkDescriptorSetAllocateInfo allocInfo = {};
 
 	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	allocInfo.descriptorPool = this->m_DescriptorPool;
-	allocInfo.descriptorSetCount = static_cast<uint32_t>(this->m_SwapChainImages.size());
+	allocInfo.descriptorSetCount = this->m_FramesInFlight;
 	allocInfo.pSetLayouts = layouts.data();
-	this->m_DescriptionSets.resize(this->m_SwapChainImages.size());
+	this->m_DescriptionSets.resize(this->m_FramesInFlight);
+	this->m_BoundTextureViews.assign(this->m_FramesInFlight, this->m_TextureManager.GetImageView(this->m_Textures.empty() ? TextureManager::PlaceholderTexture : this->m_Textures[0]));
 
 	if (vkAllocateDescriptorSets(this->m_Device, &allocInfo, this->m_DescriptionSets.data()) != VK_SUCCESS) {
 		return false;
 	}
 
-	for (size_t i = 0; i < this->m_SwapChainImages.size(); i++) {
+	// Every set points at the whole uniform arena, the object slot is picked with a dynamic offset at bind time
+	for (size_t i = 0; i < this->m_DescriptionSets.size(); i++) {
 		VkDescriptorBufferInfo bufferInfo = {};
 
-		bufferInfo.buffer = this->m_UniformBuffers[i];
+		bufferInfo.buffer = this->m_UniformBuffer;
 		bufferInfo.offset = 0;
 		bufferInfo.range = sizeof(UniformBufferObject);
 
 		VkDescriptorImageInfo imageInfo = {};
 
 		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		imageInfo.imageView = this->m_TextureImageView;
+		imageInfo.imageView = this->m_BoundTextureViews[i];
 		imageInfo.sampler = this->m_TextureSampler;
 
-		std::array<VkWriteDescriptorSet, 2> descriptorWrites = {};
+		VkDescriptorBufferInfo slotInfo = {};
+
+		slotInfo.buffer = this->m_TextureSlotBuffer;
+		slotInfo.offset = this->m_TextureSlotRegionSize * i;
+		slotInfo.range = sizeof(uint32_t) * this->MAX_BINDLESS_TEXTURES;
+
+		std::array<VkWriteDescriptorSet, 3> descriptorWrites = {};
 
 		descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 		descriptorWrites[0].dstSet = this->m_DescriptionSets[i];
 		descriptorWrites[0].dstBinding = 0;
 		descriptorWrites[0].dstArrayElement = 0;
-		descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 		descriptorWrites[0].descriptorCount = 1;
 		descriptorWrites[0].pBufferInfo = &bufferInfo;
 
@@ -742,6 +1158,13 @@ bool Application::CreateDescriptorSets() {
 		descriptorWrites[1].descriptorCount = 1;
 		descriptorWrites[1].pImageInfo = &imageInfo;
 
+		descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[2].dstSet = this->m_DescriptionSets[i];
+		descriptorWrites[2].dstBinding = 2;
+		descriptorWrites[2].dstArrayElement = 0;
+		descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorWrites[2].descriptorCount = 1;
+		descriptorWrites[2].pBufferInfo = &slotInfo;
 
 		vkUpdateDescriptorSets(this->m_Device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
 	}
@@ -757,8 +1180,9 @@ bool Application::CreateRenderPass() {
 	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	// Layout transitions in and out of the pass are done by the render graph's barriers
+	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
 	VkAttachmentDescription depthAttachment = {};
 	depthAttachment.format = FindDepthFormat();
@@ -767,7 +1191,7 @@ bool Application::CreateRenderPass() {
 	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
 	VkAttachmentReference colorAttachmentRef = {};
@@ -784,14 +1208,6 @@ bool Application::CreateRenderPass() {
 	subpass.pColorAttachments = &colorAttachmentRef;
 	subpass.pDepthStencilAttachment = &depthAttachmentRef;
 
-	VkSubpassDependency dependency = {};
-	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-	dependency.dstSubpass = 0;
-	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.srcAccessMask = 0;
-	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
 	std::array<VkAttachmentDescription, 2> attachments = { colorAttachment, depthAttachment };
 
 	VkRenderPassCreateInfo renderPassInfo = {};
@@ -800,57 +1216,113 @@ bool Application::CreateRenderPass() {
 	renderPassInfo.pAttachments = attachments.data();
 	renderPassInfo.subpassCount = 1;
 	renderPassInfo.pSubpasses = &subpass;
-	renderPassInfo.dependencyCount = 1;
-	renderPassInfo.pDependencies = &dependency;
+	renderPassInfo.dependencyCount = 0;
+	renderPassInfo.pDependencies = nullptr;
 
 	if (vkCreateRenderPass(this->m_Device, &renderPassInfo, nullptr, &this->m_RenderPass) != VK_SUCCESS) {
 		return false;
 	}
 
+	// Depth pre-pass: a depth-only pass clears and stores depth, then the color pass loads it read-only
+	VkAttachmentDescription prepassDepthAttachment = depthAttachment;
+	VkSubpassDescription prepassSubpass = {};
+
+	prepassDepthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	prepassSubpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	prepassSubpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+	renderPassInfo.attachmentCount = 1;
+	renderPassInfo.pAttachments = &prepassDepthAttachment;
+	renderPassInfo.pSubpasses = &prepassSubpass;
+
+	if (vkCreateRenderPass(this->m_Device, &renderPassInfo, nullptr, &this->m_DepthPrepassRenderPass) != VK_SUCCESS) {
+		return false;
+	}
+
+	// Only layouts and load/store ops differ from m_RenderPass, so it stays compatible with its framebuffers and pipelines
+	attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	attachments[1].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+	attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+	depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+	renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+	renderPassInfo.pAttachments = attachments.data();
+	renderPassInfo.pSubpasses = &subpass;
+
+	if (vkCreateRenderPass(this->m_Device, &renderPassInfo, nullptr, &this->m_DepthEqualRenderPass) != VK_SUCCESS) {
+		return false;
+	}
+
 	return true;
 }
 
 bool Application::CreateTextureImage(const char* fileName) {
-	int texWidth;
-	int texHeight;
-	int texChannels;
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	stbi_uc* pixels = stbi_load(fileName, &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-	VkDeviceSize imageSize = texWidth * texHeight * 4;
-	void* data;
-
-	if (!pixels) {
-		return false;
+	// Decoding happens on the thread pool, until the upload lands the descriptors point at the placeholder
+	this->m_Textures.push_back(this->m_TextureManager.Load(fileName));
+
+	return true;
+}
+
+void Application::RefreshTextureDescriptors(size_t frame) {
+	if (this->m_TextureManager.Update()) {
+		this->m_TextureSlotRegionsStale = static_cast<int>(this->m_FramesInFlight);
+	}
+
+	// Bindless draws never touch a descriptor here: the frame's slot region is rewritten and recorded buffers stay valid.
+	// Frames run in order, so the next m_FramesInFlight frames cover every region once
+	if (this->m_BindlessTextures) {
+		if (this->m_TextureSlotRegionsStale > 0) {
+			uint32_t* slots = reinterpret_cast<uint32_t*>(static_cast<char*>(this->m_TextureSlotMemory.mapped) + this->m_TextureSlotRegionSize * frame);
+			uint32_t textureCount = static_cast<uint32_t>(std::min<size_t>(this->m_TextureManager.GetTextureCount(), this->MAX_BINDLESS_TEXTURES));
+
+			for (uint32_t handle = 0; handle < textureCount; handle++) {
+				slots[handle] = this->m_TextureManager.GetBindlessIndex(handle);
+			}
+
+			this->m_TextureSlotRegionsStale--;
+		}
+
+		return;
 	}
 
-	CreateBuffers(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+	VkImageView view = this->m_TextureManager.GetImageView(this->m_Textures.empty() ? TextureManager::PlaceholderTexture : this->m_Textures[0]);
+
+	if (this->m_BoundTextureViews[frame] == view) {
+		return;
+	}
 
+	// The frame's fence has been waited on, so its set is idle; the recorded buffers that bind it are now invalid
+	VkDescriptorImageInfo imageInfo = {};
 
-	vkMapMemory(this->m_Device, stagingBufferMemory, 0, imageSize, 0, &data);
-	memcpy(data, pixels, static_cast<size_t>(imageSize));
-	vkUnmapMemory(this->m_Device, stagingBufferMemory);
-	stbi_image_free(pixels);
-	CreateImage(texWidth, texHeight, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->m_TextureImage, this->m_TextureImageMemory);
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	imageInfo.imageView = view;
+	imageInfo.sampler = this->m_TextureSampler;
 
-	TransitionImageLayout(this->m_TextureImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-	CopyBufferToImage(stagingBuffer, this->m_TextureImage, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
-	TransitionImageLayout(this->m_TextureImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	VkWriteDescriptorSet descriptorWrite = {};
 
-	vkDestroyBuffer(this->m_Device, stagingBuffer, nullptr);
-	vkFreeMemory(this->m_Device, stagingBufferMemory, nullptr);
+	descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrite.dstSet = this->m_DescriptionSets[frame];
+	descriptorWrite.dstBinding = 1;
+	descriptorWrite.dstArrayElement = 0;
+	descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	descriptorWrite.descriptorCount = 1;
+	descriptorWrite.pImageInfo = &imageInfo;
 
-	return true;
+	vkUpdateDescriptorSets(this->m_Device, 1, &descriptorWrite, 0, nullptr);
+	this->m_BoundTextureViews[frame] = view;
+
+	MarkCommandBuffersDirty();
 }
 
-void Application::CreateImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory) {
+void Application::CreateImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, Allocation& imageMemory) {
 	VkImageCreateInfo imageInfo = {};
 	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
 	imageInfo.imageType = VK_IMAGE_TYPE_2D;
 	imageInfo.extent.width = width;
 	imageInfo.extent.height = height;
 	imageInfo.extent.depth = 1;
-	imageInfo.mipLevels = 1;
+	imageInfo.mipLevels = mipLevels;
 	imageInfo.arrayLayers = 1;
 	imageInfo.format = format;
 	imageInfo.tiling = tiling;
@@ -866,49 +1338,24 @@ void Application::CreateImage(uint32_t width, uint32_t height, VkFormat format,
 	VkMemoryRequirements memRequirements;
 	vkGetImageMemoryRequirements(this->m_Device, image, &memRequirements);
 
-	VkMemoryAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = FindMemoryType(memRequirements.memoryTypeBits, properties);
+	uint32_t memoryType = this->m_Allocator.FindMemoryType(memRequirements.memoryTypeBits, properties);
+	bool dedicated = memRequirements.size >= MemoryAllocator::DedicatedImageThreshold;
 
-	if (vkAllocateMemory(this->m_Device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
+	if (!this->m_Allocator.Allocate(memRequirements, memoryType, tiling == VK_IMAGE_TILING_LINEAR, dedicated, imageMemory)) {
 		throw std::runtime_error("failed to allocate image memory!");
 	}
 
-	vkBindImageMemory(this->m_Device, image, imageMemory, 0);
+	vkBindImageMemory(this->m_Device, image, imageMemory.memory, imageMemory.offset);
 }
 
-bool Application::CreateTextureImageViews() {
-	this->m_TextureImageView = CreateImageView(this->m_TextureImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT);
-
-
-	return true;
+void Application::DestroyImage(VkImage& image, Allocation& imageMemory) {
+	vkDestroyImage(this->m_Device, image, nullptr);
+	this->m_Allocator.Free(imageMemory);
+	image = VK_NULL_HANDLE;
 }
 
-VkImageView Application::CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags) {
-	VkImageViewCreateInfo viewInfo = {};
-
-	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-	viewInfo.image = image;
-	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-	viewInfo.format = format;
-	viewInfo.subresourceRange.aspectMask = aspectFlags;
-	viewInfo.subresourceRange.baseMipLevel = 0;
-	viewInfo.subresourceRange.levelCount = 1;
-	viewInfo.subresourceRange.baseArrayLayer = 0;
-	viewInfo.subresourceRange.layerCount = 1;
-
-	VkImageView imageView;
-
-	if (vkCreateImageView(this->m_Device, &viewInfo, nullptr, &imageView) != VK_SUCCESS) {
-		throw std::runtime_error("Failed to Create Texture Image View!");
-	}
-
-	return imageView;
-}
-
-bool Application::CreateTextureSampler() {
-	VkSamplerCreateInfo samplerInfo = {};
+bool Application::CreateTextureSampler() {
+	VkSamplerCreateInfo samplerInfo = {};
 
 	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
 	samplerInfo.magFilter = VK_FILTER_LINEAR;
@@ -925,84 +1372,383 @@ bool Application::CreateTextureSampler() {
 	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
 	samplerInfo.mipLodBias = 0.0f;
 	samplerInfo.minLod = 0.0f;
-	samplerInfo.maxLod = 0.0f;
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
 
 	if (vkCreateSampler(this->m_Device, &samplerInfo, nullptr, &this->m_TextureSampler) != VK_SUCCESS) {
 		return false;
 	}
 
+	this->m_TextureManager.SetBindlessSampler(this->m_TextureSampler);
+
+	return true;
+}
+
+bool Application::CreateVertexBuffer(bool gpuAnimation) {
+	this->m_GpuAnimation = gpuAnimation && !this->m_Mesh.IsOpen();
+
+	if (this->m_Mesh.IsOpen()) {
+		if (!CreateBuffers(this->m_Mesh.GetVertexDataSize(), VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->m_VertexBuffer, this->m_VertexBufferMemory)) {
+			return false;
+		}
+
+		UploadMapped(this->m_VertexBuffer, this->m_Mesh.GetVertexData(), this->m_Mesh.GetVertexDataSize(), VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+		this->m_VertexRegionSize = 0;
+		this->m_VertexCapacity = static_cast<size_t>(this->m_Mesh.GetVertexCount());
+
+		return true;
+	}
+
+	if (!this->m_GpuAnimation) {
+		this->m_Animator.Build(this->m_Vertices.data(), this->m_Vertices.size(), sizeof(Vertex), offsetof(Vertex, pos), offsetof(Vertex, color));
+
+		return ReserveVertexCapacity(this->m_Vertices.size());
+	}
+
+	// The compute pass rewrites colors in place, so a single device local copy is shared by every frame in flight
+	VkDeviceSize vertexSize = Vertex::GetStride(this->m_VertexFormat) * this->m_Vertices.size();
+	std::vector<uint8_t> stream(vertexSize);
+	VkBufferUsageFlags storageUsage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	VkAccessFlags shaderAccess = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	if (!CreateBuffers(vertexSize, storageUsage | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->m_VertexBuffer, this->m_VertexBufferMemory)) {
+		return false;
+	}
+
+	Vertex::Encode(this->m_Vertices.data(), this->m_Vertices.size(), this->m_VertexFormat, stream.data());
+	this->m_UploadManager.UploadBuffer(this->m_VertexBuffer, 0, stream.data(), vertexSize, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | shaderAccess);
+	this->m_VertexRegionSize = 0;
+	this->m_VertexCapacity = this->m_Vertices.size();
+
+	this->m_Animator.BuildGroups(this->m_Vertices.data(), this->m_Vertices.size(), sizeof(Vertex), offsetof(Vertex, pos));
+
+	const std::vector<uint32_t>& vertexGroups = this->m_Animator.GetVertexGroups();
+	std::vector<AnimationGroupState> groups(this->m_Animator.GetGroupCount());
+
+	// Each group starts from the color of its first member
+	for (size_t i = vertexGroups.size(); i-- > 0;) {
+		groups[vertexGroups[i]].color = glm::vec4(this->m_Vertices[i].color, 1.0f);
+	}
+
+	this->m_AnimationGroupCount = static_cast<uint32_t>(groups.size());
+
+	VkDeviceSize groupIndexSize = sizeof(uint32_t) * vertexGroups.size();
+	VkDeviceSize groupStateSize = sizeof(AnimationGroupState) * groups.size();
+
+	if (!CreateBuffers(groupIndexSize, storageUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->m_VertexGroupBuffer, this->m_VertexGroupMemory)) {
+		return false;
+	}
+
+	if (!CreateBuffers(groupStateSize, storageUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->m_GroupStateBuffer, this->m_GroupStateMemory)) {
+		return false;
+	}
+
+	this->m_UploadManager.UploadBuffer(this->m_VertexGroupBuffer, 0, vertexGroups.data(), groupIndexSize, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+	this->m_UploadManager.UploadBuffer(this->m_GroupStateBuffer, 0, groups.data(), groupStateSize, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, shaderAccess);
+
 	return true;
 }
 
-bool Application::CreateVertexBuffer() {
-	VkDeviceSize bufferSize = sizeof(this->m_Vertices[0]) * this->m_Vertices.size();
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	void* data;
+bool Application::CreateAnimationPipeline() {
+	if (!this->m_GpuAnimation) {
+		return true;
+	}
+
+	std::array<VkDescriptorSetLayoutBinding, 3> bindings = {};
+
+	for (uint32_t i = 0; i < bindings.size(); i++) {
+		bindings[i].binding = i;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+
+	if (vkCreateDescriptorSetLayout(this->m_Device, &layoutInfo, nullptr, &this->m_AnimationSetLayout) != VK_SUCCESS) {
+		return false;
+	}
+
+	VkDescriptorPoolSize poolSize = {};
+	poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSize.descriptorCount = static_cast<uint32_t>(bindings.size());
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+	poolInfo.maxSets = 1;
+
+	if (vkCreateDescriptorPool(this->m_Device, &poolInfo, nullptr, &this->m_AnimationDescriptorPool) != VK_SUCCESS) {
+		return false;
+	}
 
-	CreateBuffers(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = this->m_AnimationDescriptorPool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &this->m_AnimationSetLayout;
 
-	vkMapMemory(this->m_Device, stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, this->m_Vertices.data(), (size_t)bufferSize);
-	vkUnmapMemory(this->m_Device, stagingBufferMemory);
+	if (vkAllocateDescriptorSets(this->m_Device, &allocInfo, &this->m_AnimationSet) != VK_SUCCESS) {
+		return false;
+	}
 
-	if (this->m_VertexBufferMemory != NULL) {
+	std::array<VkDescriptorBufferInfo, 3> bufferInfos = {};
+	std::array<VkWriteDescriptorSet, 3> descriptorWrites = {};
+
+	bufferInfos[0].buffer = this->m_VertexBuffer;
+	bufferInfos[1].buffer = this->m_VertexGroupBuffer;
+	bufferInfos[2].buffer = this->m_GroupStateBuffer;
+
+	for (uint32_t i = 0; i < descriptorWrites.size(); i++) {
+		bufferInfos[i].offset = 0;
+		bufferInfos[i].range = VK_WHOLE_SIZE;
+
+		descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[i].dstSet = this->m_AnimationSet;
+		descriptorWrites[i].dstBinding = i;
+		descriptorWrites[i].dstArrayElement = 0;
+		descriptorWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorWrites[i].descriptorCount = 1;
+		descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+	}
+
+	vkUpdateDescriptorSets(this->m_Device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(AnimationPushConstants);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &this->m_AnimationSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	if (vkCreatePipelineLayout(this->m_Device, &pipelineLayoutInfo, nullptr, &this->m_AnimationPipelineLayout) != VK_SUCCESS) {
+		return false;
+	}
+
+	auto compShaderCode = ReadFile("shaders/comp.spv");
+	VkShaderModule compShaderModule = CreateShaderModule(compShaderCode);
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = compShaderModule;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.layout = this->m_AnimationPipelineLayout;
+
+	VkResult result = this->m_PipelineCache.CreateComputePipeline(pipelineInfo, this->m_AnimationPipeline);
+
+	vkDestroyShaderModule(this->m_Device, compShaderModule, nullptr);
+
+	return result == VK_SUCCESS;
+}
+
+bool Application::ReserveVertexCapacity(size_t vertexCount) {
+	if (vertexCount <= this->m_VertexCapacity && this->m_VertexBuffer != VK_NULL_HANDLE) {
+		return true;
+	}
+
+	size_t capacity = std::max<size_t>(vertexCount, this->m_VertexCapacity * 2);
+	VkDeviceSize regionSize = Vertex::GetStride(this->m_VertexFormat) * capacity;
+
+	// Each frame in flight streams into its own region, so regions start on a generous boundary
+	regionSize = (regionSize + 255) & ~VkDeviceSize(255);
+
+	if (this->m_VertexBuffer != VK_NULL_HANDLE) {
 		vkDeviceWaitIdle(this->m_Device);
-		vkFreeCommandBuffers(this->m_Device, this->m_CommandPool, static_cast<uint32_t>(this->m_CommandBuffers.size()), this->m_CommandBuffers.data());
-		vkDestroyBuffer(this->m_Device, this->m_VertexBuffer, nullptr);
-		vkFreeMemory(this->m_Device, this->m_VertexBufferMemory, nullptr);
+		DestroyBuffer(this->m_VertexBuffer, this->m_VertexBufferMemory);
 	}
 
-	CreateBuffers(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->m_VertexBuffer, this->m_VertexBufferMemory);
+	if (!CreateBuffers(regionSize * this->m_FramesInFlight, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, this->m_VertexBuffer, this->m_VertexBufferMemory)) {
+		return false;
+	}
+
+	this->m_VertexRegionSize = regionSize;
+	this->m_VertexCapacity = capacity;
+
+	for (size_t i = 0; i < this->m_FramesInFlight; i++) {
+		Vertex::Encode(this->m_Vertices.data(), this->m_Vertices.size(), this->m_VertexFormat, static_cast<char*>(this->m_VertexBufferMemory.mapped) + this->m_VertexRegionSize * i);
+	}
 
-	CopyBuffer(stagingBuffer, this->m_VertexBuffer, bufferSize);
-	vkDestroyBuffer(this->m_Device, stagingBuffer, nullptr);
-	vkFreeMemory(this->m_Device, stagingBufferMemory, nullptr);
+	// Recorded command buffers bind the old buffer, so they have to be recorded again
+	MarkCommandBuffersDirty();
 
 	return true;
 }
 
 bool Application::CreateIndexBuffer() {
-	VkDeviceSize bufferSize = sizeof(this->m_Indices[0]) * this->m_Indices.size();
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
+	VkDeviceSize bufferSize = this->m_Mesh.IsOpen() ? this->m_Mesh.GetIndexDataSize() : sizeof(this->m_Indices[0]) * this->m_Indices.size();
+
+	if (!CreateBuffers(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->m_IndexBuffer, this->m_IndexBufferMemory)) {
+		return false;
+	}
+
+	if (this->m_Mesh.IsOpen()) {
+		UploadMapped(this->m_IndexBuffer, this->m_Mesh.GetIndexData(), bufferSize, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
+	}
+	else {
+		this->m_UploadManager.UploadBuffer(this->m_IndexBuffer, 0, this->m_Indices.data(), bufferSize, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
+	}
+
+	return true;
+}
+
+// Uploads a large read-only range, such as a mapped mesh stream, in MESH_UPLOAD_CHUNK slices. Only two
+// slices are staged at a time, so staging memory stays bounded and faulting in the next slice from the
+// file overlaps the copy of the previous one
+void Application::UploadMapped(VkBuffer buffer, const void* data, VkDeviceSize size, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	uint64_t previousTicket = 0;
+
+	for (VkDeviceSize offset = 0; offset < size; offset += this->MESH_UPLOAD_CHUNK) {
+		VkDeviceSize chunkSize = std::min(this->MESH_UPLOAD_CHUNK, size - offset);
+
+		this->m_UploadManager.UploadBuffer(buffer, offset, bytes + offset, chunkSize, dstStage, dstAccess);
+
+		uint64_t ticket = this->m_UploadManager.Submit();
+
+		if (previousTicket != 0) {
+			this->m_UploadManager.Wait(previousTicket);
+		}
+
+		previousTicket = ticket;
+	}
+}
+
+bool Application::CreateInstanceBuffer(uint32_t instanceCount) {
+	uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(std::max(instanceCount, 1u)))));
+	float cell = 2.0f / side;
+
+	this->m_Instances.resize(std::max(instanceCount, 1u));
+
+	// A single instance keeps the original scene; more are laid out on a grid that covers the same area
+	for (uint32_t i = 0; i < this->m_Instances.size(); i++) {
+		InstanceData& instance = this->m_Instances[i];
+		TextureHandle texture = this->m_Textures.empty() ? TextureManager::PlaceholderTexture : this->m_Textures[i % this->m_Textures.size()];
+
+		instance.transform = glm::mat4(1.0f);
+		instance.tint = glm::vec4(1.0f);
+		instance.textureHandle = texture < this->MAX_BINDLESS_TEXTURES ? texture : TextureManager::PlaceholderTexture;
+
+		if (this->m_Instances.size() > 1) {
+			glm::vec3 center(-1.0f + cell * (i % side + 0.5f), -1.0f + cell * (i / side + 0.5f), 0.0f);
+
+			instance.transform = glm::scale(glm::translate(glm::mat4(1.0f), center), glm::vec3(cell * 0.4f));
+			instance.tint = glm::vec4(0.75f + 0.25f * center.x, 0.75f + 0.25f * center.y, 1.0f, 1.0f);
+		}
+	}
+
+	// The culler tests the mesh's bounding sphere carried through each instance transform
+	glm::vec4 bounds = this->m_Mesh.IsOpen() ? this->m_Mesh.GetBoundingSphere() : Vertex::ComputeBoundingSphere(this->m_Vertices.data(), this->m_Vertices.size());
+
+	this->m_Culler.Resize(this->m_Instances.size());
+
+	for (size_t i = 0; i < this->m_Instances.size(); i++) {
+		const glm::mat4& transform = this->m_Instances[i].transform;
+		float scale = std::max(glm::length(glm::vec3(transform[0])), std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+
+		this->m_Culler.SetSphere(i, glm::vec3(transform * glm::vec4(glm::vec3(bounds), 1.0f)), bounds.w * scale);
+	}
+
+	// Each frame in flight gets a region the visible instances are compacted into, every region starts with all of them
+	this->m_InstanceRegionSize = (sizeof(InstanceData) * this->m_Instances.size() + 255) & ~VkDeviceSize(255);
+
+	if (!CreateBuffers(this->m_InstanceRegionSize * this->m_FramesInFlight, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, this->m_InstanceBuffer, this->m_InstanceBufferMemory)) {
+		return false;
+	}
+
+	for (size_t i = 0; i < this->m_FramesInFlight; i++) {
+		memcpy(static_cast<char*>(this->m_InstanceBufferMemory.mapped) + this->m_InstanceRegionSize * i, this->m_Instances.data(), sizeof(InstanceData) * this->m_Instances.size());
+	}
+
+	return true;
+}
+
+// One command per quad in m_Indices, or per submesh of a loaded mesh, each drawing every instance,
+// followed by the draw count the count variant reads
+bool Application::CreateIndirectBuffer() {
+	std::vector<VkDrawIndexedIndirectCommand> commands(this->m_Mesh.IsOpen() ? this->m_Mesh.GetSubmeshes().size() : this->m_Indices.size() / 6);
 
-	CreateBuffers(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+	for (uint32_t i = 0; i < commands.size(); i++) {
+		commands[i].indexCount = 6;
+		commands[i].instanceCount = static_cast<uint32_t>(this->m_Instances.size());
+		commands[i].firstIndex = i * 6;
+		commands[i].vertexOffset = 0;
+		commands[i].firstInstance = 0;
 
-	void* data;
-	vkMapMemory(this->m_Device, stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, this->m_Indices.data(), (size_t)bufferSize);
-	vkUnmapMemory(this->m_Device, stagingBufferMemory);
+		if (this->m_Mesh.IsOpen()) {
+			const MeshSubmesh& submesh = this->m_Mesh.GetSubmeshes()[i];
+
+			commands[i].indexCount = submesh.indexCount;
+			commands[i].firstIndex = submesh.firstIndex;
+			commands[i].vertexOffset = submesh.vertexOffset;
+		}
+	}
+
+	this->m_DrawCommandCount = static_cast<uint32_t>(commands.size());
+	this->m_DrawCountOffset = sizeof(VkDrawIndexedIndirectCommand) * commands.size();
+
+	// Culling rewrites the instance counts every frame, so like the instances there is one region per frame in flight
+	this->m_IndirectRegionSize = (this->m_DrawCountOffset + sizeof(uint32_t) + 255) & ~VkDeviceSize(255);
+
+	if (!CreateBuffers(this->m_IndirectRegionSize * this->m_FramesInFlight, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, this->m_IndirectBuffer, this->m_IndirectBufferMemory)) {
+		return false;
+	}
 
-	CreateBuffers(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->m_IndexBuffer, this->m_IndexBufferMemory);
-	CopyBuffer(stagingBuffer, this->m_IndexBuffer, bufferSize);
+	for (size_t i = 0; i < this->m_FramesInFlight; i++) {
+		char* region = static_cast<char*>(this->m_IndirectBufferMemory.mapped) + this->m_IndirectRegionSize * i;
 
-	vkDestroyBuffer(this->m_Device, stagingBuffer, nullptr);
-	vkFreeMemory(this->m_Device, stagingBufferMemory, nullptr);
+		memcpy(region, commands.data(), static_cast<size_t>(this->m_DrawCountOffset));
+		memcpy(region + this->m_DrawCountOffset, &this->m_DrawCommandCount, sizeof(uint32_t));
+	}
 
 	return true;
 }
 
 bool Application::CreateUniformBuffers() {
-	VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+	VkDeviceSize alignment = this->m_DeviceProperties.limits.minUniformBufferOffsetAlignment;
 
-	this->m_UniformBuffers.resize(this->m_SwapChainImages.size());
-	this->m_UniformBufferMemory.resize(this->m_SwapChainImages.size());
+	// One persistently mapped arena: MAX_UNIFORM_OBJECTS aligned slots for each frame in flight
+	this->m_UniformStride = (sizeof(UniformBufferObject) + alignment - 1) & ~(alignment - 1);
 
-	for (size_t i = 0; i < this->m_SwapChainImages.size(); i++) {
-		CreateBuffers(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, this->m_UniformBuffers[i], this->m_UniformBufferMemory[i]);
+	VkDeviceSize bufferSize = this->m_UniformStride * this->MAX_UNIFORM_OBJECTS * this->m_FramesInFlight;
+
+	if (!CreateBuffers(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, this->m_UniformBuffer, this->m_UniformBufferMemory)) {
+		return false;
+	}
+
+	// Texture handle -> bindless slot, one region per frame in flight so a region is only rewritten once its frame is idle
+	VkDeviceSize slotAlignment = this->m_DeviceProperties.limits.minStorageBufferOffsetAlignment;
+
+	this->m_TextureSlotRegionSize = (sizeof(uint32_t) * this->MAX_BINDLESS_TEXTURES + slotAlignment - 1) & ~(slotAlignment - 1);
+
+	if (!CreateBuffers(this->m_TextureSlotRegionSize * this->m_FramesInFlight, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, this->m_TextureSlotBuffer, this->m_TextureSlotMemory)) {
+		return false;
 	}
 
+	memset(this->m_TextureSlotMemory.mapped, 0, static_cast<size_t>(this->m_TextureSlotRegionSize * this->m_FramesInFlight));
+	this->m_TextureSlotRegionsStale = static_cast<int>(this->m_FramesInFlight);
+
 	return true;
 }
 
 bool Application::CreateDescriptorPool() {
-	std::array<VkDescriptorPoolSize, 2> poolSizes = {};
+	std::array<VkDescriptorPoolSize, 3> poolSizes = {};
 
-	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	poolSizes[0].descriptorCount = static_cast<uint32_t>(this->m_SwapChainImages.size());
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	poolSizes[0].descriptorCount = this->m_FramesInFlight;
 	poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	poolSizes[1].descriptorCount = static_cast<uint32_t>(this->m_SwapChainImages.size());
+	poolSizes[1].descriptorCount = this->m_FramesInFlight;
+	poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[2].descriptorCount = this->m_FramesInFlight;
 
 
 	VkDescriptorPoolCreateInfo poolInfo = {};
@@ -1010,7 +1756,7 @@ bool Application::CreateDescriptorPool() {
 	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
 	poolInfo.pPoolSizes = poolSizes.data();
-	poolInfo.maxSets = static_cast<uint32_t>(this->m_SwapChainImages.size());
+	poolInfo.maxSets = this->m_FramesInFlight;
 
 	if (vkCreateDescriptorPool(this->m_Device, &poolInfo, nullptr, &this->m_DescriptorPool) != VK_SUCCESS) {
 		return false;
@@ -1019,7 +1765,7 @@ bool Application::CreateDescriptorPool() {
 	return true;
 }
 
-bool Application::CreateBuffers(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
+bool Application::CreateBuffers(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, Allocation& bufferMemory) {
 	VkBufferCreateInfo bufferInfo = {};
 
 	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -1035,283 +1781,588 @@ bool Application::CreateBuffers(VkDeviceSize size, VkBufferUsageFlags usage, VkM
 
 	vkGetBufferMemoryRequirements(this->m_Device, buffer, &memRequirements);
 
-	VkMemoryAllocateInfo allocInfo = {};
+	if (!this->m_Allocator.Allocate(memRequirements, this->m_Allocator.FindMemoryType(memRequirements.memoryTypeBits, properties), true, false, bufferMemory)) {
+		vkDestroyBuffer(this->m_Device, buffer, nullptr);
+		return false;
+	}
+
+	vkBindBufferMemory(this->m_Device, buffer, bufferMemory.memory, bufferMemory.offset);
+
+	return true;
+}
+
+void Application::DestroyBuffer(VkBuffer& buffer, Allocation& bufferMemory) {
+	vkDestroyBuffer(this->m_Device, buffer, nullptr);
+	this->m_Allocator.Free(bufferMemory);
+	buffer = VK_NULL_HANDLE;
+}
+
+bool Application::CreateCommandBuffers() {
+	QueueFamilyIndices indices = FindDeviceQueFamilies(this->m_PhysicalDevice);
+	size_t imageCount = this->m_SwapChainFramebuffers.size();
+
+	// Each frame in flight records into its own transient pool, so a whole frame's buffers are reset in one call
+	if (this->m_FrameCommandPools.empty()) {
+		this->m_FrameCommandPools.resize(this->m_FramesInFlight);
+		this->m_CommandBuffers.resize(this->m_FramesInFlight);
+		this->m_RecordedGeneration.resize(this->m_FramesInFlight);
+		this->m_FramePoolGeneration.resize(this->m_FramesInFlight, 0);
+
+		for (size_t frame = 0; frame < this->m_FramesInFlight; frame++) {
+			VkCommandPoolCreateInfo poolInfo = {};
+
+			poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+			poolInfo.queueFamilyIndex = indices.graphicsFamily.value();
+			poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+			if (vkCreateCommandPool(this->m_Device, &poolInfo, nullptr, &this->m_FrameCommandPools[frame]) != VK_SUCCESS) {
+				return false;
+			}
+		}
+	}
+
+	for (size_t frame = 0; frame < this->m_FramesInFlight; frame++) {
+		std::vector<VkCommandBuffer>& buffers = this->m_CommandBuffers[frame];
+
+		if (buffers.size() < imageCount) {
+			VkCommandBufferAllocateInfo allocInfo = {};
+			size_t existing = buffers.size();
+
+			buffers.resize(imageCount);
+			allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocInfo.commandPool = this->m_FrameCommandPools[frame];
+			allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			allocInfo.commandBufferCount = static_cast<uint32_t>(imageCount - existing);
+
+			if (vkAllocateCommandBuffers(this->m_Device, &allocInfo, buffers.data() + existing) != VK_SUCCESS) {
+				return false;
+			}
+		}
+
+		this->m_RecordedGeneration[frame].resize(buffers.size(), 0);
+
+		if (!AllocateSecondaryCommandBuffers(frame)) {
+			return false;
+		}
+	}
+
+	MarkCommandBuffersDirty();
 
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = FindMemoryType(memRequirements.memoryTypeBits, properties);
+	return true;
+}
+
+// Must be called before CreateGraphicsPipeline and CreateVertexBuffer, both are built for one layout
+void Application::SetVertexFormat(VertexFormat format) {
+	VkFormatProperties positionProperties;
+	VkFormatProperties uvProperties;
+
+	vkGetPhysicalDeviceFormatProperties(this->m_PhysicalDevice, VK_FORMAT_R16G16B16A16_SFLOAT, &positionProperties);
+	vkGetPhysicalDeviceFormatProperties(this->m_PhysicalDevice, VK_FORMAT_R16G16_UNORM, &uvProperties);
+
+	if (format == VertexFormat::Packed && !((positionProperties.bufferFeatures & uvProperties.bufferFeatures) & VK_FORMAT_FEATURE_VERTEX_BUFFER_BIT)) {
+		printf("Packed vertex formats are not supported as vertex input, using float vertices\n");
+		format = VertexFormat::Float;
+	}
+
+	this->m_VertexFormat = format;
+}
 
-	if (vkAllocateMemory(this->m_Device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
+// Replaces the built-in quads with a .vtmesh file. The pipeline adopts the file's vertex format, so the
+// stream can be uploaded straight from the mapping; loaded meshes are drawn with their stored colors
+bool Application::LoadMesh(const std::string& path) {
+	if (!this->m_Mesh.Open(path)) {
 		return false;
 	}
 
-	vkBindBufferMemory(this->m_Device, buffer, bufferMemory, 0);
+	SetVertexFormat(this->m_Mesh.GetVertexFormat());
+
+	if (this->m_VertexFormat != this->m_Mesh.GetVertexFormat()) {
+		printf("%s was converted for a vertex format this device cannot read, convert it with --float-vertices\n", path.c_str());
+		this->m_Mesh.Close();
+		return false;
+	}
+
+	this->m_IndexType = this->m_Mesh.GetIndexType();
 
 	return true;
 }
 
-void Application::CopyBuffer(VkBuffer srcBuffer, VkBuffer destBuffer, VkDeviceSize size) {
-	VkCommandBuffer commandBuffer = BeginSingleTimeCommands();
-	VkBufferCopy copyRegion = {};
+// Only valid before CreateLogicalDevice, everything sized per frame in flight is created after it
+void Application::SetFramesInFlight(uint32_t framesInFlight) {
+	this->m_FramesInFlight = std::min(std::max(framesInFlight, 1u), this->MAX_FRAMES_IN_FLIGHT);
+}
 
-	copyRegion.size = size;
-	vkCmdCopyBuffer(commandBuffer, srcBuffer, destBuffer, 1, &copyRegion);
+uint32_t Application::GetFramesInFlight() {
+	return this->m_FramesInFlight;
+}
 
-	EndSingleTimeCommands(commandBuffer);
+FrameTimeline* Application::GetFrameTimeline() {
+	return &this->m_FrameTimeline;
 }
 
-VkCommandBuffer Application::BeginSingleTimeCommands() {
-	VkCommandBufferAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandPool = this->m_CommandPool;
-	allocInfo.commandBufferCount = 1;
+void Application::SetRecordingThreads(uint32_t threadCount) {
+	this->m_RecordingThreads = threadCount;
+}
 
-	VkCommandBuffer commandBuffer;
-	vkAllocateCommandBuffers(this->m_Device, &allocInfo, &commandBuffer);
+void Application::SetFrustumCulling(bool enabled) {
+	this->m_FrustumCulling = enabled;
+}
 
-	VkCommandBufferBeginInfo beginInfo = {};
-	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+// Takes effect at the next DrawFrame, which waits for the device and declares the render graph again
+void Application::SetDepthPrepass(bool enabled) {
+	if (enabled == this->m_DepthPrepass) {
+		return;
+	}
 
-	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+	this->m_DepthPrepass = enabled;
+	this->m_RenderGraphStale = true;
+}
 
-	return commandBuffer;
+bool Application::IsDepthPrepassEnabled() {
+	return this->m_DepthPrepass;
 }
 
-void Application::EndSingleTimeCommands(VkCommandBuffer commandBuffer) {
-	vkEndCommandBuffer(commandBuffer);
+// Takes effect through a swap chain recreate at the next DrawFrame, the render pass and pipelines are kept since the format does not change
+bool Application::SetPresentMode(VkPresentModeKHR presentMode) {
+	if (this->m_Headless) {
+		return false;
+	}
 
-	VkSubmitInfo submitInfo = {};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer;
+	std::vector<VkPresentModeKHR> presentModes = QuerySwapChainSupport(this->m_PhysicalDevice).presentModes;
+
+	if (std::find(presentModes.begin(), presentModes.end(), presentMode) == presentModes.end()) {
+		printf("Present mode %s is not supported by the surface\n", GetPresentModeName(presentMode));
+		return false;
+	}
 
-	vkQueueSubmit(this->m_GraphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-	vkQueueWaitIdle(this->m_GraphicsQueue);
+	this->m_RequestedPresentMode = presentMode;
+	this->m_PresentModeStale = this->m_SwapChain != VK_NULL_HANDLE && presentMode != this->m_PresentMode;
 
-	vkFreeCommandBuffers(this->m_Device, this->m_CommandPool, 1, &commandBuffer);
+	return true;
 }
 
-void Application::TransitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout) {
-	VkCommandBuffer commandBuffer = BeginSingleTimeCommands();
-	VkImageMemoryBarrier barrier = {};
+VkPresentModeKHR Application::GetPresentMode() {
+	return this->m_PresentMode;
+}
 
-	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-	barrier.oldLayout = oldLayout;
-	barrier.newLayout = newLayout;
-	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.image = image;
+const char* Application::GetPresentModeName(VkPresentModeKHR presentMode) {
+	switch (presentMode) {
+	case VK_PRESENT_MODE_IMMEDIATE_KHR: return "immediate";
+	case VK_PRESENT_MODE_MAILBOX_KHR: return "mailbox";
+	case VK_PRESENT_MODE_FIFO_KHR: return "fifo";
+	case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "fifo_relaxed";
+	default: return "unknown";
+	}
+}
 
-	if (newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
-		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+// Called once the swap chain or offscreen target exists, before the render graph is created
+void Application::SetDynamicResolution(bool enabled, float minScale, float maxScale, float targetFrameTime) {
+	VkFormatFeatureFlags blitFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
 
-		if (HasStencilComponent(format)) {
-			barrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
-		}
+	if (enabled && (!this->m_SwapChainBlitTarget || !this->m_Allocator.IsFormatSupported(this->m_SwapChainImageFormat, VK_IMAGE_TILING_OPTIMAL, blitFeatures))) {
+		printf("Dynamic resolution needs a filtered blit into the swap chain image, rendering at full resolution\n");
+		enabled = false;
 	}
-	else {
-		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+
+	this->m_DynamicResolution = enabled;
+
+	if (!enabled) {
+		return;
 	}
 
-	barrier.subresourceRange.baseMipLevel = 0;
-	barrier.subresourceRange.levelCount = 1;
-	barrier.subresourceRange.baseArrayLayer = 0;
-	barrier.subresourceRange.layerCount = 1;
-	barrier.srcAccessMask = 0; //TODO
-	barrier.dstAccessMask = 0; //TODO
+	this->m_ResolutionScaler.Init(minScale, maxScale, targetFrameTime);
+	printf("Dynamic resolution: scale %.2f to %.2f, target %.2f ms\n", minScale, maxScale, targetFrameTime);
+}
 
-	VkPipelineStageFlags sourceStage;
-	VkPipelineStageFlags destinationStage;
+// Every recording thread owns a pool per frame in flight, a command pool may only be used by one thread at a time
+bool Application::AllocateSecondaryCommandBuffers(size_t frame) {
+	QueueFamilyIndices indices = FindDeviceQueFamilies(this->m_PhysicalDevice);
+	size_t imageCount = this->m_SwapChainFramebuffers.size();
 
-	if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-		barrier.srcAccessMask = 0;
-		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	if (this->m_RecordingThreads == 0) {
+		return true;
 	}
-	else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-		sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-		destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+
+	if (this->m_SecondaryCommandPools.empty()) {
+		this->m_SecondaryCommandPools.resize(this->m_FramesInFlight);
+		this->m_SecondaryCommandBuffers.resize(this->m_FramesInFlight);
 	}
-	else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
-		barrier.srcAccessMask = 0;
-		barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-		sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		destinationStage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+
+	std::vector<VkCommandPool>& pools = this->m_SecondaryCommandPools[frame];
+
+	while (pools.size() < this->m_RecordingThreads) {
+		VkCommandPoolCreateInfo poolInfo = {};
+		VkCommandPool pool;
+
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.queueFamilyIndex = indices.graphicsFamily.value();
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+		if (vkCreateCommandPool(this->m_Device, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+			return false;
+		}
+
+		pools.push_back(pool);
+		this->m_SecondaryCommandBuffers[frame].emplace_back();
 	}
-	else {
-		throw std::invalid_argument("Unsupported layout transition!");
+
+	for (size_t thread = 0; thread < pools.size(); thread++) {
+		std::vector<VkCommandBuffer>& buffers = this->m_SecondaryCommandBuffers[frame][thread];
+
+		if (buffers.size() < imageCount) {
+			VkCommandBufferAllocateInfo allocInfo = {};
+			size_t existing = buffers.size();
+
+			buffers.resize(imageCount);
+			allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocInfo.commandPool = pools[thread];
+			allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+			allocInfo.commandBufferCount = static_cast<uint32_t>(imageCount - existing);
+
+			if (vkAllocateCommandBuffers(this->m_Device, &allocInfo, buffers.data() + existing) != VK_SUCCESS) {
+				return false;
+			}
+		}
 	}
 
-	vkCmdPipelineBarrier(commandBuffer, sourceStage, destinationStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	return true;
+}
 
-	EndSingleTimeCommands(commandBuffer);
+void Application::MarkCommandBuffersDirty() {
+	this->m_SceneGeneration++;
 }
 
-void Application::CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) {
-	VkCommandBuffer commandBuffer = BeginSingleTimeCommands();
+VkCommandBuffer Application::GetFrameCommandBuffer(uint32_t imageIndex) {
+	size_t frame = this->m_CurrentFrame;
+	VkCommandBuffer commandBuffer = this->m_CommandBuffers[frame][imageIndex];
 
-	VkBufferImageCopy region = {};
+	if (this->m_RecordedGeneration[frame][imageIndex] == this->m_SceneGeneration) {
+		return commandBuffer;
+	}
 
-	region.bufferOffset = 0;
-	region.bufferRowLength = 0;
-	region.bufferImageHeight = 0;
-	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	region.imageSubresource.mipLevel = 0;
-	region.imageSubresource.baseArrayLayer = 0;
-	region.imageSubresource.layerCount = 1;
-	region.imageOffset = { 0, 0, 0 };
-	region.imageExtent = {
-		width,
-		height,
-		1
-	};
+	// The frame's fence has been waited on, so nothing from this pool is still executing
+	if (this->m_FramePoolGeneration[frame] != this->m_SceneGeneration) {
+		vkResetCommandPool(this->m_Device, this->m_FrameCommandPools[frame], 0);
 
+		if (!this->m_SecondaryCommandPools.empty()) {
+			for (auto pool : this->m_SecondaryCommandPools[frame]) {
+				vkResetCommandPool(this->m_Device, pool, 0);
+			}
+		}
 
-	vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+		std::fill(this->m_RecordedGeneration[frame].begin(), this->m_RecordedGeneration[frame].end(), 0);
+		this->m_FramePoolGeneration[frame] = this->m_SceneGeneration;
+	}
 
+	RecordCommandBuffer(commandBuffer, frame, imageIndex);
+	this->m_RecordedGeneration[frame][imageIndex] = this->m_SceneGeneration;
 
-	EndSingleTimeCommands(commandBuffer);
+	return commandBuffer;
 }
 
-uint32_t Application::FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
-	VkPhysicalDeviceMemoryProperties memProperties;
+void Application::RecordCommandBuffer(VkCommandBuffer commandBuffer, size_t frame, uint32_t imageIndex) {
+	VkCommandBufferBeginInfo beginInfo = {};
 
-	vkGetPhysicalDeviceMemoryProperties(this->m_PhysicalDevice, &memProperties);
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = 0;
+	beginInfo.pInheritanceInfo = nullptr;
 
-	for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-		if (typeFilter & (1 << i) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-			return i;
-		}
+	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to begin recording command buffer!");
 	}
 
-	throw std::runtime_error("Failed to find suitable memory type!");
+	this->m_Profiler.WriteBeginTimestamp(commandBuffer, frame);
+
+	this->m_RenderGraph.SetImage(this->m_ColorTarget, this->m_SwapChainImages[imageIndex]);
+
+	if (this->m_GpuAnimation) {
+		this->m_RenderGraph.SetBuffer(this->m_VertexResource, this->m_VertexBuffer);
+		this->m_RenderGraph.SetBuffer(this->m_GroupStateResource, this->m_GroupStateBuffer);
+	}
+
+	if (!this->m_ReadbackBuffers.empty()) {
+		this->m_RenderGraph.SetBuffer(this->m_ReadbackResource, this->m_ReadbackBuffers[frame]);
+	}
+
+	this->m_RenderGraph.Execute(commandBuffer, frame, imageIndex);
+	this->m_Profiler.WriteEndTimestamp(commandBuffer, frame);
+
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("Faild to record command buffer!");
+	}
 }
 
-bool Application::CreateCommandBuffers() {
-	VkCommandBufferAllocateInfo allocInfo = {};
+void Application::RecordMainPass(VkCommandBuffer commandBuffer, size_t frame, uint32_t imageIndex) {
 	std::array<VkClearValue, 2> clearValues = {};
+	VkRenderPassBeginInfo renderPassInfo = {};
 
 	clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
 	clearValues[1].depthStencil = { 1.0f, 0 };
 
-	this->m_CommandBuffers.resize(this->m_SwapChainFramebuffers.size());
-	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.commandPool = this->m_CommandPool;
-	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandBufferCount = (uint32_t)this->m_CommandBuffers.size();
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = this->m_DepthPrepass ? this->m_DepthEqualRenderPass : this->m_RenderPass;
+	renderPassInfo.framebuffer = this->m_SwapChainFramebuffers[imageIndex];
+	renderPassInfo.renderArea.offset = { 0, 0 };
+	renderPassInfo.renderArea.extent = this->m_RenderExtent;
+	renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+	renderPassInfo.pClearValues = clearValues.data();
 
-	if (vkAllocateCommandBuffers(this->m_Device, &allocInfo, this->m_CommandBuffers.data()) != VK_SUCCESS) {
-		return false;
+	if (this->m_RecordingThreads > 0) {
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+		RecordSecondaryDraws(commandBuffer, frame, imageIndex);
+	}
+	else {
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		RecordScenePass(commandBuffer, frame, 0, this->m_DrawCommandCount);
 	}
 
-	for (size_t i = 0; i < this->m_CommandBuffers.size(); i++) {
-		VkCommandBufferBeginInfo beginInfo = {};
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-		beginInfo.pInheritanceInfo = nullptr;
+	vkCmdEndRenderPass(commandBuffer);
+	this->m_Profiler.WritePassTimestamp(commandBuffer, frame, GpuPass::Scene);
+}
+
+// Depth only, recorded inline even with recording threads since it is a single bind and the draw list
+void Application::RecordDepthPrepass(VkCommandBuffer commandBuffer, size_t frame, uint32_t imageIndex) {
+	VkClearValue clearValue = {};
+	VkRenderPassBeginInfo renderPassInfo = {};
 
-		if (vkBeginCommandBuffer(this->m_CommandBuffers[i], &beginInfo) != VK_SUCCESS) {
-			throw std::runtime_error("Failed to begin recording command buffer!");
-		}
+	clearValue.depthStencil = { 1.0f, 0 };
 
-		VkRenderPassBeginInfo renderPassInfo = {};
-		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassInfo.renderPass = this->m_RenderPass;
-		renderPassInfo.framebuffer = this->m_SwapChainFramebuffers[i];
-		renderPassInfo.renderArea.offset = { 0, 0 };
-		renderPassInfo.renderArea.extent = this->m_SwapChainExtent;
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = this->m_DepthPrepassRenderPass;
+	renderPassInfo.framebuffer = this->m_DepthPrepassFramebuffer;
+	renderPassInfo.renderArea.offset = { 0, 0 };
+	renderPassInfo.renderArea.extent = this->m_RenderExtent;
+	renderPassInfo.clearValueCount = 1;
+	renderPassInfo.pClearValues = &clearValue;
 
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->m_DepthPrepassPipeline);
+	SetSceneViewport(commandBuffer);
 
-		renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-		renderPassInfo.pClearValues = clearValues.data();
+	VkBuffer vertexBuffers[] = { this->m_PositionBuffer, this->m_InstanceBuffer };
+	VkDeviceSize offsets[] = { 0, this->m_InstanceRegionSize * frame };
+	uint32_t uniformOffset = static_cast<uint32_t>(this->m_UniformStride * this->MAX_UNIFORM_OBJECTS * frame);
 
-		vkCmdBeginRenderPass(this->m_CommandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-		vkCmdBindPipeline(this->m_CommandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, this->m_GraphicsPipeLine);
-		
-		VkBuffer vertexBuffers[] = { this->m_VertexBuffer };
-		VkDeviceSize offsets[] = { 0 };
+	vkCmdBindVertexBuffers(commandBuffer, 0, 2, vertexBuffers, offsets);
+	vkCmdBindIndexBuffer(commandBuffer, this->m_IndexBuffer, 0, this->m_IndexType);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->m_PipelineLayout, 0, 1, &this->m_DescriptionSets[frame], 1, &uniformOffset);
 
-		vkCmdBindVertexBuffers(this->m_CommandBuffers[i], 0, 1, vertexBuffers, offsets);
-		vkCmdBindIndexBuffer(this->m_CommandBuffers[i], this->m_IndexBuffer, 0, VK_INDEX_TYPE_UINT16);
+	RecordSceneDraws(commandBuffer, frame, 0, this->m_DrawCommandCount);
 
-		vkCmdBindDescriptorSets(this->m_CommandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, this->m_PipelineLayout, 0, 1, &this->m_DescriptionSets[i], 0, nullptr);
-		vkCmdDrawIndexed(this->m_CommandBuffers[i], static_cast<uint32_t>(this->m_Indices.size()), 1, 0, 0, 0);
-		vkCmdEndRenderPass(this->m_CommandBuffers[i]);
+	vkCmdEndRenderPass(commandBuffer);
+	this->m_Profiler.WritePassTimestamp(commandBuffer, frame, GpuPass::DepthPrepass);
+}
 
-		if (vkEndCommandBuffer(this->m_CommandBuffers[i]) != VK_SUCCESS) {
-			throw std::runtime_error("Faild to record command buffer!");
-		}
+void Application::SetSceneViewport(VkCommandBuffer commandBuffer) {
+	VkViewport viewport = {};
+	VkRect2D scissor = {};
+
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = (float)this->m_RenderExtent.width;
+	viewport.height = (float)this->m_RenderExtent.height;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+
+	scissor.offset = { 0, 0 };
+	scissor.extent = this->m_RenderExtent;
+
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+}
+
+// Stretches the rendered part of the scene target over the whole output image, filtered so lower scales blur instead of blocking
+void Application::RecordUpscale(VkCommandBuffer commandBuffer, size_t frame, uint32_t imageIndex) {
+	VkImageBlit region = {};
+
+	region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.srcSubresource.layerCount = 1;
+	region.srcOffsets[1] = { static_cast<int32_t>(this->m_RenderExtent.width), static_cast<int32_t>(this->m_RenderExtent.height), 1 };
+	region.dstSubresource = region.srcSubresource;
+	region.dstOffsets[1] = { static_cast<int32_t>(this->m_SwapChainExtent.width), static_cast<int32_t>(this->m_SwapChainExtent.height), 1 };
+
+	vkCmdBlitImage(commandBuffer, this->m_RenderGraph.GetImage(this->m_SceneColorTarget), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		this->m_SwapChainImages[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region, VK_FILTER_LINEAR);
+
+	this->m_Profiler.WritePassTimestamp(commandBuffer, frame, GpuPass::Upscale);
+}
+
+// Offscreen frames are copied out for frame dumps, the graph makes the copy visible to the host afterwards
+void Application::RecordReadback(VkCommandBuffer commandBuffer, size_t frame, uint32_t imageIndex) {
+	VkBufferImageCopy region = {};
+
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.layerCount = 1;
+	region.imageExtent = { this->m_SwapChainExtent.width, this->m_SwapChainExtent.height, 1 };
+
+	vkCmdCopyImageToBuffer(commandBuffer, this->m_SwapChainImages[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, this->m_ReadbackBuffers[frame], 1, &region);
+}
+
+// Everything a draw range needs inside the render pass, secondary buffers inherit none of the primary's state
+void Application::RecordScenePass(VkCommandBuffer commandBuffer, size_t frame, uint32_t firstDraw, uint32_t drawCount) {
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->m_DepthPrepass ? this->m_DepthEqualPipeline : this->m_GraphicsPipeLine);
+	SetSceneViewport(commandBuffer);
+
+	VkBuffer vertexBuffers[] = { this->m_VertexBuffer, this->m_InstanceBuffer };
+	VkDeviceSize offsets[] = { this->m_VertexRegionSize * frame, this->m_InstanceRegionSize * frame };
+
+	vkCmdBindVertexBuffers(commandBuffer, 0, 2, vertexBuffers, offsets);
+	vkCmdBindIndexBuffer(commandBuffer, this->m_IndexBuffer, 0, this->m_IndexType);
+
+	uint32_t uniformOffset = static_cast<uint32_t>(this->m_UniformStride * this->MAX_UNIFORM_OBJECTS * frame);
+
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->m_PipelineLayout, 0, 1, &this->m_DescriptionSets[frame], 1, &uniformOffset);
+
+	if (this->m_BindlessTextures) {
+		VkDescriptorSet textureTable = this->m_TextureManager.GetBindlessSet();
+
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->m_PipelineLayout, 1, 1, &textureTable, 0, nullptr);
 	}
 
-	return true;
+	RecordSceneDraws(commandBuffer, frame, firstDraw, drawCount);
+}
+
+// Splits the draw list into one secondary buffer per recording thread and runs them from the primary
+void Application::RecordSecondaryDraws(VkCommandBuffer commandBuffer, size_t frame, uint32_t imageIndex) {
+	uint32_t threadCount = this->m_RecordingThreads;
+	std::vector<VkCommandBuffer> secondaries(threadCount, VK_NULL_HANDLE);
+
+	this->m_ThreadPool.ParallelFor(threadCount, [&](size_t firstThread, size_t lastThread) {
+		for (size_t thread = firstThread; thread < lastThread; thread++) {
+			uint32_t firstDraw = static_cast<uint32_t>(this->m_DrawCommandCount * thread / threadCount);
+			uint32_t lastDraw = static_cast<uint32_t>(this->m_DrawCommandCount * (thread + 1) / threadCount);
+
+			if (firstDraw == lastDraw) {
+				continue;
+			}
+
+			VkCommandBuffer secondary = this->m_SecondaryCommandBuffers[frame][thread][imageIndex];
+			VkCommandBufferInheritanceInfo inheritanceInfo = {};
+			VkCommandBufferBeginInfo beginInfo = {};
+
+			inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+			inheritanceInfo.renderPass = this->m_RenderPass;
+			inheritanceInfo.subpass = 0;
+			inheritanceInfo.framebuffer = this->m_SwapChainFramebuffers[imageIndex];
+
+			beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+			beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+			if (vkBeginCommandBuffer(secondary, &beginInfo) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to begin recording secondary command buffer!");
+			}
+
+			RecordScenePass(secondary, frame, firstDraw, lastDraw - firstDraw);
+
+			if (vkEndCommandBuffer(secondary) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to record secondary command buffer!");
+			}
+
+			secondaries[thread] = secondary;
+		}
+	});
+
+	secondaries.erase(std::remove(secondaries.begin(), secondaries.end(), VK_NULL_HANDLE), secondaries.end());
+
+	if (!secondaries.empty()) {
+		vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+	}
 }
 
 bool Application::CreateSemaphoresAndFences() {
 	VkSemaphoreCreateInfo semaphoreInfo = {};
-	VkFenceCreateInfo fenceInfo = {};
 
-	this->m_ImageAvailableSemaphore.resize(this->MAX_FRAMES_IN_FLIGHT);
-	this->m_RenderFinishedSemaphore.resize(this->MAX_FRAMES_IN_FLIGHT);		
-	this->m_InFlightFences.resize(this->MAX_FRAMES_IN_FLIGHT);
+	this->m_ImageAvailableSemaphore.resize(this->m_FramesInFlight);
+	this->m_RenderFinishedSemaphore.resize(this->m_FramesInFlight);		
 
 	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-	for (size_t i = 0; i < this->MAX_FRAMES_IN_FLIGHT; i++) {
+	// Acquire and present still need binary semaphores, only the CPU side frame tracking moves to the timeline
+	for (size_t i = 0; i < this->m_FramesInFlight; i++) {
 		if (vkCreateSemaphore(this->m_Device, &semaphoreInfo, nullptr, &this->m_ImageAvailableSemaphore[i]) != VK_SUCCESS) {
 			return false;
 		}
 		if (vkCreateSemaphore(this->m_Device, &semaphoreInfo, nullptr, &this->m_RenderFinishedSemaphore[i]) != VK_SUCCESS) {
 			return false;
 		}
-		if (vkCreateFence(this->m_Device, &fenceInfo, nullptr, &this->m_InFlightFences[i]) != VK_SUCCESS) {
-			return false;
-		}
 	}
 
-	
-
-	return true;
+	return this->m_FrameTimeline.Init(this->m_Device, this->m_FramesInFlight, this->m_TimelineSemaphore);
 }
 
 bool Application::RecreateSwapChain() {
 	int width = 0;
 	int height = 0;
 
+	// Only block while minimized, waiting on events here would stall every resize by a frame
+	glfwGetFramebufferSize(this->m_Window, &width, &height);
+
 	while (width == 0 || height == 0) {
-		glfwGetFramebufferSize(this->m_Window, &width, &height);
 		glfwWaitEvents();
+		glfwGetFramebufferSize(this->m_Window, &width, &height);
 	}
 	vkDeviceWaitIdle(this->m_Device);
 
+	auto start = std::chrono::high_resolution_clock::now();
+	VkFormat previousFormat = this->m_SwapChainImageFormat;
+
 	this->CleanupSwapChain();
 
 	this->CreateSwapChain(this->m_WindowWidth, this->m_WindowHeight, this->m_Vsync);
 	this->CreateImageViews();
-	this->CreateRenderPass();
-	this->CreateGraphicsPipeline();
-	this->CreateDepthImageResources();
+
+	// The render pass and pipeline only depend on the surface format, which a resize rarely changes
+	if (this->m_SwapChainImageFormat != previousFormat) {
+		vkDestroyPipeline(this->m_Device, this->m_GraphicsPipeLine, nullptr);
+		vkDestroyPipeline(this->m_Device, this->m_DepthEqualPipeline, nullptr);
+		vkDestroyPipeline(this->m_Device, this->m_DepthPrepassPipeline, nullptr);
+		vkDestroyPipelineLayout(this->m_Device, this->m_PipelineLayout, nullptr);
+		vkDestroyRenderPass(this->m_Device, this->m_RenderPass, nullptr);
+		vkDestroyRenderPass(this->m_Device, this->m_DepthEqualRenderPass, nullptr);
+		vkDestroyRenderPass(this->m_Device, this->m_DepthPrepassRenderPass, nullptr);
+
+		this->CreateRenderPass();
+		this->CreateGraphicsPipeline();
+	}
+
+	this->CreateRenderGraph();
 	this->CreateFrameBuffers();
-	this->CreateUniformBuffers();
-	this->CreateDescriptorPool();
-	this->CreateDescriptorSets();
 	this->CreateCommandBuffers();
 
+	auto end = std::chrono::high_resolution_clock::now();
+	printf("Swap chain recreated in %.2f ms (pipeline cache %s)\n", std::chrono::duration<double, std::milli>(end - start).count(), this->m_PipelineCache.GetHandle() != VK_NULL_HANDLE ? "on" : "off");
+
 	return true;
 }
 
 bool Application::DrawFrame() {
 	uint32_t imageIndex;		
 
-	vkWaitForFences(this->m_Device, 1, &this->m_InFlightFences[this->m_CurrentFrame], VK_TRUE, std::numeric_limits<uint64_t>::max());
+	if (this->m_RenderGraphStale && !RebuildRenderGraph()) {
+		return false;
+	}
+
+	if (this->m_PresentModeStale) {
+		this->RecreateSwapChain();
+	}
+
+	if (this->m_Headless) {
+		return DrawOffscreenFrame();
+	}
+
+	this->m_Profiler.BeginFrame();
+	this->m_Profiler.BeginPhase(ProfilePhase::FenceWait);
+	this->m_FrameTimeline.WaitForSlot(this->m_CurrentFrame);
+	this->m_Profiler.EndPhase(ProfilePhase::FenceWait);
+
+	if (this->m_Profiler.CollectGpuTime(this->m_CurrentFrame)) {
+		UpdateResolutionScale();
+	}
 	
+	this->m_Profiler.BeginPhase(ProfilePhase::Acquire);
 	VkResult res = vkAcquireNextImageKHR(this->m_Device, this->m_SwapChain, std::numeric_limits<uint64_t>::max(), this->m_ImageAvailableSemaphore[this->m_CurrentFrame], VK_NULL_HANDLE, &imageIndex);
+	this->m_Profiler.EndPhase(ProfilePhase::Acquire);
 
 	if (res == VK_ERROR_OUT_OF_DATE_KHR) {
 		this->RecreateSwapChain();
@@ -1321,8 +2372,18 @@ bool Application::DrawFrame() {
 		return false;
 	}
 
-	UpdateUniformBuffer(imageIndex);
-	//UpdateVertexBuffer();
+	this->m_Profiler.BeginPhase(ProfilePhase::Uniforms);
+	UpdateUniformBuffer();
+	this->m_Profiler.EndPhase(ProfilePhase::Uniforms);
+
+	this->m_Profiler.BeginPhase(ProfilePhase::Cull);
+	CullInstances(this->m_CurrentFrame);
+	this->m_Profiler.EndPhase(ProfilePhase::Cull);
+
+	this->m_Profiler.BeginPhase(ProfilePhase::Upload);
+	UploadVertices();
+	RefreshTextureDescriptors(this->m_CurrentFrame);
+	this->m_Profiler.EndPhase(ProfilePhase::Upload);
 
 	VkSubmitInfo submitInfo = {};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -1334,16 +2395,28 @@ bool Application::DrawFrame() {
 	submitInfo.pWaitSemaphores = waitSemaphores;
 	submitInfo.pWaitDstStageMask = waitStages;
 
+	this->m_Profiler.BeginPhase(ProfilePhase::Record);
+	VkCommandBuffer commandBuffer = GetFrameCommandBuffer(imageIndex);
+	this->m_Profiler.EndPhase(ProfilePhase::Record);
+
+	// Pending uploads go to the queue ahead of the frame, so the frame is ordered after their final barriers
+	this->m_Profiler.BeginPhase(ProfilePhase::Upload);
+	this->m_UploadManager.Submit();
+	this->m_UploadManager.Update();
+	this->m_Profiler.EndPhase(ProfilePhase::Upload);
+
 	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &this->m_CommandBuffers[imageIndex];
+	submitInfo.pCommandBuffers = &commandBuffer;
 
 	VkSemaphore signalSemaphores[] = { this->m_RenderFinishedSemaphore[this->m_CurrentFrame] };
 	submitInfo.signalSemaphoreCount = 1;
 	submitInfo.pSignalSemaphores = signalSemaphores;
 
-	vkResetFences(this->m_Device, 1, &this->m_InFlightFences[this->m_CurrentFrame]);
+	this->m_Profiler.BeginPhase(ProfilePhase::Submit);
+	VkResult submitResult = this->m_FrameTimeline.Submit(this->m_GraphicsQueue, submitInfo, this->m_CurrentFrame);
+	this->m_Profiler.EndPhase(ProfilePhase::Submit);
 
-	if (vkQueueSubmit(this->m_GraphicsQueue, 1, &submitInfo, this->m_InFlightFences[this->m_CurrentFrame]) != VK_SUCCESS) {
+	if (submitResult != VK_SUCCESS) {
 		return false;
 	}
 	   	  
@@ -1359,7 +2432,11 @@ bool Application::DrawFrame() {
 	presentInfo.pImageIndices = &imageIndex;
 	presentInfo.pResults = nullptr;
 
+	this->m_Profiler.BeginPhase(ProfilePhase::Present);
 	res = vkQueuePresentKHR(this->m_PresentQue, &presentInfo);
+	this->m_Profiler.EndPhase(ProfilePhase::Present);
+	this->m_Profiler.RecordPresent();
+	this->m_Profiler.EndFrame(this->m_CurrentFrame);
 	
 	if (res == VK_ERROR_OUT_OF_DATE_KHR || res == VK_SUBOPTIMAL_KHR || this->m_FramebufferResized) {
 		this->m_FramebufferResized = false;
@@ -1369,12 +2446,127 @@ bool Application::DrawFrame() {
 		return false;
 	}
 
-	this->m_CurrentFrame = (this->m_CurrentFrame + 1) % this->MAX_FRAMES_IN_FLIGHT;
+	this->m_CurrentFrame = (this->m_CurrentFrame + 1) % this->m_FramesInFlight;
 
 	return true;
 }
 
-void Application::UpdateUniformBuffer(uint32_t currentImage) {
+bool Application::DrawOffscreenFrame() {
+	size_t frame = this->m_CurrentFrame;
+
+	this->m_Profiler.BeginFrame();
+	this->m_Profiler.BeginPhase(ProfilePhase::FenceWait);
+	this->m_FrameTimeline.WaitForSlot(frame);
+	this->m_Profiler.EndPhase(ProfilePhase::FenceWait);
+
+	if (this->m_Profiler.CollectGpuTime(frame)) {
+		UpdateResolutionScale();
+	}
+
+	// The readback buffer for this slot is only reused once its previous frame has been written out
+	WriteFrameDump(frame);
+
+	this->m_Profiler.BeginPhase(ProfilePhase::Uniforms);
+	UpdateUniformBuffer();
+	this->m_Profiler.EndPhase(ProfilePhase::Uniforms);
+
+	this->m_Profiler.BeginPhase(ProfilePhase::Cull);
+	CullInstances(frame);
+	this->m_Profiler.EndPhase(ProfilePhase::Cull);
+
+	this->m_Profiler.BeginPhase(ProfilePhase::Upload);
+	UploadVertices();
+	RefreshTextureDescriptors(frame);
+	this->m_Profiler.EndPhase(ProfilePhase::Upload);
+
+	this->m_Profiler.BeginPhase(ProfilePhase::Record);
+	VkCommandBuffer commandBuffer = GetFrameCommandBuffer(static_cast<uint32_t>(frame));
+	this->m_Profiler.EndPhase(ProfilePhase::Record);
+
+	VkSubmitInfo submitInfo = {};
+
+	this->m_Profiler.BeginPhase(ProfilePhase::Upload);
+	this->m_UploadManager.Submit();
+	this->m_UploadManager.Update();
+	this->m_Profiler.EndPhase(ProfilePhase::Upload);
+
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+
+	this->m_Profiler.BeginPhase(ProfilePhase::Submit);
+	VkResult submitResult = this->m_FrameTimeline.Submit(this->m_GraphicsQueue, submitInfo, frame);
+	this->m_Profiler.EndPhase(ProfilePhase::Submit);
+
+	if (submitResult != VK_SUCCESS) {
+		return false;
+	}
+	this->m_Profiler.EndFrame(frame);
+
+	if (!this->m_PendingDumpFrame.empty()) {
+		this->m_PendingDumpFrame[frame] = static_cast<int64_t>(this->m_FrameNumber);
+	}
+
+	this->m_FrameNumber++;
+	this->m_CurrentFrame = (this->m_CurrentFrame + 1) % this->m_FramesInFlight;
+
+	return true;
+}
+
+void Application::WriteFrameDump(size_t frame) {
+	if (this->m_PendingDumpFrame.empty() || this->m_PendingDumpFrame[frame] < 0) {
+		return;
+	}
+
+	char fileName[64];
+	snprintf(fileName, sizeof(fileName), "frame_%05lld.ppm", static_cast<long long>(this->m_PendingDumpFrame[frame]));
+	this->m_PendingDumpFrame[frame] = -1;
+
+	std::string path = (std::filesystem::path(this->m_DumpDirectory) / fileName).string();
+	std::ofstream file(path, std::ios::binary);
+
+	if (!file.is_open()) {
+		printf("Failed to write %s\n", path.c_str());
+		return;
+	}
+
+	uint32_t width = this->m_SwapChainExtent.width;
+	uint32_t height = this->m_SwapChainExtent.height;
+	const uint8_t* pixels = static_cast<const uint8_t*>(this->m_ReadbackMemory[frame].mapped);
+	std::vector<uint8_t> row(width * 3);
+
+	file << "P6\n" << width << " " << height << "\n255\n";
+
+	for (uint32_t y = 0; y < height; y++) {
+		for (uint32_t x = 0; x < width; x++) {
+			const uint8_t* pixel = pixels + (static_cast<size_t>(y) * width + x) * 4;
+
+			row[x * 3 + 0] = pixel[0];
+			row[x * 3 + 1] = pixel[1];
+			row[x * 3 + 2] = pixel[2];
+		}
+
+		file.write(reinterpret_cast<const char*>(row.data()), row.size());
+	}
+}
+
+void Application::FlushFrameDumps() {
+	vkDeviceWaitIdle(this->m_Device);
+
+	for (size_t frame = 0; frame < this->m_PendingDumpFrame.size(); frame++) {
+		WriteFrameDump(frame);
+	}
+}
+
+void Application::ReportProfile(const std::string& jsonPath) {
+	this->m_Profiler.PrintReport();
+
+	if (!jsonPath.empty()) {
+		this->m_Profiler.WriteJson(jsonPath);
+	}
+}
+
+void Application::UpdateUniformBuffer() {
 	static auto startTime = std::chrono::high_resolution_clock::now();
 
 	auto currentTime = std::chrono::high_resolution_clock::now();
@@ -1387,19 +2579,118 @@ void Application::UpdateUniformBuffer(uint32_t currentImage) {
 	ubo.proj = glm::perspective(glm::radians(45.0f), this->m_SwapChainExtent.width / (float)this->m_SwapChainExtent.height, 0.1f, 10.0f);
 	ubo.proj[1][1] *= -1;
 
-	void* data;
-	vkMapMemory(this->m_Device, this->m_UniformBufferMemory[currentImage], 0, sizeof(ubo), 0, &data);
-	memcpy(data, &ubo, sizeof(ubo));
-	vkUnmapMemory(this->m_Device, this->m_UniformBufferMemory[currentImage]);
+	WriteObjectUniform(0, ubo);
+
+	// The shared model matrix is applied after each instance transform, so it belongs to the culling frustum
+	this->m_CullTransform = ubo.proj * ubo.view * ubo.model;
+}
+
+// Compacts the instances whose bounds touch the frustum into this frame's instance region and points every
+// draw at that many instances. Both regions are host visible and only rewritten once the frame is idle,
+// so the recorded command buffers stay valid.
+void Application::CullInstances(size_t frame) {
+	if (!this->m_FrustumCulling) {
+		this->m_Profiler.SetCounter(ProfileCounter::VisibleObjects, static_cast<uint32_t>(this->m_Instances.size()));
+		return;
+	}
+
+	size_t visibleCount = this->m_Culler.Cull(this->m_CullTransform, this->m_VisibleInstances);
+	InstanceData* instances = reinterpret_cast<InstanceData*>(static_cast<char*>(this->m_InstanceBufferMemory.mapped) + this->m_InstanceRegionSize * frame);
+	VkDrawIndexedIndirectCommand* commands = reinterpret_cast<VkDrawIndexedIndirectCommand*>(static_cast<char*>(this->m_IndirectBufferMemory.mapped) + this->m_IndirectRegionSize * frame);
+
+	for (size_t i = 0; i < visibleCount; i++) {
+		instances[i] = this->m_Instances[this->m_VisibleInstances[i]];
+	}
+
+	for (uint32_t i = 0; i < this->m_DrawCommandCount; i++) {
+		commands[i].instanceCount = static_cast<uint32_t>(visibleCount);
+	}
+
+	this->m_Profiler.SetCounter(ProfileCounter::VisibleObjects, static_cast<uint32_t>(visibleCount));
+	this->m_Profiler.SetCounter(ProfileCounter::CulledObjects, static_cast<uint32_t>(this->m_Instances.size() - visibleCount));
 }
 
-void Application::UpdateVertexBuffer() {
-	VertexTest();
+uint32_t Application::WriteObjectUniform(uint32_t object, const UniformBufferObject& ubo) {
+	VkDeviceSize offset = this->m_UniformStride * (this->MAX_UNIFORM_OBJECTS * this->m_CurrentFrame + object);
+
+	memcpy(static_cast<char*>(this->m_UniformBufferMemory.mapped) + offset, &ubo, sizeof(ubo));
 
-	void* data;
-	vkMapMemory(this->m_Device, this->m_VertexBufferMemory, 0, sizeof(this->m_Vertices), 0, &data);
-	memcpy(data, &this->m_Vertices, sizeof(this->m_Vertices));
-	vkUnmapMemory(this->m_Device, this->m_VertexBufferMemory);
+	return static_cast<uint32_t>(offset);
+}
+
+// The draw list lives in m_IndirectBuffer, so recording cost does not depend on how many instances there are
+void Application::RecordSceneDraws(VkCommandBuffer commandBuffer, size_t frame, uint32_t firstDraw, uint32_t drawCount) {
+	VkDeviceSize stride = sizeof(VkDrawIndexedIndirectCommand);
+	VkDeviceSize region = this->m_IndirectRegionSize * frame;
+
+#ifdef VK_KHR_draw_indirect_count
+	// The count in the buffer covers the whole list, so only a full range can go through the count variant
+	if (this->m_CmdDrawIndexedIndirectCount != nullptr && firstDraw == 0 && drawCount == this->m_DrawCommandCount) {
+		this->m_CmdDrawIndexedIndirectCount(commandBuffer, this->m_IndirectBuffer, region, this->m_IndirectBuffer, region + this->m_DrawCountOffset, drawCount, static_cast<uint32_t>(stride));
+		return;
+	}
+#endif
+
+	if (this->m_MultiDrawIndirect) {
+		vkCmdDrawIndexedIndirect(commandBuffer, this->m_IndirectBuffer, region + stride * firstDraw, drawCount, static_cast<uint32_t>(stride));
+		return;
+	}
+
+	// Without multiDrawIndirect the draw count has to be 1, so each command is issued on its own
+	for (uint32_t i = firstDraw; i < firstDraw + drawCount; i++) {
+		vkCmdDrawIndexedIndirect(commandBuffer, this->m_IndirectBuffer, region + stride * i, 1, static_cast<uint32_t>(stride));
+	}
+}
+
+void Application::RecordAnimation(VkCommandBuffer commandBuffer) {
+	AnimationPushConstants constants = {};
+	VkMemoryBarrier barrier = {};
+	uint32_t vertexCount = static_cast<uint32_t>(this->m_Vertices.size());
+
+	constants.vertexStride = Vertex::GetStride(this->m_VertexFormat) / sizeof(uint32_t);
+	constants.colorOffset = Vertex::GetColorOffset(this->m_VertexFormat) / sizeof(uint32_t);
+	constants.packedColor = this->m_VertexFormat == VertexFormat::Packed ? 1 : 0;
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->m_AnimationPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->m_AnimationPipelineLayout, 0, 1, &this->m_AnimationSet, 0, nullptr);
+
+	// Pass 0 steps one color per position group, pass 1 scatters the group colors into the vertices.
+	// Only the barrier between the two dispatches is recorded here, the ones around them come from the render graph
+	constants.pass = 0;
+	constants.count = this->m_AnimationGroupCount;
+	vkCmdPushConstants(commandBuffer, this->m_AnimationPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+	vkCmdDispatch(commandBuffer, (this->m_AnimationGroupCount + 63) / 64, 1, 1);
+
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	constants.pass = 1;
+	constants.count = vertexCount;
+	vkCmdPushConstants(commandBuffer, this->m_AnimationPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+	vkCmdDispatch(commandBuffer, (vertexCount + 63) / 64, 1, 1);
+}
+
+void Application::UploadVertices() {
+	if (this->m_GpuAnimation || this->m_Mesh.IsOpen()) {
+		return;
+	}
+
+	if (this->m_Vertices.size() > this->m_VertexCapacity) {
+		ReserveVertexCapacity(this->m_Vertices.size());
+	}
+
+	// Every region already holds m_Vertices from ReserveVertexCapacity, only the animated colors change per frame
+	char* region = static_cast<char*>(this->m_VertexBufferMemory.mapped) + this->m_VertexRegionSize * this->m_CurrentFrame;
+	uint32_t stride = Vertex::GetStride(this->m_VertexFormat);
+
+	if (this->m_VertexFormat == VertexFormat::Packed) {
+		this->m_Animator.WritePackedColors(region, stride, Vertex::GetColorOffset(this->m_VertexFormat));
+	}
+	else {
+		this->m_Animator.WriteColors(region, stride, Vertex::GetColorOffset(this->m_VertexFormat));
+	}
 }
 
 VkDevice Application::GetDevice() {
@@ -1438,13 +2729,143 @@ VkShaderModule Application::CreateShaderModule(const std::vector<char>& code) {
 	return sm;
 }
 
-bool Application::CreateDepthImageResources() {
-	VkFormat depthFormat = FindDepthFormat();
+// Declares the frame's passes once per swap chain, the depth buffer is a graph transient so its memory can
+// be shared with other attachments whose passes don't overlap it
+bool Application::CreateRenderGraph() {
+	RenderImageDesc depthDesc = {};
+	RenderUsage initialColor = this->m_Headless ? RenderUsage::Undefined : RenderUsage::Acquired;
+	RenderUsage finalColor = this->m_Headless ? RenderUsage::Undefined : RenderUsage::Present;
+
+	this->m_SceneExtent = this->m_SwapChainExtent;
+	this->m_RenderExtent = this->m_SwapChainExtent;
+
+	if (this->m_DynamicResolution) {
+		this->m_SceneExtent = this->m_ResolutionScaler.GetMaxExtent(this->m_SwapChainExtent);
+		this->m_RenderExtent = this->m_ResolutionScaler.GetRenderExtent(this->m_SwapChainExtent);
+	}
+
+	depthDesc.format = FindDepthFormat();
+	depthDesc.extent = this->m_SceneExtent;
+	depthDesc.aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+
+	this->m_RenderGraph.Destroy();
+	this->m_ColorTarget = this->m_RenderGraph.ImportImage("color", VK_IMAGE_ASPECT_COLOR_BIT, initialColor, finalColor);
+	this->m_DepthTarget = this->m_RenderGraph.CreateImage("depth", depthDesc);
+	this->m_SceneColorTarget = this->m_ColorTarget;
+
+	// With dynamic resolution the scene renders into its own target and is blitted to the output image afterwards
+	if (this->m_DynamicResolution) {
+		RenderImageDesc colorDesc = {};
+
+		colorDesc.format = this->m_SwapChainImageFormat;
+		colorDesc.extent = this->m_SceneExtent;
+		colorDesc.aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+
+		this->m_SceneColorTarget = this->m_RenderGraph.CreateImage("scene color", colorDesc);
+	}
+
+	// With the pre-pass the color pass only tests against depth, so it reads it in a read-only layout
+	std::vector<RenderAccess> sceneAccesses = {
+		{ this->m_SceneColorTarget, RenderUsage::ColorAttachment },
+		{ this->m_DepthTarget, this->m_DepthPrepass ? RenderUsage::DepthRead : RenderUsage::DepthAttachment }
+	};
+
+	if (this->m_GpuAnimation) {
+		// Both were last touched by the previous frame: the vertices read as vertex input, the group state written by compute
+		this->m_VertexResource = this->m_RenderGraph.ImportBuffer("vertices", RenderUsage::VertexBuffer, RenderUsage::Undefined);
+		this->m_GroupStateResource = this->m_RenderGraph.ImportBuffer("group state", RenderUsage::StorageWrite, RenderUsage::Undefined);
+
+		this->m_RenderGraph.AddPass("animate", { { this->m_VertexResource, RenderUsage::StorageWrite }, { this->m_GroupStateResource, RenderUsage::StorageWrite } },
+			[this](VkCommandBuffer commandBuffer, size_t frame, uint32_t imageIndex) {
+				RecordAnimation(commandBuffer);
+				this->m_Profiler.WritePassTimestamp(commandBuffer, frame, GpuPass::Animate);
+			});
+
+		sceneAccesses.push_back({ this->m_VertexResource, RenderUsage::VertexBuffer });
+	}
+
+	if (this->m_DepthPrepass) {
+		if (this->m_PositionBuffer == VK_NULL_HANDLE && !CreatePositionBuffer()) {
+			return false;
+		}
+
+		this->m_RenderGraph.AddPass("depth prepass", { { this->m_DepthTarget, RenderUsage::DepthAttachment } },
+			[this](VkCommandBuffer commandBuffer, size_t frame, uint32_t imageIndex) { RecordDepthPrepass(commandBuffer, frame, imageIndex); });
+	}
+
+	this->m_RenderGraph.AddPass("scene", sceneAccesses,
+		[this](VkCommandBuffer commandBuffer, size_t frame, uint32_t imageIndex) { RecordMainPass(commandBuffer, frame, imageIndex); });
+
+	if (this->m_DynamicResolution) {
+		this->m_RenderGraph.AddPass("upscale", { { this->m_SceneColorTarget, RenderUsage::TransferSrc }, { this->m_ColorTarget, RenderUsage::TransferDst } },
+			[this](VkCommandBuffer commandBuffer, size_t frame, uint32_t imageIndex) { RecordUpscale(commandBuffer, frame, imageIndex); });
+	}
+
+	if (!this->m_ReadbackBuffers.empty()) {
+		this->m_ReadbackResource = this->m_RenderGraph.ImportBuffer("readback", RenderUsage::Undefined, RenderUsage::HostRead);
+
+		this->m_RenderGraph.AddPass("readback", { { this->m_ColorTarget, RenderUsage::TransferSrc }, { this->m_ReadbackResource, RenderUsage::TransferDst } },
+			[this](VkCommandBuffer commandBuffer, size_t frame, uint32_t imageIndex) { RecordReadback(commandBuffer, frame, imageIndex); });
+	}
+
+	if (!this->m_RenderGraph.Compile()) {
+		return false;
+	}
+
+	this->m_DepthImageView = this->m_RenderGraph.GetImageView(this->m_DepthTarget);
+	this->m_SceneColorView = this->m_DynamicResolution ? this->m_RenderGraph.GetImageView(this->m_SceneColorTarget) : VK_NULL_HANDLE;
+	this->m_RenderGraphStale = false;
+	this->m_Profiler.SetCounter(ProfileCounter::RenderScale, static_cast<uint32_t>(this->m_DynamicResolution ? this->m_ResolutionScaler.GetScale() * 100.0f + 0.5f : 100.0f));
+
+	return true;
+}
+
+// Passes changed at runtime, the graph and the framebuffers on its transients are declared again
+bool Application::RebuildRenderGraph() {
+	vkDeviceWaitIdle(this->m_Device);
+	DestroyFrameBuffers();
 
-	CreateImage(this->m_SwapChainExtent.width, this->m_SwapChainExtent.height, depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->m_DepthImage, this->m_DepthImageMemory);
-	this->m_DepthImageView = CreateImageView(this->m_DepthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
-	TransitionImageLayout(this->m_DepthImage, depthFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+	if (!CreateRenderGraph() || !CreateFrameBuffers()) {
+		return false;
+	}
 
+	MarkCommandBuffersDirty();
+
+	return true;
+}
+
+// Only the render extent changes, the scene targets are sized for the largest scale so nothing is reallocated
+void Application::UpdateResolutionScale() {
+	if (!this->m_DynamicResolution || !this->m_ResolutionScaler.Update(this->m_Profiler.GetLastGpuTime())) {
+		return;
+	}
+
+	this->m_RenderExtent = this->m_ResolutionScaler.GetRenderExtent(this->m_SwapChainExtent);
+	this->m_Profiler.SetCounter(ProfileCounter::RenderScale, static_cast<uint32_t>(this->m_ResolutionScaler.GetScale() * 100.0f + 0.5f));
+	MarkCommandBuffersDirty();
+}
+
+// Positions never change after load, so the pre-pass stream is a single device local copy built on first use
+bool Application::CreatePositionBuffer() {
+	size_t vertexCount = this->m_Mesh.IsOpen() ? static_cast<size_t>(this->m_Mesh.GetVertexCount()) : this->m_Vertices.size();
+	VkDeviceSize bufferSize = Vertex::GetPositionStride(this->m_VertexFormat) * vertexCount;
+	std::vector<uint8_t> positions(bufferSize);
+
+	if (this->m_Mesh.IsOpen()) {
+		Vertex::ExtractPositions(this->m_Mesh.GetVertexData(), vertexCount, this->m_VertexFormat, positions.data());
+	}
+	else {
+		std::vector<uint8_t> encoded(Vertex::GetStride(this->m_VertexFormat) * vertexCount);
+
+		Vertex::Encode(this->m_Vertices.data(), vertexCount, this->m_VertexFormat, encoded.data());
+		Vertex::ExtractPositions(encoded.data(), vertexCount, this->m_VertexFormat, positions.data());
+	}
+
+	if (!CreateBuffers(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->m_PositionBuffer, this->m_PositionBufferMemory)) {
+		return false;
+	}
+
+	UploadMapped(this->m_PositionBuffer, positions.data(), bufferSize, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
 
 	return true;
 }
@@ -1452,13 +2873,7 @@ bool Application::CreateDepthImageResources() {
 VkFormat Application::FindSupportedFormat(const std::vector<VkFormat>& canidates, VkImageTiling tiling, VkFormatFeatureFlags features) {
 	
 	for (VkFormat format : canidates) {
-		VkFormatProperties props;
-		vkGetPhysicalDeviceFormatProperties(this->m_PhysicalDevice, format, &props);
-
-		if (tiling == VK_IMAGE_TILING_LINEAR && (props.linearTilingFeatures & features) == features) {
-			return format;
-		}
-		else if (tiling == VK_IMAGE_TILING_OPTIMAL && (props.optimalTilingFeatures & features) == features) {
+		if (this->m_Allocator.IsFormatSupported(format, tiling, features)) {
 			return format;
 		}
 	}
@@ -1490,92 +2905,14 @@ GLFWwindow* Application::GetWindow() {
 }
 
 
-void Application::VertexTest() {
-
-	static float destR = 0;
-	static float destG = 0;
-	static float destB = 0;
-	bool rMatched = false;
-	bool gMatched = false;
-	bool bMatched = false;
-	static uint64_t timeNow = 0;
-
-
-	if (timeNow == 0) {
-		timeNow = time(NULL);
-		std::srand(timeNow);
+void Application::AnimateVertices() {
+	if (this->m_GpuAnimation || this->m_Mesh.IsOpen()) {
+		return;
 	}
-	
-
-	for (auto& vert : this->m_Vertices) {
-
-	 if (vert.destColor[0] == 0 && vert.destColor[1] == 0 && vert.destColor[2] == 0) {
-			bool pointFound = false;
-
-			for (auto sVerts : this->m_Vertices) {
-				if (sVerts.pos == vert.pos && sVerts.destColor != vert.destColor) {
-			
-					if (sVerts.destColor[0] != 0 && sVerts.destColor[1] != 0 && sVerts.destColor[2] != 0) {
-						vert.destColor = sVerts.destColor;
-						pointFound = true;
-						break;
-					}
-					
-				}
-			}
-
-			if (!pointFound) {
-				vert.destColor[0] = (float)RoundFloat(((float)std::rand() / (RAND_MAX))) / 100;
-				vert.destColor[1] = (float)RoundFloat(((float)std::rand() / (RAND_MAX))) / 100;
-				vert.destColor[2] = (float)RoundFloat(((float)std::rand() / (RAND_MAX))) / 100;
-			}
-		}
-
-		int matchCount = 0;
-
-		for (uint32_t i = 0; i < 3; i++) {
-			if (vert.color[i] < vert.destColor[i]) {
-				float delta = vert.destColor[i] - vert.color[i];
-				
-				if (delta > .009) {
-					vert.color[i] = vert.color[i] + .01;
-				}
-				else {
-					vert.color[i] = vert.destColor[i];		
-					matchCount++;
-				}
-			}
-			else if (vert.color[i] > vert.destColor[i]) {
-				float delta = vert.color[i] - vert.destColor[i];
-
-				if (delta > .009) {
-					vert.color[i] = vert.color[i] - .01;
-				}
-				else {
-					vert.color[i] = vert.destColor[i];
-					matchCount++;
-				}
-			}
-			else {
-				matchCount++;
-			}
-		}
-
-		if (matchCount == 3) {
-			for (uint32_t i = 0; i < 3; i++) {
-				vert.destColor[i] = 0.0;
-			}
-		}
-
-	}
-
-	CreateVertexBuffer();
-	CreateCommandBuffers();
-}
 
-int Application::RoundFloat(float input) {
-	int value = (int)(input * 100 + .5);
-	return value;
+	this->m_Profiler.BeginPhase(ProfilePhase::Animate);
+	this->m_Animator.Step();
+	this->m_Profiler.EndPhase(ProfilePhase::Animate);
 }
 
 void Application::MatrixTest() {
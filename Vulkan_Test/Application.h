@@ -18,11 +18,27 @@
 #include <time.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
 #include <chrono>
+#include <string>
 
 
 #include "ApplicationStructs.h"
+#include "MemoryAllocator.h"
+#include "UploadManager.h"
+#include "PipelineCache.h"
+#include "FrameProfiler.h"
+#include "ColorAnimator.h"
+#include "ThreadPool.h"
+#include "TextureManager.h"
+#include "MeshFile.h"
+#include "FrustumCuller.h"
+#include "RenderGraph.h"
+#include "ResolutionScaler.h"
+#include "FrameTimeline.h"
 
+// Passing a null window runs the renderer headless: no surface or swap chain is created and frames are
+// rendered into offscreen color images instead (see CreateOffscreenTarget).
 class Application
 {
 public:
@@ -32,32 +48,57 @@ public:
 	VkResult InitVulkan();
 	VkInstance GetInstance();
 	bool PickPhysicalDevice();
-	bool CreateLogicalDevice();
+	bool CreateLogicalDevice(bool);
+	bool CreatePipelineCache(bool);
 	bool CreateSurface();
 	bool CreateSwapChain(uint32_t, uint32_t, bool);
+	bool CreateOffscreenTarget(uint32_t, uint32_t, const std::string&);
+	void FlushFrameDumps();
+	void ReportProfile(const std::string&);
+	bool IsHeadless();
+	bool IsValidationEnabled();
 	bool CreateImageViews();
 	bool CreateDescriptorSetLayout();
+	void SetVertexFormat(VertexFormat);
+	bool LoadMesh(const std::string&);
 	bool CreateGraphicsPipeline();
 	bool CreateRenderPass();
 	bool CreateFrameBuffers();
 	bool CreateCommandPool();
-	bool CreateDepthImageResources();
+	bool CreateRenderGraph();
 	bool CreateTextureImage(const char*);
-	bool CreateTextureImageViews();
 	bool CreateTextureSampler();
-	bool CreateVertexBuffer();
+	bool CreateVertexBuffer(bool);
+	bool CreateAnimationPipeline();
+	bool ReserveVertexCapacity(size_t);
 	bool CreateIndexBuffer();
+	void UploadMapped(VkBuffer, const void*, VkDeviceSize, VkPipelineStageFlags, VkAccessFlags);
+	bool CreateInstanceBuffer(uint32_t);
+	bool CreateIndirectBuffer();
 	bool CreateUniformBuffers();
 	bool CreateDescriptorPool();
 	bool CreateDescriptorSets();
-	bool CreateBuffers(VkDeviceSize, VkBufferUsageFlags, VkMemoryPropertyFlags, VkBuffer&, VkDeviceMemory&);
+	bool CreateBuffers(VkDeviceSize, VkBufferUsageFlags, VkMemoryPropertyFlags, VkBuffer&, Allocation&);
+	void DestroyBuffer(VkBuffer&, Allocation&);
 	bool CreateCommandBuffers();
+	void SetFramesInFlight(uint32_t);
+	uint32_t GetFramesInFlight();
+	FrameTimeline* GetFrameTimeline();
+	void SetRecordingThreads(uint32_t);
+	void SetFrustumCulling(bool);
+	void SetDepthPrepass(bool);
+	bool IsDepthPrepassEnabled();
+	void SetDynamicResolution(bool, float, float, float);
+	bool SetPresentMode(VkPresentModeKHR);
+	VkPresentModeKHR GetPresentMode();
+	static const char* GetPresentModeName(VkPresentModeKHR);
+	void MarkCommandBuffersDirty();
 	bool CreateSemaphoresAndFences();
 	bool DrawFrame();
 	VkDevice GetDevice();
 	bool RecreateSwapChain();
 	void MatrixTest();
-	void VertexTest();
+	void AnimateVertices();
 	void FrameResized(int, int);
 	GLFWwindow* GetWindow();
 
@@ -69,74 +110,189 @@ private:
 	bool IsDeviceSuitable(VkPhysicalDevice);
 	QueueFamilyIndices FindDeviceQueFamilies(VkPhysicalDevice);
 	bool CheckDeviceExtensionSupport(VkPhysicalDevice);
+	bool IsDeviceExtensionSupported(VkPhysicalDevice, const char*);
+#ifdef VK_KHR_timeline_semaphore
+	bool QueryTimelineSemaphoreSupport();
+#endif
+#ifdef VK_EXT_descriptor_indexing
+	bool QueryBindlessSupport(VkPhysicalDeviceDescriptorIndexingFeaturesEXT&);
+#endif
 	SwapChainSupportDetails QuerySwapChainSupport(VkPhysicalDevice);
 	VkSurfaceFormatKHR ChooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>&);
 	VkPresentModeKHR ChooseSwapPresentMode(const std::vector<VkPresentModeKHR>, bool);
 	VkExtent2D ChooseSwapChainExtent(const VkSurfaceCapabilitiesKHR&);
 	std::vector<char> ReadFile(const std::string&);
 	VkShaderModule CreateShaderModule(const std::vector<char>&);
-	uint32_t FindMemoryType(uint32_t, VkMemoryPropertyFlags);
 	bool CleanupSwapChain();
-	int RoundFloat(float);
-	void CopyBuffer(VkBuffer, VkBuffer, VkDeviceSize);
-	void UpdateUniformBuffer(uint32_t);
-	void CreateImage(uint32_t, uint32_t, VkFormat, VkImageTiling, VkImageUsageFlags, VkMemoryPropertyFlags, VkImage&, VkDeviceMemory&);
-	VkCommandBuffer BeginSingleTimeCommands();
-	void EndSingleTimeCommands(VkCommandBuffer);
-	void TransitionImageLayout(VkImage, VkFormat, VkImageLayout, VkImageLayout);
-	void CopyBufferToImage(VkBuffer, VkImage, uint32_t, uint32_t);
-	void UpdateVertexBuffer();
-	VkImageView CreateImageView(VkImage, VkFormat, VkImageAspectFlags);
+	void DestroyFrameBuffers();
+	bool RebuildRenderGraph();
+	bool CreatePositionBuffer();
+	void UpdateResolutionScale();
+	void UpdateUniformBuffer();
+	void CullInstances(size_t);
+	uint32_t WriteObjectUniform(uint32_t, const UniformBufferObject&);
+	void CreateImage(uint32_t, uint32_t, uint32_t, VkFormat, VkImageTiling, VkImageUsageFlags, VkMemoryPropertyFlags, VkImage&, Allocation&);
+	void DestroyImage(VkImage&, Allocation&);
+	void UploadVertices();
 	VkFormat FindSupportedFormat(const std::vector<VkFormat>&, VkImageTiling, VkFormatFeatureFlags);
 	VkFormat FindDepthFormat();
 	bool HasStencilComponent(VkFormat);
+	VkCommandBuffer GetFrameCommandBuffer(uint32_t);
+	void RecordCommandBuffer(VkCommandBuffer, size_t, uint32_t);
+	void RecordAnimation(VkCommandBuffer);
+	void RecordMainPass(VkCommandBuffer, size_t, uint32_t);
+	void RecordDepthPrepass(VkCommandBuffer, size_t, uint32_t);
+	void SetSceneViewport(VkCommandBuffer);
+	void RecordUpscale(VkCommandBuffer, size_t, uint32_t);
+	void RecordReadback(VkCommandBuffer, size_t, uint32_t);
+	void RecordScenePass(VkCommandBuffer, size_t, uint32_t, uint32_t);
+	void RecordSceneDraws(VkCommandBuffer, size_t, uint32_t, uint32_t);
+	void RecordSecondaryDraws(VkCommandBuffer, size_t, uint32_t);
+	bool AllocateSecondaryCommandBuffers(size_t);
+	void RefreshTextureDescriptors(size_t);
+	bool DrawOffscreenFrame();
+	void WriteFrameDump(size_t);
 
 	GLFWwindow* m_Window;
 	VkInstance m_Instance;
 	VkDebugUtilsMessengerEXT m_DebugMessenger;
-	VkPhysicalDevice m_PhysicalDevice;
+	VkPhysicalDevice m_PhysicalDevice = VK_NULL_HANDLE;
 	VkDevice m_Device;
-	VkSurfaceKHR m_Surface;
+	VkPhysicalDeviceProperties m_DeviceProperties;
+	MemoryAllocator m_Allocator;
+	UploadManager m_UploadManager;
+	PipelineCache m_PipelineCache;
+	FrameProfiler m_Profiler;
+	ColorAnimator m_Animator;
+	ThreadPool m_ThreadPool;
+	bool m_PipelineFeedbackSupported = false;
+	bool m_BindlessTextures = false;
+	uint32_t m_BindlessCapacity = 0;
+	VkSurfaceKHR m_Surface = VK_NULL_HANDLE;
 	VkQueue m_PresentQue;
 	VkQueue m_GraphicsQueue;
+	VkQueue m_TransferQueue;
 	uint32_t m_WindowWidth;
 	uint32_t m_WindowHeight;
-	VkSwapchainKHR m_SwapChain;
+	VkSwapchainKHR m_SwapChain = VK_NULL_HANDLE;
 	std::vector<VkImage> m_SwapChainImages;
 	VkFormat m_SwapChainImageFormat;
 	VkExtent2D m_SwapChainExtent;
+	bool m_SwapChainBlitTarget = false;
+	VkPresentModeKHR m_PresentMode = VK_PRESENT_MODE_MAX_ENUM_KHR;
+	VkPresentModeKHR m_RequestedPresentMode = VK_PRESENT_MODE_MAX_ENUM_KHR;
+	bool m_PresentModeStale = false;
 	std::vector<VkImageView> m_SwapChainImageViews;
 	VkRenderPass m_RenderPass;
 	VkDescriptorSetLayout m_DescriptorSetLayout;
 	VkDescriptorPool m_DescriptorPool;
 	VkPipelineLayout m_PipelineLayout;
 	VkPipeline m_GraphicsPipeLine;
+	bool m_DepthPrepass = false;
+	bool m_RenderGraphStale = false;
+	VkRenderPass m_DepthPrepassRenderPass = VK_NULL_HANDLE;
+	VkRenderPass m_DepthEqualRenderPass = VK_NULL_HANDLE;
+	VkPipeline m_DepthPrepassPipeline = VK_NULL_HANDLE;
+	VkPipeline m_DepthEqualPipeline = VK_NULL_HANDLE;
+	VkFramebuffer m_DepthPrepassFramebuffer = VK_NULL_HANDLE;
+	VkBuffer m_PositionBuffer = VK_NULL_HANDLE;
+	Allocation m_PositionBufferMemory;
 	VkCommandPool m_CommandPool;
-	VkBuffer m_VertexBuffer;
-	VkDeviceMemory m_VertexBufferMemory;
+	VkBuffer m_VertexBuffer = VK_NULL_HANDLE;
+	Allocation m_VertexBufferMemory;
+	VkDeviceSize m_VertexRegionSize = 0;
+	size_t m_VertexCapacity = 0;
+	VertexFormat m_VertexFormat = VertexFormat::Packed;
+	bool m_GpuAnimation = false;
+	VkBuffer m_VertexGroupBuffer = VK_NULL_HANDLE;
+	Allocation m_VertexGroupMemory;
+	VkBuffer m_GroupStateBuffer = VK_NULL_HANDLE;
+	Allocation m_GroupStateMemory;
+	uint32_t m_AnimationGroupCount = 0;
+	VkDescriptorSetLayout m_AnimationSetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool m_AnimationDescriptorPool = VK_NULL_HANDLE;
+	VkDescriptorSet m_AnimationSet = VK_NULL_HANDLE;
+	VkPipelineLayout m_AnimationPipelineLayout = VK_NULL_HANDLE;
+	VkPipeline m_AnimationPipeline = VK_NULL_HANDLE;
 	VkBuffer m_IndexBuffer;
-	VkDeviceMemory m_IndexBufferMemory;		
-	VkImage m_TextureImage;
-	VkDeviceMemory m_TextureImageMemory;
-	VkImageView m_TextureImageView;
-	VkImage m_DepthImage;
-	VkDeviceMemory m_DepthImageMemory;
-	VkImageView m_DepthImageView;
+	Allocation m_IndexBufferMemory;
+	VkIndexType m_IndexType = VK_INDEX_TYPE_UINT16;
+	MeshFile m_Mesh;
+	std::vector<InstanceData> m_Instances;
+	VkBuffer m_InstanceBuffer = VK_NULL_HANDLE;
+	Allocation m_InstanceBufferMemory;
+	VkDeviceSize m_InstanceRegionSize = 0;
+	VkBuffer m_IndirectBuffer = VK_NULL_HANDLE;
+	Allocation m_IndirectBufferMemory;
+	VkDeviceSize m_IndirectRegionSize = 0;
+	FrustumCuller m_Culler;
+	bool m_FrustumCulling = true;
+	glm::mat4 m_CullTransform = glm::mat4(1.0f);
+	std::vector<uint32_t> m_VisibleInstances;
+	uint32_t m_DrawCommandCount = 0;
+	VkDeviceSize m_DrawCountOffset = 0;
+	bool m_MultiDrawIndirect = false;
+#ifdef VK_KHR_draw_indirect_count
+	PFN_vkCmdDrawIndexedIndirectCountKHR m_CmdDrawIndexedIndirectCount = nullptr;
+#endif
+	TextureManager m_TextureManager;
+	std::vector<TextureHandle> m_Textures;
+	std::vector<VkImageView> m_BoundTextureViews;
+	VkBuffer m_TextureSlotBuffer = VK_NULL_HANDLE;
+	Allocation m_TextureSlotMemory;
+	VkDeviceSize m_TextureSlotRegionSize = 0;
+	int m_TextureSlotRegionsStale = 0;
+	const uint32_t MAX_BINDLESS_TEXTURES = 4096;
+	RenderGraph m_RenderGraph;
+	RenderResource m_ColorTarget = 0;
+	RenderResource m_DepthTarget = 0;
+	RenderResource m_VertexResource = 0;
+	RenderResource m_GroupStateResource = 0;
+	RenderResource m_ReadbackResource = 0;
+	VkImageView m_DepthImageView = VK_NULL_HANDLE;
+	ResolutionScaler m_ResolutionScaler;
+	bool m_DynamicResolution = false;
+	RenderResource m_SceneColorTarget = 0;
+	VkImageView m_SceneColorView = VK_NULL_HANDLE;
+	// Size of the scene attachments and the part of them rendered this frame, both the swap chain extent without dynamic resolution
+	VkExtent2D m_SceneExtent = {};
+	VkExtent2D m_RenderExtent = {};
 	VkSampler m_TextureSampler;
 
 	std::vector<VkDescriptorSet> m_DescriptionSets;
-	std::vector<VkBuffer> m_UniformBuffers;
-	std::vector<VkDeviceMemory> m_UniformBufferMemory;
-	std::vector<VkCommandBuffer> m_CommandBuffers;
+	VkBuffer m_UniformBuffer = VK_NULL_HANDLE;
+	Allocation m_UniformBufferMemory;
+	VkDeviceSize m_UniformStride = 0;
+	std::vector<VkCommandPool> m_FrameCommandPools;
+	std::vector<std::vector<VkCommandBuffer>> m_CommandBuffers;
+	std::vector<std::vector<uint64_t>> m_RecordedGeneration;
+	std::vector<uint64_t> m_FramePoolGeneration;
+	uint32_t m_RecordingThreads = 0;
+	std::vector<std::vector<VkCommandPool>> m_SecondaryCommandPools;
+	std::vector<std::vector<std::vector<VkCommandBuffer>>> m_SecondaryCommandBuffers;
+	uint64_t m_SceneGeneration = 1;
 	std::vector<VkFramebuffer> m_SwapChainFramebuffers;
 	std::vector<VkSemaphore> m_ImageAvailableSemaphore;
 	std::vector<VkSemaphore> m_RenderFinishedSemaphore;
-	std::vector<VkFence> m_InFlightFences;
+	FrameTimeline m_FrameTimeline;
+	bool m_TimelineSemaphore = false;
 
 	size_t m_CurrentFrame = 0;
-	const int MAX_FRAMES_IN_FLIGHT = 2;
+	uint32_t m_FramesInFlight = 2;
+	const uint32_t MAX_FRAMES_IN_FLIGHT = 4;
+	const uint32_t MAX_UNIFORM_OBJECTS = 1024;
+	const VkDeviceSize MESH_UPLOAD_CHUNK = 32ull * 1024 * 1024;
 	bool m_FramebufferResized = false;
 	bool m_Vsync = true;
+	bool m_Headless = false;
+	bool m_ValidationEnabled = true;
+
+	std::vector<Allocation> m_OffscreenImageMemory;
+	std::vector<VkBuffer> m_ReadbackBuffers;
+	std::vector<Allocation> m_ReadbackMemory;
+	std::vector<int64_t> m_PendingDumpFrame;
+	std::string m_DumpDirectory;
+	uint64_t m_FrameNumber = 0;
 
 	const std::vector<const char*> m_ValidationLayers {
 		"VK_LAYER_KHRONOS_validation"
@@ -146,15 +302,15 @@ private:
 	};
 
 	std::vector<Vertex> m_Vertices = {
-		{{-1.0f, -1.0f, 0.0f}, {1.0f, 0.0f, 0.0f}, {1.0f, 1.0f}, {0.0f, 0.0f, 0.0f}},
-		{{1.0f, -1.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {1.0f, 0.0f} , {0.0f, 0.0f, 0.0f}},
-		{{1.0f, 1.0f, 0.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f} , {0.0f, 0.0f, 0.0f}},
-		{{-1.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f} , {0.0f, 0.0f, 0.0f}},
-
-		{{-1.0f, -1.0f, 0.5f}, {1.0f, 0.0f, 0.0f}, {1.0f, 1.0f}, {0.0f, 0.0f, 0.0f}},
-		{{1.0f, -1.0f, 0.5f}, {0.0f, 1.0f, 0.0f}, {1.0f, 0.0f} , {0.0f, 0.0f, 0.0f}},
-		{{1.0f, 1.0f, 0.5f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f} , {0.0f, 0.0f, 0.0f}},
-		{{-1.0f, 1.0f, 0.5f}, {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f} , {0.0f, 0.0f, 0.0f}}
+		{{-1.0f, -1.0f, 0.0f}, {1.0f, 0.0f, 0.0f}, {1.0f, 1.0f}},
+		{{1.0f, -1.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {1.0f, 0.0f}},
+		{{1.0f, 1.0f, 0.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f}},
+		{{-1.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f}},
+
+		{{-1.0f, -1.0f, 0.5f}, {1.0f, 0.0f, 0.0f}, {1.0f, 1.0f}},
+		{{1.0f, -1.0f, 0.5f}, {0.0f, 1.0f, 0.0f}, {1.0f, 0.0f}},
+		{{1.0f, 1.0f, 0.5f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f}},
+		{{-1.0f, 1.0f, 0.5f}, {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f}}
 	};
 
 	const std::vector<uint16_t> m_Indices = {
@@ -2,11 +2,14 @@
 
 #include <optional>
 #include <array>
+#include <algorithm>
+#include <string.h>
 
 struct QueueFamilyIndices {
 
 	std::optional<uint32_t> graphicsFamily;
 	std::optional<uint32_t> presentFamily;
+	std::optional<uint32_t> transferFamily;
 
 	bool isComplete() {
 
@@ -21,44 +24,185 @@ struct SwapChainSupportDetails {
 };
 
 
+// Layouts the GPU vertex stream can take. Vertex stays the CPU side source and animation input, the
+// stream at binding 0 is encoded from it, so fields the shaders never read are not uploaded
+enum class VertexFormat : uint32_t {
+	Float,
+	Packed
+};
+
+// 16 byte stream: half float position (w is padding), RGBA8 unorm color and 16 bit unorm texture
+// coordinates, so texture coordinates have to lie in [0, 1]
+struct PackedVertex {
+	uint16_t pos[4];
+	uint32_t color;
+	uint16_t texCoord[2];
+};
+
+static_assert(sizeof(PackedVertex) == 16, "PackedVertex has to stay 16 bytes");
+
 struct Vertex {
 	glm::vec3 pos;
 	glm::vec3 color;
 	glm::vec2 texCoord;
-	glm::vec3 destColor;
 
-	static VkVertexInputBindingDescription GetBindingDescription() {
+	static uint32_t GetStride(VertexFormat format) {
+		return static_cast<uint32_t>(format == VertexFormat::Packed ? sizeof(PackedVertex) : sizeof(Vertex));
+	}
+
+	static uint32_t GetColorOffset(VertexFormat format) {
+		return static_cast<uint32_t>(format == VertexFormat::Packed ? offsetof(PackedVertex, color) : offsetof(Vertex, color));
+	}
+
+	static VkVertexInputBindingDescription GetBindingDescription(VertexFormat format) {
 		VkVertexInputBindingDescription bindDescrip = {};
 
 		bindDescrip.binding = 0;
-		bindDescrip.stride = sizeof(Vertex);
+		bindDescrip.stride = GetStride(format);
 		bindDescrip.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
 		return bindDescrip;
 	}
 
-	static std::array<VkVertexInputAttributeDescription, 4> getAttributeDescriptions() {
-		std::array<VkVertexInputAttributeDescription, 4> attributeDescrip = {};
+	static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions(VertexFormat format) {
+		std::array<VkVertexInputAttributeDescription, 3> attributeDescrip = {};
+		bool packed = format == VertexFormat::Packed;
 
+		// Normalized and half formats are expanded by the fetch, so the shader inputs stay vec3/vec2 either way
 		attributeDescrip[0].binding = 0;
 		attributeDescrip[0].location = 0;
-		attributeDescrip[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-		attributeDescrip[0].offset = offsetof(Vertex, pos);
-		
+		attributeDescrip[0].format = packed ? VK_FORMAT_R16G16B16A16_SFLOAT : VK_FORMAT_R32G32B32_SFLOAT;
+		attributeDescrip[0].offset = packed ? offsetof(PackedVertex, pos) : offsetof(Vertex, pos);
+
 		attributeDescrip[1].binding = 0;
 		attributeDescrip[1].location = 1;
-		attributeDescrip[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-		attributeDescrip[1].offset = offsetof(Vertex, color);
+		attributeDescrip[1].format = packed ? VK_FORMAT_R8G8B8A8_UNORM : VK_FORMAT_R32G32B32_SFLOAT;
+		attributeDescrip[1].offset = GetColorOffset(format);
 
 		attributeDescrip[2].binding = 0;
 		attributeDescrip[2].location = 2;
-		attributeDescrip[2].format = VK_FORMAT_R32G32_SFLOAT;
-		attributeDescrip[2].offset = offsetof(Vertex, texCoord);
+		attributeDescrip[2].format = packed ? VK_FORMAT_R16G16_UNORM : VK_FORMAT_R32G32_SFLOAT;
+		attributeDescrip[2].offset = packed ? offsetof(PackedVertex, texCoord) : offsetof(Vertex, texCoord);
+
+		return attributeDescrip;
+	}
+
+	// Position-only stream at binding 0 for the depth pre-pass, same attribute format as the full vertex so both passes compute identical depth
+	static uint32_t GetPositionStride(VertexFormat format) {
+		return static_cast<uint32_t>(format == VertexFormat::Packed ? sizeof(PackedVertex::pos) : sizeof(glm::vec3));
+	}
+
+	static VkVertexInputBindingDescription GetPositionBindingDescription(VertexFormat format) {
+		VkVertexInputBindingDescription bindDescrip = {};
+
+		bindDescrip.binding = 0;
+		bindDescrip.stride = GetPositionStride(format);
+		bindDescrip.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+		return bindDescrip;
+	}
+
+	static VkVertexInputAttributeDescription GetPositionAttributeDescription(VertexFormat format) {
+		VkVertexInputAttributeDescription attributeDescrip = getAttributeDescriptions(format)[0];
+
+		attributeDescrip.offset = 0;
+
+		return attributeDescrip;
+	}
+
+	// Copies the position of count encoded vertices into a tightly packed stream, position is the first member in both layouts
+	static void ExtractPositions(const void* src, size_t count, VertexFormat format, void* dst) {
+		const uint8_t* vertex = static_cast<const uint8_t*>(src);
+		uint8_t* position = static_cast<uint8_t*>(dst);
+		uint32_t stride = GetStride(format);
+		uint32_t positionStride = GetPositionStride(format);
+
+		for (size_t i = 0; i < count; i++) {
+			memcpy(position + positionStride * i, vertex + stride * i, positionStride);
+		}
+	}
+
+	// Sphere around the axis aligned bounds as (center, radius), used for culling
+	static glm::vec4 ComputeBoundingSphere(const Vertex* vertices, size_t count) {
+		if (count == 0) {
+			return glm::vec4(0.0f);
+		}
+
+		glm::vec3 lower = vertices[0].pos;
+		glm::vec3 upper = vertices[0].pos;
+		float radius = 0.0f;
+
+		for (size_t i = 1; i < count; i++) {
+			lower = glm::min(lower, vertices[i].pos);
+			upper = glm::max(upper, vertices[i].pos);
+		}
+
+		glm::vec3 center = (lower + upper) * 0.5f;
+
+		for (size_t i = 0; i < count; i++) {
+			radius = std::max(radius, glm::length(vertices[i].pos - center));
+		}
+
+		return glm::vec4(center, radius);
+	}
 
-		attributeDescrip[3].binding = 0;
-		attributeDescrip[3].location = 3;
-		attributeDescrip[3].format = VK_FORMAT_R32G32B32_SFLOAT;
-		attributeDescrip[3].offset = offsetof(Vertex, destColor);
+	// Writes count vertices into dst in the given layout, dst must hold GetStride(format) * count bytes
+	static void Encode(const Vertex* vertices, size_t count, VertexFormat format, void* dst) {
+		if (format == VertexFormat::Float) {
+			memcpy(dst, vertices, sizeof(Vertex) * count);
+			return;
+		}
+
+		PackedVertex* packed = static_cast<PackedVertex*>(dst);
+
+		for (size_t i = 0; i < count; i++) {
+			glm::uint64 pos = glm::packHalf4x16(glm::vec4(vertices[i].pos, 0.0f));
+			glm::uint32 texCoord = glm::packUnorm2x16(glm::clamp(vertices[i].texCoord, 0.0f, 1.0f));
+
+			memcpy(packed[i].pos, &pos, sizeof(pos));
+			memcpy(packed[i].texCoord, &texCoord, sizeof(texCoord));
+			packed[i].color = glm::packUnorm4x8(glm::vec4(vertices[i].color, 1.0f));
+		}
+	}
+};
+
+// Per-instance stream at binding 1: an object transform applied before the shared model matrix, a tint
+// multiplied into the vertex color, and the texture handle the fragment shader samples in bindless mode
+struct InstanceData {
+	glm::mat4 transform;
+	glm::vec4 tint;
+	uint32_t textureHandle;
+
+	static VkVertexInputBindingDescription GetBindingDescription() {
+		VkVertexInputBindingDescription bindDescrip = {};
+
+		bindDescrip.binding = 1;
+		bindDescrip.stride = sizeof(InstanceData);
+		bindDescrip.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+		return bindDescrip;
+	}
+
+	static std::array<VkVertexInputAttributeDescription, 6> getAttributeDescriptions() {
+		std::array<VkVertexInputAttributeDescription, 6> attributeDescrip = {};
+
+		// A mat4 attribute takes one location per column
+		for (uint32_t column = 0; column < 4; column++) {
+			attributeDescrip[column].binding = 1;
+			attributeDescrip[column].location = 4 + column;
+			attributeDescrip[column].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+			attributeDescrip[column].offset = static_cast<uint32_t>(offsetof(InstanceData, transform) + sizeof(glm::vec4) * column);
+		}
+
+		attributeDescrip[4].binding = 1;
+		attributeDescrip[4].location = 8;
+		attributeDescrip[4].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+		attributeDescrip[4].offset = offsetof(InstanceData, tint);
+
+		attributeDescrip[5].binding = 1;
+		attributeDescrip[5].location = 9;
+		attributeDescrip[5].format = VK_FORMAT_R32_UINT;
+		attributeDescrip[5].offset = offsetof(InstanceData, textureHandle);
 
 		return attributeDescrip;
 	}
@@ -69,4 +213,20 @@ struct UniformBufferObject {
 	glm::mat4 view;
 	glm::mat4 proj;
 
-};
\ No newline at end of file
+};
+
+// Matches the push constant block in animate.comp, strides and offsets are counted in 32 bit words
+struct AnimationPushConstants {
+	uint32_t pass;
+	uint32_t count;
+	uint32_t vertexStride;
+	uint32_t colorOffset;
+	uint32_t packedColor;
+};
+
+// One entry per position group in the compute animation's state buffer
+struct AnimationGroupState {
+	glm::vec4 color;
+	uint32_t generation[4];
+};
+
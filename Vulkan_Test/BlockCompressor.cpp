@@ -0,0 +1,297 @@
+
+#include "BlockCompressor.h"
+
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+static uint16_t PackColor565(const float* color) {
+	int r = static_cast<int>(std::min(std::max(color[0], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+	int g = static_cast<int>(std::min(std::max(color[1], 0.0f), 255.0f) * 63.0f / 255.0f + 0.5f);
+	int b = static_cast<int>(std::min(std::max(color[2], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+
+	return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+static void UnpackColor565(uint16_t packed, int* color) {
+	int r = (packed >> 11) & 31;
+	int g = (packed >> 5) & 63;
+	int b = packed & 31;
+
+	color[0] = (r << 3) | (r >> 2);
+	color[1] = (g << 2) | (g >> 4);
+	color[2] = (b << 3) | (b >> 2);
+}
+
+// Picks the nearest of the four palette colors for every texel, returns the packed indices and the total error
+static uint32_t FitIndices(const uint8_t* texels, uint16_t color0, uint16_t color1, uint32_t& error) {
+	int palette[4][3];
+	uint32_t indices = 0;
+
+	UnpackColor565(color0, palette[0]);
+	UnpackColor565(color1, palette[1]);
+
+	for (int c = 0; c < 3; c++) {
+		palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+		palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+	}
+
+	error = 0;
+
+	for (int i = 0; i < 16; i++) {
+		const uint8_t* texel = texels + i * 4;
+		uint32_t best = 0;
+		uint32_t bestError = UINT32_MAX;
+
+		for (uint32_t p = 0; p < 4; p++) {
+			int dr = texel[0] - palette[p][0];
+			int dg = texel[1] - palette[p][1];
+			int db = texel[2] - palette[p][2];
+			uint32_t distance = static_cast<uint32_t>(dr * dr + dg * dg + db * db);
+
+			if (distance < bestError) {
+				bestError = distance;
+				best = p;
+			}
+		}
+
+		indices |= best << (i * 2);
+		error += bestError;
+	}
+
+	return indices;
+}
+
+BlockCompressor::BlockCompressor()
+{
+}
+
+BlockCompressor::~BlockCompressor()
+{
+}
+
+size_t BlockCompressor::GetBlockBytes(BlockFormat format) {
+	return format == BlockFormat::BC1 ? 8 : 16;
+}
+
+size_t BlockCompressor::GetCompressedSize(BlockFormat format, uint32_t width, uint32_t height) {
+	size_t blocksWide = (width + 3) / 4;
+	size_t blocksHigh = (height + 3) / 4;
+
+	return blocksWide * blocksHigh * GetBlockBytes(format);
+}
+
+void BlockCompressor::Compress(const uint8_t* pixels, uint32_t width, uint32_t height, BlockFormat format, uint8_t* output, ThreadPool& threadPool) {
+	size_t blockRows = (height + 3) / 4;
+
+	threadPool.ParallelFor(blockRows, [&](size_t firstRow, size_t lastRow) {
+		CompressRows(pixels, width, height, format, output, firstRow, lastRow);
+	});
+}
+
+void BlockCompressor::CompressRows(const uint8_t* pixels, uint32_t width, uint32_t height, BlockFormat format, uint8_t* output, size_t firstRow, size_t lastRow) {
+	size_t blocksWide = (width + 3) / 4;
+	size_t blockBytes = GetBlockBytes(format);
+	uint8_t texels[16 * 4];
+
+	for (size_t by = firstRow; by < lastRow; by++) {
+		for (size_t bx = 0; bx < blocksWide; bx++) {
+			uint8_t* block = output + (by * blocksWide + bx) * blockBytes;
+
+			for (size_t y = 0; y < 4; y++) {
+				size_t sourceY = std::min<size_t>(by * 4 + y, height - 1);
+
+				for (size_t x = 0; x < 4; x++) {
+					size_t sourceX = std::min<size_t>(bx * 4 + x, width - 1);
+
+					memcpy(texels + (y * 4 + x) * 4, pixels + (sourceY * width + sourceX) * 4, 4);
+				}
+			}
+
+			if (format == BlockFormat::BC3) {
+				EncodeAlphaBlock(texels, block);
+				block += 8;
+			}
+
+			EncodeColorBlock(texels, block);
+		}
+	}
+}
+
+void BlockCompressor::EncodeColorBlock(const uint8_t* texels, uint8_t* block) {
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+	float covariance[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+
+	for (int i = 0; i < 16; i++) {
+		for (int c = 0; c < 3; c++) {
+			mean[c] += texels[i * 4 + c] / 16.0f;
+		}
+	}
+
+	for (int i = 0; i < 16; i++) {
+		float r = texels[i * 4 + 0] - mean[0];
+		float g = texels[i * 4 + 1] - mean[1];
+		float b = texels[i * 4 + 2] - mean[2];
+
+		covariance[0] += r * r;
+		covariance[1] += r * g;
+		covariance[2] += r * b;
+		covariance[3] += g * g;
+		covariance[4] += g * b;
+		covariance[5] += b * b;
+	}
+
+	// A few power iterations are enough to find the principal axis of 16 colors
+	float axis[3] = { 1.0f, 1.0f, 1.0f };
+
+	for (int iteration = 0; iteration < 8; iteration++) {
+		float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+		float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+		float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+		float length = sqrtf(x * x + y * y + z * z);
+
+		if (length < 1e-6f) {
+			break;
+		}
+
+		axis[0] = x / length;
+		axis[1] = y / length;
+		axis[2] = z / length;
+	}
+
+	float minProjection = 0.0f;
+	float maxProjection = 0.0f;
+
+	for (int i = 0; i < 16; i++) {
+		float projection = 0.0f;
+
+		for (int c = 0; c < 3; c++) {
+			projection += (texels[i * 4 + c] - mean[c]) * axis[c];
+		}
+
+		minProjection = std::min(minProjection, projection);
+		maxProjection = std::max(maxProjection, projection);
+	}
+
+	float endpoint0[3];
+	float endpoint1[3];
+
+	for (int c = 0; c < 3; c++) {
+		endpoint0[c] = mean[c] + axis[c] * maxProjection;
+		endpoint1[c] = mean[c] + axis[c] * minProjection;
+	}
+
+	uint16_t color0 = PackColor565(endpoint0);
+	uint16_t color1 = PackColor565(endpoint1);
+	uint32_t error = 0;
+
+	// color0 > color1 keeps the decoder in four color mode
+	if (color0 < color1) {
+		std::swap(color0, color1);
+	}
+
+	uint32_t indices = FitIndices(texels, color0, color1, error);
+
+	// One least squares pass moves the endpoints toward the colors the indices actually picked
+	static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+	float alpha2 = 0.0f;
+	float beta2 = 0.0f;
+	float alphaBeta = 0.0f;
+	float alphaX[3] = { 0.0f, 0.0f, 0.0f };
+	float betaX[3] = { 0.0f, 0.0f, 0.0f };
+
+	for (int i = 0; i < 16; i++) {
+		float alpha = weights[(indices >> (i * 2)) & 3];
+		float beta = 1.0f - alpha;
+
+		alpha2 += alpha * alpha;
+		beta2 += beta * beta;
+		alphaBeta += alpha * beta;
+
+		for (int c = 0; c < 3; c++) {
+			alphaX[c] += alpha * texels[i * 4 + c];
+			betaX[c] += beta * texels[i * 4 + c];
+		}
+	}
+
+	float determinant = alpha2 * beta2 - alphaBeta * alphaBeta;
+
+	if (fabsf(determinant) > 1e-6f) {
+		for (int c = 0; c < 3; c++) {
+			endpoint0[c] = (alphaX[c] * beta2 - betaX[c] * alphaBeta) / determinant;
+			endpoint1[c] = (betaX[c] * alpha2 - alphaX[c] * alphaBeta) / determinant;
+		}
+
+		uint16_t refined0 = PackColor565(endpoint0);
+		uint16_t refined1 = PackColor565(endpoint1);
+		uint32_t refinedError = 0;
+		uint32_t refinedIndices = FitIndices(texels, std::max(refined0, refined1), std::min(refined0, refined1), refinedError);
+
+		if (refinedError < error) {
+			color0 = std::max(refined0, refined1);
+			color1 = std::min(refined0, refined1);
+			indices = refinedIndices;
+		}
+	}
+
+	// Equal endpoints would switch the decoder into three color mode, so the block becomes a flat color
+	if (color0 == color1) {
+		indices = 0;
+	}
+
+	block[0] = static_cast<uint8_t>(color0 & 0xFF);
+	block[1] = static_cast<uint8_t>(color0 >> 8);
+	block[2] = static_cast<uint8_t>(color1 & 0xFF);
+	block[3] = static_cast<uint8_t>(color1 >> 8);
+	memcpy(block + 4, &indices, sizeof(indices));
+}
+
+void BlockCompressor::EncodeAlphaBlock(const uint8_t* texels, uint8_t* block) {
+	uint8_t minAlpha = 255;
+	uint8_t maxAlpha = 0;
+
+	for (int i = 0; i < 16; i++) {
+		minAlpha = std::min(minAlpha, texels[i * 4 + 3]);
+		maxAlpha = std::max(maxAlpha, texels[i * 4 + 3]);
+	}
+
+	block[0] = maxAlpha;
+	block[1] = minAlpha;
+	memset(block + 2, 0, 6);
+
+	if (maxAlpha == minAlpha) {
+		return;
+	}
+
+	// alpha0 > alpha1 selects the eight value mode: both endpoints and six evenly spaced steps between them
+	int palette[8];
+	uint64_t indices = 0;
+
+	palette[0] = maxAlpha;
+	palette[1] = minAlpha;
+
+	for (int i = 2; i < 8; i++) {
+		palette[i] = ((8 - i) * maxAlpha + (i - 1) * minAlpha) / 7;
+	}
+
+	for (int i = 0; i < 16; i++) {
+		int alpha = texels[i * 4 + 3];
+		uint64_t best = 0;
+		int bestError = 256;
+
+		for (int p = 0; p < 8; p++) {
+			int distance = abs(alpha - palette[p]);
+
+			if (distance < bestError) {
+				bestError = distance;
+				best = p;
+			}
+		}
+
+		indices |= best << (i * 3);
+	}
+
+	for (int i = 0; i < 6; i++) {
+		block[2 + i] = static_cast<uint8_t>(indices >> (i * 8));
+	}
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#include "ThreadPool.h"
+
+enum class BlockFormat : uint32_t {
+	BC1,
+	BC3
+};
+
+// Encodes RGBA8 images into BC1 (opaque, 8 bytes per 4x4 block) or BC3 (BC1 color plus an 8 byte
+// alpha block). Color endpoints are fitted along the principal axis of each block and every texel
+// then takes the nearest palette entry; partial blocks on the right and bottom edges repeat the last
+// texel. Rows of blocks are split across the thread pool.
+class BlockCompressor
+{
+public:
+	BlockCompressor();
+	~BlockCompressor();
+
+	static size_t GetBlockBytes(BlockFormat);
+	static size_t GetCompressedSize(BlockFormat, uint32_t, uint32_t);
+
+	void Compress(const uint8_t*, uint32_t, uint32_t, BlockFormat, uint8_t*, ThreadPool&);
+
+private:
+	void CompressRows(const uint8_t*, uint32_t, uint32_t, BlockFormat, uint8_t*, size_t, size_t);
+	void EncodeColorBlock(const uint8_t*, uint8_t*);
+	void EncodeAlphaBlock(const uint8_t*, uint8_t*);
+};
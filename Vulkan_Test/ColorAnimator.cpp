@@ -0,0 +1,330 @@
+
+#include "ColorAnimator.h"
+
+#include <string.h>
+#include <unordered_map>
+
+#include "CpuFeatures.h"
+
+static const float STEP = 0.01f;
+static const float SNAP_THRESHOLD = 0.009f;
+
+struct PositionKey {
+	uint32_t x;
+	uint32_t y;
+	uint32_t z;
+
+	bool operator==(const PositionKey& other) const {
+		return x == other.x && y == other.y && z == other.z;
+	}
+};
+
+struct PositionKeyHash {
+	size_t operator()(const PositionKey& key) const {
+		uint64_t hash = key.x * 0x9E3779B97F4A7C15ull;
+
+		hash ^= (key.y + 0x7F4A7C15ull + (hash << 6) + (hash >> 2)) * 0xBF58476D1CE4E5B9ull;
+		hash ^= (key.z + 0x94D049BBull + (hash << 6) + (hash >> 2)) * 0x94D049BB133111EBull;
+
+		return static_cast<size_t>(hash ^ (hash >> 31));
+	}
+};
+
+static PositionKey MakeKey(float x, float y, float z) {
+	PositionKey key;
+
+	// Normalize -0.0 so it lands in the same group as 0.0, matching the float comparison this replaces
+	x = x == 0.0f ? 0.0f : x;
+	y = y == 0.0f ? 0.0f : y;
+	z = z == 0.0f ? 0.0f : z;
+
+	memcpy(&key.x, &x, sizeof(float));
+	memcpy(&key.y, &y, sizeof(float));
+	memcpy(&key.z, &z, sizeof(float));
+
+	return key;
+}
+
+ColorAnimator::ColorAnimator()
+{
+	this->m_HasAvx2 = CpuSupportsAvx2();
+}
+
+ColorAnimator::~ColorAnimator()
+{
+}
+
+void ColorAnimator::Build(const void* vertices, size_t count, size_t stride, size_t positionOffset, size_t colorOffset) {
+	const char* bytes = static_cast<const char*>(vertices);
+
+	BuildGroups(vertices, count, stride, positionOffset);
+
+	this->m_Red.resize(count);
+	this->m_Green.resize(count);
+	this->m_Blue.resize(count);
+	this->m_TargetRed.resize(count);
+	this->m_TargetGreen.resize(count);
+	this->m_TargetBlue.resize(count);
+
+	for (size_t i = 0; i < count; i++) {
+		const float* color = reinterpret_cast<const float*>(bytes + i * stride + colorOffset);
+
+		this->m_Red[i] = color[0];
+		this->m_Green[i] = color[1];
+		this->m_Blue[i] = color[2];
+	}
+
+	// Every group starts out arrived so the first Retarget hands out targets
+	this->m_Arrived.assign((count + 7) / 8, 0xFF);
+	Retarget();
+}
+
+void ColorAnimator::BuildGroups(const void* vertices, size_t count, size_t stride, size_t positionOffset) {
+	const char* bytes = static_cast<const char*>(vertices);
+	std::unordered_map<PositionKey, uint32_t, PositionKeyHash> groupIndex;
+
+	this->m_Count = count;
+	this->m_VertexGroup.resize(count);
+	this->m_PosX.resize(count);
+	this->m_PosY.resize(count);
+	this->m_PosZ.resize(count);
+
+	groupIndex.reserve(count);
+
+	for (size_t i = 0; i < count; i++) {
+		const float* position = reinterpret_cast<const float*>(bytes + i * stride + positionOffset);
+
+		this->m_PosX[i] = position[0];
+		this->m_PosY[i] = position[1];
+		this->m_PosZ[i] = position[2];
+
+		auto inserted = groupIndex.emplace(MakeKey(position[0], position[1], position[2]), static_cast<uint32_t>(groupIndex.size()));
+		this->m_VertexGroup[i] = inserted.first->second;
+	}
+
+	// Counting sort of the vertices by group gives the compressed member lists
+	size_t groupCount = groupIndex.size();
+
+	this->m_GroupOffsets.assign(groupCount + 1, 0);
+	this->m_GroupMembers.resize(count);
+
+	for (size_t i = 0; i < count; i++) {
+		this->m_GroupOffsets[this->m_VertexGroup[i] + 1]++;
+	}
+
+	for (size_t g = 0; g < groupCount; g++) {
+		this->m_GroupOffsets[g + 1] += this->m_GroupOffsets[g];
+	}
+
+	std::vector<uint32_t> cursor(this->m_GroupOffsets.begin(), this->m_GroupOffsets.end() - 1);
+
+	for (size_t i = 0; i < count; i++) {
+		this->m_GroupMembers[cursor[this->m_VertexGroup[i]]++] = static_cast<uint32_t>(i);
+	}
+}
+
+const std::vector<uint32_t>& ColorAnimator::GetVertexGroups() {
+	return this->m_VertexGroup;
+}
+
+size_t ColorAnimator::GetGroupCount() {
+	return this->m_GroupOffsets.empty() ? 0 : this->m_GroupOffsets.size() - 1;
+}
+
+size_t ColorAnimator::GetVertexCount() {
+	return this->m_Count;
+}
+
+float ColorAnimator::RandomChannel() {
+	// xorshift32, targets are quantized to hundredths like the original animation
+	uint32_t x = this->m_RandomState;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	this->m_RandomState = x;
+
+	return static_cast<float>(x % 101) / 100.0f;
+}
+
+void ColorAnimator::Step() {
+	size_t vectorEnd = this->m_Count & ~size_t(7);
+
+#ifdef CPU_FEATURES_X86
+	if (this->m_HasAvx2) {
+		StepAvx2(0, vectorEnd);
+	}
+	else {
+		StepSse(0, vectorEnd);
+	}
+#else
+	vectorEnd = 0;
+#endif
+
+	StepScalar(vectorEnd, this->m_Count);
+	Retarget();
+}
+
+void ColorAnimator::StepScalar(size_t begin, size_t end) {
+	float* colors[3] = { this->m_Red.data(), this->m_Green.data(), this->m_Blue.data() };
+	const float* targets[3] = { this->m_TargetRed.data(), this->m_TargetGreen.data(), this->m_TargetBlue.data() };
+
+	for (size_t i = begin; i < end; i++) {
+		bool arrived = true;
+
+		for (int c = 0; c < 3; c++) {
+			float delta = targets[c][i] - colors[c][i];
+			float magnitude = delta < 0.0f ? -delta : delta;
+			bool distant = magnitude > SNAP_THRESHOLD;
+
+			colors[c][i] = distant ? colors[c][i] + (delta > 0.0f ? STEP : -STEP) : targets[c][i];
+			arrived = arrived && !distant;
+		}
+
+		uint8_t bit = static_cast<uint8_t>(1u << (i & 7));
+		this->m_Arrived[i >> 3] = arrived ? (this->m_Arrived[i >> 3] | bit) : (this->m_Arrived[i >> 3] & ~bit);
+	}
+}
+
+#ifdef CPU_FEATURES_X86
+void ColorAnimator::StepSse(size_t begin, size_t end) {
+	float* colors[3] = { this->m_Red.data(), this->m_Green.data(), this->m_Blue.data() };
+	const float* targets[3] = { this->m_TargetRed.data(), this->m_TargetGreen.data(), this->m_TargetBlue.data() };
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+	const __m128 step = _mm_set1_ps(STEP);
+	const __m128 threshold = _mm_set1_ps(SNAP_THRESHOLD);
+
+	// Two 4-wide halves per iteration so each iteration fills one byte of the arrived bits
+	for (size_t i = begin; i < end; i += 8) {
+		int farBits = 0;
+
+		for (size_t half = 0; half < 8; half += 4) {
+			__m128 anyFar = _mm_setzero_ps();
+
+			for (int c = 0; c < 3; c++) {
+				__m128 color = _mm_loadu_ps(colors[c] + i + half);
+				__m128 target = _mm_loadu_ps(targets[c] + i + half);
+				__m128 delta = _mm_sub_ps(target, color);
+				__m128 distant = _mm_cmpgt_ps(_mm_andnot_ps(signMask, delta), threshold);
+				__m128 stepped = _mm_add_ps(color, _mm_or_ps(_mm_and_ps(delta, signMask), step));
+
+				_mm_storeu_ps(colors[c] + i + half, _mm_or_ps(_mm_and_ps(distant, stepped), _mm_andnot_ps(distant, target)));
+				anyFar = _mm_or_ps(anyFar, distant);
+			}
+
+			farBits |= _mm_movemask_ps(anyFar) << half;
+		}
+
+		this->m_Arrived[i >> 3] = static_cast<uint8_t>(~farBits);
+	}
+}
+
+CPU_FEATURES_AVX2 void ColorAnimator::StepAvx2(size_t begin, size_t end) {
+	float* colors[3] = { this->m_Red.data(), this->m_Green.data(), this->m_Blue.data() };
+	const float* targets[3] = { this->m_TargetRed.data(), this->m_TargetGreen.data(), this->m_TargetBlue.data() };
+	const __m256 signMask = _mm256_set1_ps(-0.0f);
+	const __m256 step = _mm256_set1_ps(STEP);
+	const __m256 threshold = _mm256_set1_ps(SNAP_THRESHOLD);
+
+	for (size_t i = begin; i < end; i += 8) {
+		__m256 anyFar = _mm256_setzero_ps();
+
+		for (int c = 0; c < 3; c++) {
+			__m256 color = _mm256_loadu_ps(colors[c] + i);
+			__m256 target = _mm256_loadu_ps(targets[c] + i);
+			__m256 delta = _mm256_sub_ps(target, color);
+			__m256 distant = _mm256_cmp_ps(_mm256_andnot_ps(signMask, delta), threshold, _CMP_GT_OQ);
+			__m256 stepped = _mm256_add_ps(color, _mm256_or_ps(_mm256_and_ps(delta, signMask), step));
+
+			_mm256_storeu_ps(colors[c] + i, _mm256_blendv_ps(target, stepped, distant));
+			anyFar = _mm256_or_ps(anyFar, distant);
+		}
+
+		this->m_Arrived[i >> 3] = static_cast<uint8_t>(~_mm256_movemask_ps(anyFar));
+	}
+}
+#else
+void ColorAnimator::StepSse(size_t begin, size_t end) {
+	StepScalar(begin, end);
+}
+
+void ColorAnimator::StepAvx2(size_t begin, size_t end) {
+	StepScalar(begin, end);
+}
+#endif
+
+void ColorAnimator::Retarget() {
+	// Only vertices that arrived this step can complete a group, and most bytes of the bit set are zero
+	for (size_t byte = 0; byte < this->m_Arrived.size(); byte++) {
+		while (this->m_Arrived[byte] != 0) {
+			uint32_t bit = 0;
+
+			while (!((this->m_Arrived[byte] >> bit) & 1)) {
+				bit++;
+			}
+
+			size_t vertex = byte * 8 + bit;
+
+			if (vertex >= this->m_Count) {
+				this->m_Arrived[byte] &= static_cast<uint8_t>(~(1u << bit));
+				continue;
+			}
+
+			uint32_t group = this->m_VertexGroup[vertex];
+			uint32_t begin = this->m_GroupOffsets[group];
+			uint32_t end = this->m_GroupOffsets[group + 1];
+			bool arrived = true;
+
+			for (uint32_t m = begin; m < end && arrived; m++) {
+				uint32_t v = this->m_GroupMembers[m];
+				arrived = (this->m_Arrived[v >> 3] >> (v & 7)) & 1;
+			}
+
+			if (!arrived) {
+				// Waits at its target for the rest of the group, the next step sets the bit again
+				this->m_Arrived[byte] &= static_cast<uint8_t>(~(1u << bit));
+				continue;
+			}
+
+			float red = RandomChannel();
+			float green = RandomChannel();
+			float blue = RandomChannel();
+
+			// Clearing every member's bit keeps the group from being handed a second target this pass
+			for (uint32_t m = begin; m < end; m++) {
+				uint32_t v = this->m_GroupMembers[m];
+
+				this->m_TargetRed[v] = red;
+				this->m_TargetGreen[v] = green;
+				this->m_TargetBlue[v] = blue;
+				this->m_Arrived[v >> 3] &= static_cast<uint8_t>(~(1u << (v & 7)));
+			}
+		}
+	}
+}
+
+void ColorAnimator::WriteColors(void* vertices, size_t stride, size_t colorOffset) {
+	char* bytes = static_cast<char*>(vertices) + colorOffset;
+
+	for (size_t i = 0; i < this->m_Count; i++) {
+		float* color = reinterpret_cast<float*>(bytes + i * stride);
+
+		color[0] = this->m_Red[i];
+		color[1] = this->m_Green[i];
+		color[2] = this->m_Blue[i];
+	}
+}
+
+// RGBA8 unorm with opaque alpha, the same rounding as packUnorm4x8
+void ColorAnimator::WritePackedColors(void* vertices, size_t stride, size_t colorOffset) {
+	char* bytes = static_cast<char*>(vertices) + colorOffset;
+
+	for (size_t i = 0; i < this->m_Count; i++) {
+		uint32_t red = static_cast<uint32_t>(this->m_Red[i] * 255.0f + 0.5f);
+		uint32_t green = static_cast<uint32_t>(this->m_Green[i] * 255.0f + 0.5f);
+		uint32_t blue = static_cast<uint32_t>(this->m_Blue[i] * 255.0f + 0.5f);
+		uint32_t color = red | (green << 8) | (blue << 16) | (0xFFu << 24);
+
+		memcpy(bytes + i * stride, &color, sizeof(color));
+	}
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// Steps every vertex color toward a random target by a fixed amount per tick. Vertices that share a
+// position form a group that always shares a target, and the group picks a new one once every member
+// has arrived. State is kept as separate arrays per channel so the step kernel can run 8 (AVX2) or
+// 4 (SSE2) vertices at a time without branches; the group index is a hash of the position built once.
+class ColorAnimator
+{
+public:
+	ColorAnimator();
+	~ColorAnimator();
+
+	void Build(const void*, size_t, size_t, size_t, size_t);
+	void BuildGroups(const void*, size_t, size_t, size_t);
+	const std::vector<uint32_t>& GetVertexGroups();
+	size_t GetGroupCount();
+	void Step();
+	void WriteColors(void*, size_t, size_t);
+	void WritePackedColors(void*, size_t, size_t);
+	size_t GetVertexCount();
+
+private:
+	void StepScalar(size_t, size_t);
+	void StepSse(size_t, size_t);
+	void StepAvx2(size_t, size_t);
+	void Retarget();
+	float RandomChannel();
+
+	size_t m_Count = 0;
+	bool m_HasAvx2 = false;
+	uint32_t m_RandomState = 0x9E3779B9u;
+
+	std::vector<float> m_PosX;
+	std::vector<float> m_PosY;
+	std::vector<float> m_PosZ;
+	std::vector<float> m_Red;
+	std::vector<float> m_Green;
+	std::vector<float> m_Blue;
+	std::vector<float> m_TargetRed;
+	std::vector<float> m_TargetGreen;
+	std::vector<float> m_TargetBlue;
+
+	// One bit per vertex, set when all three channels sit on the target after a step
+	std::vector<uint8_t> m_Arrived;
+
+	// Groups in compressed form: the members of group g are m_GroupMembers[m_GroupOffsets[g] .. m_GroupOffsets[g + 1])
+	std::vector<uint32_t> m_GroupOffsets;
+	std::vector<uint32_t> m_GroupMembers;
+	std::vector<uint32_t> m_VertexGroup;
+};
@@ -0,0 +1,29 @@
+
+#include "CpuFeatures.h"
+
+bool CpuSupportsAvx2() {
+#if defined(CPU_FEATURES_X86) && defined(_MSC_VER)
+	int info[4];
+
+	__cpuid(info, 0);
+
+	if (info[0] < 7) {
+		return false;
+	}
+
+	__cpuid(info, 1);
+
+	// AVX needs both the CPU bit and the OS saving the upper halves of the registers
+	if (!(info[2] & (1 << 27)) || !(info[2] & (1 << 28)) || (_xgetbv(0) & 6) != 6) {
+		return false;
+	}
+
+	__cpuidex(info, 7, 0);
+
+	return (info[1] & (1 << 5)) != 0;
+#elif defined(CPU_FEATURES_X86)
+	return __builtin_cpu_supports("avx2");
+#else
+	return false;
+#endif
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CPU_FEATURES_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define CPU_FEATURES_AVX2
+#else
+#define CPU_FEATURES_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+// Runtime check for the AVX2 kernels, SSE2 is part of the x64 baseline and needs no check.
+// Functions using AVX2 intrinsics are marked CPU_FEATURES_AVX2 so GCC/Clang compile them for it.
+bool CpuSupportsAvx2();
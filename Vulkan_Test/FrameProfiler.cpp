@@ -0,0 +1,368 @@
+
+#include "FrameProfiler.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <fstream>
+#include <math.h>
+
+FrameProfiler::FrameProfiler()
+{
+}
+
+FrameProfiler::~FrameProfiler()
+{
+	this->Destroy();
+}
+
+bool FrameProfiler::Init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t graphicsFamily, uint32_t framesInFlight) {
+	VkPhysicalDeviceProperties properties;
+	uint32_t queueFamilyCount = 0;
+
+	this->m_Device = device;
+	this->m_QueriesPending.assign(framesInFlight, false);
+
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+	uint32_t validBits = queueFamilies[graphicsFamily].timestampValidBits;
+
+	if (validBits == 0) {
+		printf("Graphics queue does not support timestamps, GPU times will not be reported\n");
+		return true;
+	}
+
+	this->m_TimestampPeriod = properties.limits.timestampPeriod;
+	this->m_TimestampMask = validBits >= 64 ? ~0ull : ((1ull << validBits) - 1);
+
+	VkQueryPoolCreateInfo poolInfo = {};
+
+	poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	poolInfo.queryCount = framesInFlight * QueriesPerFrame;
+
+	return vkCreateQueryPool(this->m_Device, &poolInfo, nullptr, &this->m_QueryPool) == VK_SUCCESS;
+}
+
+void FrameProfiler::Destroy() {
+	if (this->m_QueryPool != VK_NULL_HANDLE) {
+		vkDestroyQueryPool(this->m_Device, this->m_QueryPool, nullptr);
+		this->m_QueryPool = VK_NULL_HANDLE;
+	}
+}
+
+void FrameProfiler::BeginFrame() {
+	auto now = std::chrono::high_resolution_clock::now();
+
+	if (this->m_HasLastFrame) {
+		this->m_FrameTimes.push_back(std::chrono::duration<float, std::milli>(now - this->m_LastFrameStart).count());
+	}
+
+	this->m_LastFrameStart = now;
+	this->m_HasLastFrame = true;
+	std::fill(std::begin(this->m_PhaseTime) + 1, std::end(this->m_PhaseTime), 0.0f);
+}
+
+// Returns true when a new GPU frame time was recorded
+bool FrameProfiler::CollectGpuTime(size_t frame) {
+	bool collected = false;
+
+	if (this->m_QueryPool == VK_NULL_HANDLE || !this->m_QueriesPending[frame]) {
+		return false;
+	}
+
+	// Only called once the frame's fence has signalled, so the results are available without waiting
+	uint64_t timestamps[QueriesPerFrame];
+
+	if (vkGetQueryPoolResults(this->m_Device, this->m_QueryPool, static_cast<uint32_t>(frame * QueriesPerFrame), QueriesPerFrame, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+		auto toMilliseconds = [this](uint64_t begin, uint64_t end) {
+			return static_cast<float>(((end - begin) & this->m_TimestampMask) * this->m_TimestampPeriod / 1000000.0);
+		};
+
+		this->m_GpuTimes.push_back(toMilliseconds(timestamps[0], timestamps[QueriesPerFrame - 1]));
+
+		for (uint32_t i = 0; i < static_cast<uint32_t>(GpuPass::Count); i++) {
+			this->m_GpuPassTimes[i].push_back(toMilliseconds(timestamps[i], timestamps[i + 1]));
+		}
+
+		collected = true;
+	}
+
+	this->m_QueriesPending[frame] = false;
+
+	return collected;
+}
+
+float FrameProfiler::GetLastGpuTime() {
+	return this->m_GpuTimes.empty() ? 0.0f : this->m_GpuTimes.back();
+}
+
+void FrameProfiler::EndFrame(size_t frame) {
+	// Animate runs before the frame starts, so it is the only phase carried over from the previous call
+	for (size_t i = 0; i < static_cast<size_t>(ProfilePhase::Count); i++) {
+		this->m_PhaseSamples[i].push_back(this->m_PhaseTime[i]);
+	}
+
+	this->m_PhaseTime[static_cast<size_t>(ProfilePhase::Animate)] = 0.0f;
+
+	for (size_t i = 0; i < static_cast<size_t>(ProfileCounter::Count); i++) {
+		this->m_CounterSamples[i].push_back(this->m_CounterValue[i]);
+	}
+
+	if (this->m_QueryPool != VK_NULL_HANDLE) {
+		this->m_QueriesPending[frame] = true;
+	}
+}
+
+void FrameProfiler::BeginPhase(ProfilePhase phase) {
+	this->m_PhaseStart[static_cast<size_t>(phase)] = std::chrono::high_resolution_clock::now();
+}
+
+void FrameProfiler::EndPhase(ProfilePhase phase) {
+	auto now = std::chrono::high_resolution_clock::now();
+	size_t index = static_cast<size_t>(phase);
+
+	this->m_PhaseTime[index] += std::chrono::duration<float, std::milli>(now - this->m_PhaseStart[index]).count();
+}
+
+void FrameProfiler::SetCounter(ProfileCounter counter, uint32_t value) {
+	this->m_CounterValue[static_cast<size_t>(counter)] = static_cast<float>(value);
+}
+
+void FrameProfiler::WriteBeginTimestamp(VkCommandBuffer commandBuffer, size_t frame) {
+	if (this->m_QueryPool == VK_NULL_HANDLE) {
+		return;
+	}
+
+	// The command buffer is replayed without re-recording, so it resets its own queries each submission
+	vkCmdResetQueryPool(commandBuffer, this->m_QueryPool, static_cast<uint32_t>(frame * QueriesPerFrame), QueriesPerFrame);
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, this->m_QueryPool, static_cast<uint32_t>(frame * QueriesPerFrame));
+	this->m_NextPassQuery = 1;
+}
+
+// Passes that were not recorded since the previous call get the same timestamp, so they report zero and every query is written
+void FrameProfiler::WritePassTimestamp(VkCommandBuffer commandBuffer, size_t frame, GpuPass pass) {
+	if (this->m_QueryPool == VK_NULL_HANDLE) {
+		return;
+	}
+
+	for (; this->m_NextPassQuery <= static_cast<uint32_t>(pass) + 1; this->m_NextPassQuery++) {
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, this->m_QueryPool, static_cast<uint32_t>(frame * QueriesPerFrame + this->m_NextPassQuery));
+	}
+}
+
+// Closes the frame's queries, the passes that were not recorded end here
+void FrameProfiler::WriteEndTimestamp(VkCommandBuffer commandBuffer, size_t frame) {
+	WritePassTimestamp(commandBuffer, frame, static_cast<GpuPass>(static_cast<uint32_t>(GpuPass::Count) - 1));
+}
+
+// Switching back to a mode that was measured before keeps adding to its samples
+void FrameProfiler::BeginPresentMode(const char* name) {
+	auto found = std::find_if(this->m_PresentModes.begin(), this->m_PresentModes.end(), [name](const PresentModeSamples& mode) { return mode.name == name; });
+
+	if (found == this->m_PresentModes.end()) {
+		PresentModeSamples mode;
+
+		mode.name = name;
+		found = this->m_PresentModes.insert(this->m_PresentModes.end(), mode);
+	}
+
+	this->m_CurrentPresentMode = static_cast<size_t>(found - this->m_PresentModes.begin());
+	// The swap chain recreate in between would otherwise show up as one long interval
+	this->m_HasLastPresent = false;
+}
+
+// Called once vkQueuePresentKHR has returned, the acquire phase start marks the beginning of the frame's latency
+void FrameProfiler::RecordPresent() {
+	if (this->m_PresentModes.empty()) {
+		return;
+	}
+
+	auto now = std::chrono::high_resolution_clock::now();
+	PresentModeSamples& mode = this->m_PresentModes[this->m_CurrentPresentMode];
+
+	mode.latencies.push_back(std::chrono::duration<float, std::milli>(now - this->m_PhaseStart[static_cast<size_t>(ProfilePhase::Acquire)]).count());
+
+	if (this->m_HasLastPresent) {
+		mode.intervals.push_back(std::chrono::duration<float, std::milli>(now - this->m_LastPresent).count());
+	}
+
+	this->m_LastPresent = now;
+	this->m_HasLastPresent = true;
+}
+
+const char* FrameProfiler::GetPhaseName(ProfilePhase phase) {
+	switch (phase) {
+	case ProfilePhase::Animate: return "animate";
+	case ProfilePhase::FenceWait: return "fence_wait";
+	case ProfilePhase::Acquire: return "acquire";
+	case ProfilePhase::Uniforms: return "uniforms";
+	case ProfilePhase::Cull: return "cull";
+	case ProfilePhase::Upload: return "upload";
+	case ProfilePhase::Record: return "record";
+	case ProfilePhase::Submit: return "submit";
+	case ProfilePhase::Present: return "present";
+	default: return "unknown";
+	}
+}
+
+const char* FrameProfiler::GetCounterName(ProfileCounter counter) {
+	switch (counter) {
+	case ProfileCounter::VisibleObjects: return "visible";
+	case ProfileCounter::CulledObjects: return "culled";
+	case ProfileCounter::RenderScale: return "render_scale_pct";
+	default: return "unknown";
+	}
+}
+
+const char* FrameProfiler::GetGpuPassName(GpuPass pass) {
+	switch (pass) {
+	case GpuPass::Animate: return "gpu_animate";
+	case GpuPass::DepthPrepass: return "gpu_prepass";
+	case GpuPass::Scene: return "gpu_scene";
+	case GpuPass::Upscale: return "gpu_upscale";
+	default: return "unknown";
+	}
+}
+
+FrameProfiler::Percentiles FrameProfiler::ComputePercentiles(std::vector<float> samples) {
+	Percentiles result;
+
+	if (samples.empty()) {
+		return result;
+	}
+
+	std::sort(samples.begin(), samples.end());
+
+	auto rank = [&samples](double percentile) {
+		size_t index = static_cast<size_t>(percentile * (samples.size() - 1) + 0.5);
+		return static_cast<double>(samples[index]);
+	};
+
+	double total = 0.0;
+
+	for (float sample : samples) {
+		total += sample;
+	}
+
+	result.count = samples.size();
+	result.p50 = rank(0.50);
+	result.p95 = rank(0.95);
+	result.p99 = rank(0.99);
+	result.max = samples.back();
+	result.mean = total / samples.size();
+
+	return result;
+}
+
+double FrameProfiler::ComputeStdDev(const std::vector<float>& samples) {
+	double mean = 0.0;
+	double variance = 0.0;
+
+	if (samples.size() < 2) {
+		return 0.0;
+	}
+
+	for (float sample : samples) {
+		mean += sample;
+	}
+
+	mean /= samples.size();
+
+	for (float sample : samples) {
+		variance += (sample - mean) * (sample - mean);
+	}
+
+	return sqrt(variance / (samples.size() - 1));
+}
+
+void FrameProfiler::PrintReport() {
+	auto printRow = [](const char* name, const Percentiles& p) {
+		printf("  %-12s %8zu %9.3f %9.3f %9.3f %9.3f %9.3f\n", name, p.count, p.mean, p.p50, p.p95, p.p99, p.max);
+	};
+
+	printf("Frame timings (ms)\n");
+	printf("  %-12s %8s %9s %9s %9s %9s %9s\n", "", "samples", "mean", "p50", "p95", "p99", "max");
+	printRow("frame", ComputePercentiles(this->m_FrameTimes));
+	printRow("gpu", ComputePercentiles(this->m_GpuTimes));
+
+	for (size_t i = 0; i < static_cast<size_t>(GpuPass::Count); i++) {
+		printRow(GetGpuPassName(static_cast<GpuPass>(i)), ComputePercentiles(this->m_GpuPassTimes[i]));
+	}
+
+	for (size_t i = 0; i < static_cast<size_t>(ProfilePhase::Count); i++) {
+		printRow(GetPhaseName(static_cast<ProfilePhase>(i)), ComputePercentiles(this->m_PhaseSamples[i]));
+	}
+
+	printf("Frame counters\n");
+
+	for (size_t i = 0; i < static_cast<size_t>(ProfileCounter::Count); i++) {
+		printRow(GetCounterName(static_cast<ProfileCounter>(i)), ComputePercentiles(this->m_CounterSamples[i]));
+	}
+
+	if (this->m_PresentModes.empty()) {
+		return;
+	}
+
+	// Jitter is the standard deviation of the present intervals
+	printf("Present modes (ms)\n");
+	printf("  %-12s %8s %9s %9s %9s %9s %9s\n", "", "samples", "latency", "lat_p99", "interval", "int_p99", "jitter");
+
+	for (const auto& mode : this->m_PresentModes) {
+		Percentiles latency = ComputePercentiles(mode.latencies);
+		Percentiles interval = ComputePercentiles(mode.intervals);
+
+		printf("  %-12s %8zu %9.3f %9.3f %9.3f %9.3f %9.3f\n", mode.name.c_str(), latency.count, latency.mean, latency.p99, interval.mean, interval.p99, ComputeStdDev(mode.intervals));
+	}
+}
+
+bool FrameProfiler::WriteJson(const std::string& path) {
+	std::ofstream file(path);
+
+	if (!file.is_open()) {
+		printf("Failed to open %s for writing\n", path.c_str());
+		return false;
+	}
+
+	auto writeEntry = [&file](const char* name, const Percentiles& p, bool last) {
+		file << "    \"" << name << "\": { \"samples\": " << p.count << ", \"mean\": " << p.mean << ", \"p50\": " << p.p50
+			<< ", \"p95\": " << p.p95 << ", \"p99\": " << p.p99 << ", \"max\": " << p.max << " }" << (last ? "\n" : ",\n");
+	};
+
+	file << "{\n  \"unit\": \"ms\",\n  \"timings\": {\n";
+	writeEntry("frame", ComputePercentiles(this->m_FrameTimes), false);
+	writeEntry("gpu", ComputePercentiles(this->m_GpuTimes), false);
+
+	for (size_t i = 0; i < static_cast<size_t>(GpuPass::Count); i++) {
+		writeEntry(GetGpuPassName(static_cast<GpuPass>(i)), ComputePercentiles(this->m_GpuPassTimes[i]), false);
+	}
+
+	for (size_t i = 0; i < static_cast<size_t>(ProfilePhase::Count); i++) {
+		writeEntry(GetPhaseName(static_cast<ProfilePhase>(i)), ComputePercentiles(this->m_PhaseSamples[i]), i + 1 == static_cast<size_t>(ProfilePhase::Count));
+	}
+
+	file << "  },\n  \"counters\": {\n";
+
+	for (size_t i = 0; i < static_cast<size_t>(ProfileCounter::Count); i++) {
+		writeEntry(GetCounterName(static_cast<ProfileCounter>(i)), ComputePercentiles(this->m_CounterSamples[i]), i + 1 == static_cast<size_t>(ProfileCounter::Count));
+	}
+
+	file << "  },\n  \"present_modes\": {\n";
+
+	for (size_t i = 0; i < this->m_PresentModes.size(); i++) {
+		const auto& mode = this->m_PresentModes[i];
+		Percentiles latency = ComputePercentiles(mode.latencies);
+		Percentiles interval = ComputePercentiles(mode.intervals);
+
+		file << "    \"" << mode.name << "\": { \"samples\": " << latency.count << ", \"latency_mean\": " << latency.mean << ", \"latency_p50\": " << latency.p50
+			<< ", \"latency_p99\": " << latency.p99 << ", \"interval_mean\": " << interval.mean << ", \"interval_p99\": " << interval.p99
+			<< ", \"jitter\": " << ComputeStdDev(mode.intervals) << " }" << (i + 1 == this->m_PresentModes.size() ? "\n" : ",\n");
+	}
+
+	file << "  }\n}\n";
+
+	return true;
+}
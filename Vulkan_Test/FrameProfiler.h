@@ -0,0 +1,111 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+enum class ProfilePhase : uint32_t {
+	Animate,
+	FenceWait,
+	Acquire,
+	Uniforms,
+	Cull,
+	Upload,
+	Record,
+	Submit,
+	Present,
+	Count
+};
+
+// Per-frame values that are reported alongside the timings
+enum class ProfileCounter : uint32_t {
+	VisibleObjects,
+	CulledObjects,
+	RenderScale,
+	Count
+};
+
+// GPU passes timed with a timestamp at their end, in the order they are recorded
+enum class GpuPass : uint32_t {
+	Animate,
+	DepthPrepass,
+	Scene,
+	Upscale,
+	Count
+};
+
+// Collects per-frame CPU phase timings, counters and the GPU time of the frame's command buffer. The GPU side
+// writes a timestamp at the start of the recorded command buffer and one after each GpuPass, per frame in
+// flight; they are read back once that frame's fence has signalled, so reading never stalls the queue.
+class FrameProfiler
+{
+public:
+	FrameProfiler();
+	~FrameProfiler();
+
+	bool Init(VkPhysicalDevice, VkDevice, uint32_t, uint32_t);
+	void Destroy();
+	void BeginFrame();
+	bool CollectGpuTime(size_t);
+	float GetLastGpuTime();
+	void EndFrame(size_t);
+	void BeginPhase(ProfilePhase);
+	void EndPhase(ProfilePhase);
+	void SetCounter(ProfileCounter, uint32_t);
+	void WriteBeginTimestamp(VkCommandBuffer, size_t);
+	void WritePassTimestamp(VkCommandBuffer, size_t, GpuPass);
+	void WriteEndTimestamp(VkCommandBuffer, size_t);
+	void BeginPresentMode(const char*);
+	void RecordPresent();
+	void PrintReport();
+	bool WriteJson(const std::string&);
+
+private:
+	struct Percentiles {
+		size_t count = 0;
+		double p50 = 0.0;
+		double p95 = 0.0;
+		double p99 = 0.0;
+		double max = 0.0;
+		double mean = 0.0;
+	};
+
+	// Latency runs from the start of the acquire to the return of the present, intervals are between consecutive presents
+	struct PresentModeSamples {
+		std::string name;
+		std::vector<float> latencies;
+		std::vector<float> intervals;
+	};
+
+	static Percentiles ComputePercentiles(std::vector<float>);
+	static double ComputeStdDev(const std::vector<float>&);
+	static const char* GetPhaseName(ProfilePhase);
+	static const char* GetCounterName(ProfileCounter);
+	static const char* GetGpuPassName(GpuPass);
+
+	static constexpr uint32_t QueriesPerFrame = static_cast<uint32_t>(GpuPass::Count) + 1;
+
+	VkDevice m_Device = VK_NULL_HANDLE;
+	VkQueryPool m_QueryPool = VK_NULL_HANDLE;
+	double m_TimestampPeriod = 0.0;
+	uint64_t m_TimestampMask = 0;
+	std::vector<bool> m_QueriesPending;
+	uint32_t m_NextPassQuery = 1;
+
+	std::chrono::high_resolution_clock::time_point m_PhaseStart[static_cast<size_t>(ProfilePhase::Count)];
+	float m_PhaseTime[static_cast<size_t>(ProfilePhase::Count)] = {};
+	std::chrono::high_resolution_clock::time_point m_LastFrameStart;
+	bool m_HasLastFrame = false;
+
+	std::vector<float> m_FrameTimes;
+	std::vector<float> m_GpuTimes;
+	std::vector<float> m_GpuPassTimes[static_cast<size_t>(GpuPass::Count)];
+	std::vector<float> m_PhaseSamples[static_cast<size_t>(ProfilePhase::Count)];
+	float m_CounterValue[static_cast<size_t>(ProfileCounter::Count)] = {};
+	std::vector<float> m_CounterSamples[static_cast<size_t>(ProfileCounter::Count)];
+	std::vector<PresentModeSamples> m_PresentModes;
+	size_t m_CurrentPresentMode = 0;
+	std::chrono::high_resolution_clock::time_point m_LastPresent;
+	bool m_HasLastPresent = false;
+};
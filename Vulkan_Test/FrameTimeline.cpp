@@ -0,0 +1,213 @@
+#include "FrameTimeline.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <limits>
+
+FrameTimeline::FrameTimeline()
+{
+}
+
+FrameTimeline::~FrameTimeline()
+{
+	this->Destroy();
+}
+
+bool FrameTimeline::Init(VkDevice device, uint32_t framesInFlight, bool timelineSemaphore) {
+	this->m_Device = device;
+	this->m_SlotValues.assign(framesInFlight, 0);
+	this->m_NextValue = 1;
+	this->m_CompletedValue = 0;
+
+#ifdef VK_KHR_timeline_semaphore
+	if (timelineSemaphore) {
+		VkSemaphoreTypeCreateInfoKHR typeInfo = {};
+		VkSemaphoreCreateInfo semaphoreInfo = {};
+
+		typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+		typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+		typeInfo.initialValue = 0;
+
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		semaphoreInfo.pNext = &typeInfo;
+
+		this->m_WaitSemaphores = (PFN_vkWaitSemaphoresKHR)vkGetDeviceProcAddr(device, "vkWaitSemaphoresKHR");
+		this->m_GetSemaphoreCounterValue = (PFN_vkGetSemaphoreCounterValueKHR)vkGetDeviceProcAddr(device, "vkGetSemaphoreCounterValueKHR");
+
+		if (this->m_WaitSemaphores != nullptr && this->m_GetSemaphoreCounterValue != nullptr) {
+			return vkCreateSemaphore(device, &semaphoreInfo, nullptr, &this->m_Timeline) == VK_SUCCESS;
+		}
+	}
+#endif
+
+	printf("Timeline semaphores are not available, frames are tracked with fences\n");
+
+	this->m_Fences.resize(framesInFlight, VK_NULL_HANDLE);
+
+	for (auto& fence : this->m_Fences) {
+		if (!CreateSignaledFence(fence)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// An idle slot's fence stays signaled, so a slot whose submit failed looks the same as one never used
+bool FrameTimeline::CreateSignaledFence(VkFence& fence) {
+	VkFenceCreateInfo fenceInfo = {};
+
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+	return vkCreateFence(this->m_Device, &fenceInfo, nullptr, &fence) == VK_SUCCESS;
+}
+
+void FrameTimeline::Destroy() {
+	if (this->m_Timeline != VK_NULL_HANDLE) {
+		vkDestroySemaphore(this->m_Device, this->m_Timeline, nullptr);
+		this->m_Timeline = VK_NULL_HANDLE;
+	}
+
+	for (auto fence : this->m_Fences) {
+		vkDestroyFence(this->m_Device, fence, nullptr);
+	}
+
+	this->m_Fences.clear();
+}
+
+// Blocks until the frame that last used the slot has finished, so its per-frame resources can be rewritten
+void FrameTimeline::WaitForSlot(size_t slot) {
+	Wait(this->m_SlotValues[slot]);
+}
+
+// Adds the frame's signal to the submission, the caller's binary semaphores keep working alongside it.
+// The slot only takes the new value once the submit succeeded, a failed frame leaves nothing to wait on.
+VkResult FrameTimeline::Submit(VkQueue queue, VkSubmitInfo& submitInfo, size_t slot) {
+	uint64_t value = this->m_NextValue;
+	VkResult result;
+
+	if (this->m_Timeline == VK_NULL_HANDLE) {
+		vkResetFences(this->m_Device, 1, &this->m_Fences[slot]);
+
+		result = vkQueueSubmit(queue, 1, &submitInfo, this->m_Fences[slot]);
+
+		if (result != VK_SUCCESS) {
+			// The fence was never handed to the queue, a new signaled one puts the slot back to idle
+			vkDestroyFence(this->m_Device, this->m_Fences[slot], nullptr);
+			this->m_Fences[slot] = VK_NULL_HANDLE;
+
+			if (!CreateSignaledFence(this->m_Fences[slot])) {
+				result = VK_ERROR_OUT_OF_HOST_MEMORY;
+			}
+
+			return result;
+		}
+
+		this->m_SlotValues[slot] = value;
+		this->m_NextValue++;
+
+		return result;
+	}
+
+#ifdef VK_KHR_timeline_semaphore
+	VkTimelineSemaphoreSubmitInfoKHR timelineInfo = {};
+
+	// Values for binary semaphores are ignored, they only keep the arrays the same length as the semaphore lists
+	this->m_SignalSemaphores.assign(submitInfo.pSignalSemaphores, submitInfo.pSignalSemaphores + submitInfo.signalSemaphoreCount);
+	this->m_SignalSemaphores.push_back(this->m_Timeline);
+	this->m_SignalValues.assign(submitInfo.signalSemaphoreCount, 0);
+	this->m_SignalValues.push_back(value);
+	this->m_WaitValues.assign(submitInfo.waitSemaphoreCount, 0);
+
+	timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+	timelineInfo.pNext = submitInfo.pNext;
+	timelineInfo.waitSemaphoreValueCount = static_cast<uint32_t>(this->m_WaitValues.size());
+	timelineInfo.pWaitSemaphoreValues = this->m_WaitValues.data();
+	timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(this->m_SignalValues.size());
+	timelineInfo.pSignalSemaphoreValues = this->m_SignalValues.data();
+
+	VkSubmitInfo timelineSubmit = submitInfo;
+
+	timelineSubmit.pNext = &timelineInfo;
+	timelineSubmit.signalSemaphoreCount = static_cast<uint32_t>(this->m_SignalSemaphores.size());
+	timelineSubmit.pSignalSemaphores = this->m_SignalSemaphores.data();
+
+	result = vkQueueSubmit(queue, 1, &timelineSubmit, VK_NULL_HANDLE);
+
+	if (result == VK_SUCCESS) {
+		this->m_SlotValues[slot] = value;
+		this->m_NextValue++;
+	}
+#else
+	result = VK_ERROR_FEATURE_NOT_PRESENT;
+#endif
+
+	return result;
+}
+
+bool FrameTimeline::IsComplete(uint64_t value) {
+	return value <= GetCompletedValue();
+}
+
+void FrameTimeline::Wait(uint64_t value) {
+	if (value <= this->m_CompletedValue) {
+		return;
+	}
+
+	if (this->m_Timeline == VK_NULL_HANDLE) {
+		// A slot's fence belongs to the value stored for it, so every slot at or below the value has to signal
+		for (size_t i = 0; i < this->m_Fences.size(); i++) {
+			if (this->m_SlotValues[i] > this->m_CompletedValue && this->m_SlotValues[i] <= value) {
+				vkWaitForFences(this->m_Device, 1, &this->m_Fences[i], VK_TRUE, std::numeric_limits<uint64_t>::max());
+			}
+		}
+
+		this->m_CompletedValue = value;
+		return;
+	}
+
+#ifdef VK_KHR_timeline_semaphore
+	VkSemaphoreWaitInfoKHR waitInfo = {};
+
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &this->m_Timeline;
+	waitInfo.pValues = &value;
+
+	if (this->m_WaitSemaphores(this->m_Device, &waitInfo, std::numeric_limits<uint64_t>::max()) == VK_SUCCESS) {
+		this->m_CompletedValue = value;
+	}
+#endif
+}
+
+// The value the most recent frame signals when it finishes, resources used by it are free once this completes
+uint64_t FrameTimeline::GetSubmittedValue() {
+	return this->m_NextValue - 1;
+}
+
+uint64_t FrameTimeline::GetCompletedValue() {
+	if (this->m_Timeline == VK_NULL_HANDLE) {
+		for (size_t i = 0; i < this->m_Fences.size(); i++) {
+			if (this->m_SlotValues[i] > this->m_CompletedValue && vkGetFenceStatus(this->m_Device, this->m_Fences[i]) == VK_SUCCESS) {
+				this->m_CompletedValue = this->m_SlotValues[i];
+			}
+		}
+
+		return this->m_CompletedValue;
+	}
+
+#ifdef VK_KHR_timeline_semaphore
+	uint64_t value = 0;
+
+	if (this->m_GetSemaphoreCounterValue(this->m_Device, this->m_Timeline, &value) == VK_SUCCESS) {
+		this->m_CompletedValue = std::max(this->m_CompletedValue, value);
+	}
+#endif
+
+	return this->m_CompletedValue;
+}
+
+bool FrameTimeline::UsesTimelineSemaphore() {
+	return this->m_Timeline != VK_NULL_HANDLE;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+// Tracks frame submissions as increasing values, the same way UploadManager hands out tickets. With
+// VK_KHR_timeline_semaphore every frame signals one timeline semaphore with its value, so waiting for a
+// frame slot, polling progress and tagging resources with the frame that last used them all read the
+// same counter. The project builds against SDK 1.2.131.2, whose headers declare the extension, so a fence
+// per frame slot only stands in when the device does not support it or headers older than 1.1.130 are used.
+class FrameTimeline
+{
+public:
+	FrameTimeline();
+	~FrameTimeline();
+
+	bool Init(VkDevice, uint32_t, bool);
+	void Destroy();
+	void WaitForSlot(size_t);
+	VkResult Submit(VkQueue, VkSubmitInfo&, size_t);
+	bool IsComplete(uint64_t);
+	void Wait(uint64_t);
+	uint64_t GetSubmittedValue();
+	uint64_t GetCompletedValue();
+	bool UsesTimelineSemaphore();
+
+private:
+	bool CreateSignaledFence(VkFence&);
+
+	VkDevice m_Device = VK_NULL_HANDLE;
+	VkSemaphore m_Timeline = VK_NULL_HANDLE;
+#ifdef VK_KHR_timeline_semaphore
+	PFN_vkWaitSemaphoresKHR m_WaitSemaphores = nullptr;
+	PFN_vkGetSemaphoreCounterValueKHR m_GetSemaphoreCounterValue = nullptr;
+#endif
+	std::vector<VkFence> m_Fences;
+	// Value of the last frame submitted from each slot, 0 while the slot is unused
+	std::vector<uint64_t> m_SlotValues;
+	uint64_t m_NextValue = 1;
+	uint64_t m_CompletedValue = 0;
+
+	std::vector<VkSemaphore> m_SignalSemaphores;
+	std::vector<uint64_t> m_SignalValues;
+	std::vector<uint64_t> m_WaitValues;
+};
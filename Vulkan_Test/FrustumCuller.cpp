@@ -0,0 +1,177 @@
+
+#include "FrustumCuller.h"
+
+#include <math.h>
+
+#include "CpuFeatures.h"
+
+FrustumCuller::FrustumCuller()
+{
+	this->m_HasAvx2 = CpuSupportsAvx2();
+}
+
+FrustumCuller::~FrustumCuller()
+{
+}
+
+void FrustumCuller::Resize(size_t count) {
+	this->m_Count = count;
+	this->m_CenterX.resize(count);
+	this->m_CenterY.resize(count);
+	this->m_CenterZ.resize(count);
+	this->m_Radius.resize(count);
+}
+
+void FrustumCuller::SetSphere(size_t index, const glm::vec3& center, float radius) {
+	this->m_CenterX[index] = center.x;
+	this->m_CenterY[index] = center.y;
+	this->m_CenterZ[index] = center.z;
+	this->m_Radius[index] = radius;
+}
+
+// visible is resized to the object count and holds the visible indices in ascending order on return
+size_t FrustumCuller::Cull(const glm::mat4& clip, std::vector<uint32_t>& visible) {
+	size_t vectorEnd = this->m_Count & ~size_t(7);
+	size_t visibleCount = 0;
+
+	ExtractPlanes(clip);
+	visible.resize(this->m_Count);
+
+#ifdef CPU_FEATURES_X86
+	if (this->m_HasAvx2) {
+		visibleCount = CullAvx2(0, vectorEnd, visible.data());
+	}
+	else {
+		visibleCount = CullSse(0, vectorEnd, visible.data());
+	}
+#else
+	vectorEnd = 0;
+#endif
+
+	visibleCount += CullScalar(vectorEnd, this->m_Count, visible.data() + visibleCount);
+
+	return visibleCount;
+}
+
+size_t FrustumCuller::GetObjectCount() {
+	return this->m_Count;
+}
+
+void FrustumCuller::ExtractPlanes(const glm::mat4& clip) {
+	// Rows of the matrix, glm stores columns
+	glm::vec4 rows[4];
+
+	for (int i = 0; i < 4; i++) {
+		rows[i] = glm::vec4(clip[0][i], clip[1][i], clip[2][i], clip[3][i]);
+	}
+
+	// -w <= x <= w, -w <= y <= w and 0 <= z <= w
+	glm::vec4 planes[6] = { rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1], rows[3] - rows[1], rows[2], rows[3] - rows[2] };
+
+	for (int i = 0; i < 6; i++) {
+		float length = sqrtf(planes[i].x * planes[i].x + planes[i].y * planes[i].y + planes[i].z * planes[i].z);
+		float scale = length > 0.0f ? 1.0f / length : 0.0f;
+
+		for (int c = 0; c < 4; c++) {
+			this->m_Planes[i][c] = planes[i][c] * scale;
+		}
+	}
+}
+
+size_t FrustumCuller::CullScalar(size_t begin, size_t end, uint32_t* visible) {
+	size_t visibleCount = 0;
+
+	for (size_t i = begin; i < end; i++) {
+		bool inside = true;
+
+		for (int p = 0; p < 6; p++) {
+			const float* plane = this->m_Planes[p];
+			float distance = plane[0] * this->m_CenterX[i] + plane[1] * this->m_CenterY[i] + plane[2] * this->m_CenterZ[i] + plane[3];
+
+			inside = inside && distance >= -this->m_Radius[i];
+		}
+
+		// Written unconditionally and only kept by advancing the count, so there is no branch on the result
+		visible[visibleCount] = static_cast<uint32_t>(i);
+		visibleCount += inside ? 1 : 0;
+	}
+
+	return visibleCount;
+}
+
+#ifdef CPU_FEATURES_X86
+size_t FrustumCuller::CullSse(size_t begin, size_t end, uint32_t* visible) {
+	size_t visibleCount = 0;
+
+	for (size_t i = begin; i < end; i += 4) {
+		__m128 x = _mm_loadu_ps(this->m_CenterX.data() + i);
+		__m128 y = _mm_loadu_ps(this->m_CenterY.data() + i);
+		__m128 z = _mm_loadu_ps(this->m_CenterZ.data() + i);
+		__m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(this->m_Radius.data() + i));
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+		for (int p = 0; p < 6; p++) {
+			const float* plane = this->m_Planes[p];
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane[0])), _mm_mul_ps(y, _mm_set1_ps(plane[1]))),
+				_mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane[2])), _mm_set1_ps(plane[3])));
+
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+		}
+
+		int mask = _mm_movemask_ps(inside);
+
+		// Most blocks are either entirely in or entirely out once the scene is large
+		if (mask == 0) {
+			continue;
+		}
+
+		for (int lane = 0; lane < 4; lane++) {
+			visible[visibleCount] = static_cast<uint32_t>(i + lane);
+			visibleCount += (mask >> lane) & 1;
+		}
+	}
+
+	return visibleCount;
+}
+
+CPU_FEATURES_AVX2 size_t FrustumCuller::CullAvx2(size_t begin, size_t end, uint32_t* visible) {
+	size_t visibleCount = 0;
+
+	for (size_t i = begin; i < end; i += 8) {
+		__m256 x = _mm256_loadu_ps(this->m_CenterX.data() + i);
+		__m256 y = _mm256_loadu_ps(this->m_CenterY.data() + i);
+		__m256 z = _mm256_loadu_ps(this->m_CenterZ.data() + i);
+		__m256 negativeRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(this->m_Radius.data() + i));
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+		for (int p = 0; p < 6; p++) {
+			const float* plane = this->m_Planes[p];
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(plane[0])), _mm256_mul_ps(y, _mm256_set1_ps(plane[1]))),
+				_mm256_add_ps(_mm256_mul_ps(z, _mm256_set1_ps(plane[2])), _mm256_set1_ps(plane[3])));
+
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negativeRadius, _CMP_GE_OQ));
+		}
+
+		int mask = _mm256_movemask_ps(inside);
+
+		if (mask == 0) {
+			continue;
+		}
+
+		for (int lane = 0; lane < 8; lane++) {
+			visible[visibleCount] = static_cast<uint32_t>(i + lane);
+			visibleCount += (mask >> lane) & 1;
+		}
+	}
+
+	return visibleCount;
+}
+#else
+size_t FrustumCuller::CullSse(size_t begin, size_t end, uint32_t* visible) {
+	return CullScalar(begin, end, visible);
+}
+
+size_t FrustumCuller::CullAvx2(size_t begin, size_t end, uint32_t* visible) {
+	return CullScalar(begin, end, visible);
+}
+#endif
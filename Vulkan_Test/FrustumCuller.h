@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Tests object bounding spheres against the six planes of a clip matrix (Vulkan's 0..1 depth range).
+// Centers and radii are kept as separate arrays so the test runs 8 (AVX2) or 4 (SSE2) spheres per
+// iteration, and the indices of the spheres that touch the frustum are written as a compact list.
+class FrustumCuller
+{
+public:
+	FrustumCuller();
+	~FrustumCuller();
+
+	void Resize(size_t);
+	void SetSphere(size_t, const glm::vec3&, float);
+	size_t Cull(const glm::mat4&, std::vector<uint32_t>&);
+	size_t GetObjectCount();
+
+private:
+	void ExtractPlanes(const glm::mat4&);
+	size_t CullScalar(size_t, size_t, uint32_t*);
+	size_t CullSse(size_t, size_t, uint32_t*);
+	size_t CullAvx2(size_t, size_t, uint32_t*);
+
+	size_t m_Count = 0;
+	bool m_HasAvx2 = false;
+
+	// Normalized planes as (a, b, c, d) with the inside where a*x + b*y + c*z + d >= 0
+	float m_Planes[6][4] = {};
+
+	std::vector<float> m_CenterX;
+	std::vector<float> m_CenterY;
+	std::vector<float> m_CenterZ;
+	std::vector<float> m_Radius;
+};
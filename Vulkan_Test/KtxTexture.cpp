@@ -0,0 +1,276 @@
+
+#include "KtxTexture.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <fstream>
+#include <algorithm>
+
+static const uint8_t KTX2_IDENTIFIER[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+
+// Identifier, nine header words and the dfd/kvd/sgd index, the level index follows directly
+static const size_t KTX2_LEVEL_INDEX_OFFSET = 80;
+static const size_t KTX2_LEVEL_ENTRY_SIZE = 24;
+
+// The sgd fields sit at a 4 byte aligned offset in the file, so the header is packed to match
+#pragma pack(push, 4)
+struct Ktx2Header {
+	uint32_t vkFormat;
+	uint32_t typeSize;
+	uint32_t pixelWidth;
+	uint32_t pixelHeight;
+	uint32_t pixelDepth;
+	uint32_t layerCount;
+	uint32_t faceCount;
+	uint32_t levelCount;
+	uint32_t supercompressionScheme;
+	uint32_t dfdByteOffset;
+	uint32_t dfdByteLength;
+	uint32_t kvdByteOffset;
+	uint32_t kvdByteLength;
+	uint64_t sgdByteOffset;
+	uint64_t sgdByteLength;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(Ktx2Header) == KTX2_LEVEL_INDEX_OFFSET - 12, "KTX2 header layout mismatch");
+
+struct Ktx2LevelEntry {
+	uint64_t byteOffset;
+	uint64_t byteLength;
+	uint64_t uncompressedByteLength;
+};
+
+// Reads the texel block size and bytes per block from the basic descriptor block, which every KTX2 file carries
+static bool ReadBlockLayout(const std::vector<uint8_t>& contents, const Ktx2Header& header, uint32_t& blockWidth, uint32_t& blockHeight, uint32_t& blockBytes) {
+	// Total size word, then the descriptor's vendor/type, version/size and model words before the block dimensions
+	const size_t dimensionOffset = 16;
+	const size_t bytesPlaneOffset = 20;
+
+	if (header.dfdByteOffset > contents.size() || header.dfdByteLength > contents.size() - header.dfdByteOffset || header.dfdByteLength < bytesPlaneOffset + 4) {
+		return false;
+	}
+
+	const uint8_t* dfd = contents.data() + header.dfdByteOffset;
+
+	blockWidth = dfd[dimensionOffset] + 1u;
+	blockHeight = dfd[dimensionOffset + 1] + 1u;
+	blockBytes = dfd[bytesPlaneOffset];
+
+	return blockBytes != 0;
+}
+
+static void AppendWord(std::vector<uint8_t>& data, uint32_t value) {
+	data.insert(data.end(), reinterpret_cast<const uint8_t*>(&value), reinterpret_cast<const uint8_t*>(&value) + sizeof(value));
+}
+
+// Basic data format descriptor block for BC1 (one color sample) or BC3 (alpha sample then color sample)
+static std::vector<uint8_t> BuildDataFormatDescriptor(BlockFormat format) {
+	std::vector<uint8_t> dfd;
+	uint32_t sampleCount = format == BlockFormat::BC1 ? 1 : 2;
+	uint32_t blockSize = 24 + 16 * sampleCount;
+	uint32_t colorModel = format == BlockFormat::BC1 ? 128 : 130;
+	uint32_t bytesPlane0 = static_cast<uint32_t>(BlockCompressor::GetBlockBytes(format));
+
+	AppendWord(dfd, 4 + blockSize);
+	AppendWord(dfd, 0);
+	AppendWord(dfd, 2 | (blockSize << 16));
+	AppendWord(dfd, colorModel | (1 << 8) | (1 << 16));
+	AppendWord(dfd, 3 | (3 << 8));
+	AppendWord(dfd, bytesPlane0);
+	AppendWord(dfd, 0);
+
+	for (uint32_t i = 0; i < sampleCount; i++) {
+		bool alpha = format == BlockFormat::BC3 && i == 0;
+		uint32_t bitOffset = format == BlockFormat::BC3 && i == 1 ? 64 : 0;
+		uint32_t channel = alpha ? 15 : 0;
+
+		AppendWord(dfd, bitOffset | (63 << 16) | (channel << 24));
+		AppendWord(dfd, 0);
+		AppendWord(dfd, 0);
+		AppendWord(dfd, UINT32_MAX);
+	}
+
+	return dfd;
+}
+
+KtxTexture::KtxTexture()
+{
+}
+
+KtxTexture::~KtxTexture()
+{
+}
+
+bool KtxTexture::Load(const std::string& path) {
+	std::ifstream file(path, std::ios::ate | std::ios::binary);
+
+	if (!file.is_open()) {
+		printf("Failed to open %s\n", path.c_str());
+		return false;
+	}
+
+	size_t fileSize = (size_t)file.tellg();
+	std::vector<uint8_t> contents(fileSize);
+
+	file.seekg(0);
+	file.read(reinterpret_cast<char*>(contents.data()), fileSize);
+
+	if (!file || fileSize < KTX2_LEVEL_INDEX_OFFSET || memcmp(contents.data(), KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0) {
+		printf("%s is not a KTX2 file\n", path.c_str());
+		return false;
+	}
+
+	Ktx2Header header;
+	memcpy(&header, contents.data() + sizeof(KTX2_IDENTIFIER), sizeof(header));
+
+	if (header.supercompressionScheme != 0) {
+		printf("%s uses supercompression scheme %u, only plain block data is supported\n", path.c_str(), header.supercompressionScheme);
+		return false;
+	}
+
+	if (header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != 1 || header.pixelWidth == 0 || header.pixelHeight == 0) {
+		printf("%s is not a single 2D image\n", path.c_str());
+		return false;
+	}
+
+	// A level count of zero asks the loader to generate mips, which block formats cannot get without a decode
+	if (header.levelCount == 0) {
+		printf("%s asks for generated mips, convert it with its full mip chain\n", path.c_str());
+		return false;
+	}
+
+	uint32_t levelCount = header.levelCount;
+	uint32_t blockWidth;
+	uint32_t blockHeight;
+	uint32_t blockBytes;
+
+	if (!ReadBlockLayout(contents, header, blockWidth, blockHeight, blockBytes)) {
+		printf("%s has no usable data format descriptor\n", path.c_str());
+		return false;
+	}
+
+	if (KTX2_LEVEL_INDEX_OFFSET + levelCount * KTX2_LEVEL_ENTRY_SIZE > fileSize) {
+		printf("%s has a truncated level index\n", path.c_str());
+		return false;
+	}
+
+	this->m_Format = static_cast<VkFormat>(header.vkFormat);
+	this->m_Width = header.pixelWidth;
+	this->m_Height = header.pixelHeight;
+	this->m_Levels.resize(levelCount);
+
+	size_t totalSize = 0;
+
+	for (uint32_t i = 0; i < levelCount; i++) {
+		Ktx2LevelEntry entry;
+		memcpy(&entry, contents.data() + KTX2_LEVEL_INDEX_OFFSET + i * KTX2_LEVEL_ENTRY_SIZE, sizeof(entry));
+
+		if (entry.byteOffset > fileSize || entry.byteLength > fileSize - entry.byteOffset) {
+			printf("%s level %u lies outside the file\n", path.c_str(), i);
+			return false;
+		}
+
+		MipLevel& level = this->m_Levels[i];
+
+		level.width = std::max(header.pixelWidth >> i, 1u);
+		level.height = std::max(header.pixelHeight >> i, 1u);
+
+		// The upload copies whole blocks for the level's extent, a shorter level would be read past its end
+		uint64_t expectedSize = static_cast<uint64_t>((level.width + blockWidth - 1) / blockWidth) * ((level.height + blockHeight - 1) / blockHeight) * blockBytes;
+
+		if (entry.byteLength < expectedSize) {
+			printf("%s level %u holds %llu bytes, its extent needs %llu\n", path.c_str(), i, (unsigned long long)entry.byteLength, (unsigned long long)expectedSize);
+			return false;
+		}
+
+		level.offset = totalSize;
+		level.size = static_cast<size_t>(entry.byteLength);
+		totalSize += level.size;
+	}
+
+	// Levels are stored smallest first in the file, they are repacked largest first to match MipChain
+	this->m_Data.resize(totalSize);
+
+	for (uint32_t i = 0; i < levelCount; i++) {
+		Ktx2LevelEntry entry;
+		memcpy(&entry, contents.data() + KTX2_LEVEL_INDEX_OFFSET + i * KTX2_LEVEL_ENTRY_SIZE, sizeof(entry));
+
+		memcpy(this->m_Data.data() + this->m_Levels[i].offset, contents.data() + entry.byteOffset, this->m_Levels[i].size);
+	}
+
+	return true;
+}
+
+bool KtxTexture::Write(const std::string& path, BlockFormat format, const std::vector<MipLevel>& levels, const std::vector<uint8_t>& data) {
+	std::vector<uint8_t> dfd = BuildDataFormatDescriptor(format);
+	std::vector<Ktx2LevelEntry> levelIndex(levels.size());
+	Ktx2Header header = {};
+
+	header.vkFormat = static_cast<uint32_t>(GetVulkanFormat(format));
+	header.typeSize = 1;
+	header.pixelWidth = levels[0].width;
+	header.pixelHeight = levels[0].height;
+	header.faceCount = 1;
+	header.levelCount = static_cast<uint32_t>(levels.size());
+	header.dfdByteOffset = static_cast<uint32_t>(KTX2_LEVEL_INDEX_OFFSET + levels.size() * KTX2_LEVEL_ENTRY_SIZE);
+	header.dfdByteLength = static_cast<uint32_t>(dfd.size());
+
+	// Level data starts after the descriptor, smallest level first, each aligned to the block size
+	size_t alignment = BlockCompressor::GetBlockBytes(format);
+	size_t offset = header.dfdByteOffset + dfd.size();
+
+	for (size_t i = levels.size(); i-- > 0;) {
+		offset = (offset + alignment - 1) / alignment * alignment;
+		levelIndex[i].byteOffset = offset;
+		levelIndex[i].byteLength = levels[i].size;
+		levelIndex[i].uncompressedByteLength = levels[i].size;
+		offset += levels[i].size;
+	}
+
+	std::vector<uint8_t> contents(offset, 0);
+
+	memcpy(contents.data(), KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+	memcpy(contents.data() + sizeof(KTX2_IDENTIFIER), &header, sizeof(header));
+	memcpy(contents.data() + KTX2_LEVEL_INDEX_OFFSET, levelIndex.data(), levelIndex.size() * KTX2_LEVEL_ENTRY_SIZE);
+	memcpy(contents.data() + header.dfdByteOffset, dfd.data(), dfd.size());
+
+	for (size_t i = 0; i < levels.size(); i++) {
+		memcpy(contents.data() + levelIndex[i].byteOffset, data.data() + levels[i].offset, levels[i].size);
+	}
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+
+	if (!file.is_open()) {
+		printf("Failed to open %s for writing\n", path.c_str());
+		return false;
+	}
+
+	file.write(reinterpret_cast<const char*>(contents.data()), contents.size());
+
+	return static_cast<bool>(file);
+}
+
+VkFormat KtxTexture::GetVulkanFormat(BlockFormat format) {
+	return format == BlockFormat::BC1 ? VK_FORMAT_BC1_RGB_UNORM_BLOCK : VK_FORMAT_BC3_UNORM_BLOCK;
+}
+
+VkFormat KtxTexture::GetFormat() {
+	return this->m_Format;
+}
+
+uint32_t KtxTexture::GetWidth() {
+	return this->m_Width;
+}
+
+uint32_t KtxTexture::GetHeight() {
+	return this->m_Height;
+}
+
+const std::vector<MipLevel>& KtxTexture::GetLevels() {
+	return this->m_Levels;
+}
+
+const std::vector<uint8_t>& KtxTexture::GetData() {
+	return this->m_Data;
+}
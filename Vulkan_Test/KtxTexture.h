@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <string>
+#include <vector>
+
+#include "MipChain.h"
+#include "BlockCompressor.h"
+
+// Reads and writes KTX2 containers. Loading keeps the texel data exactly as stored, so any format
+// the device can sample (BC, ETC2, ASTC, ...) is uploaded without a decode step; supercompressed
+// files (Basis, zstd) are rejected. Writing is used by the offline converter and covers the block
+// formats BlockCompressor produces.
+class KtxTexture
+{
+public:
+	KtxTexture();
+	~KtxTexture();
+
+	bool Load(const std::string&);
+	static bool Write(const std::string&, BlockFormat, const std::vector<MipLevel>&, const std::vector<uint8_t>&);
+	static VkFormat GetVulkanFormat(BlockFormat);
+
+	VkFormat GetFormat();
+	uint32_t GetWidth();
+	uint32_t GetHeight();
+	const std::vector<MipLevel>& GetLevels();
+	const std::vector<uint8_t>& GetData();
+
+private:
+	VkFormat m_Format = VK_FORMAT_UNDEFINED;
+	uint32_t m_Width = 0;
+	uint32_t m_Height = 0;
+	std::vector<MipLevel> m_Levels;
+	std::vector<uint8_t> m_Data;
+};
@@ -0,0 +1,569 @@
+
+#include "MemoryAllocator.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static uint32_t BitScanReverse64(uint64_t value) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse64(&index, value);
+	return index;
+#else
+	return 63 - __builtin_clzll(value);
+#endif
+}
+
+static uint32_t BitScanForward64(uint64_t value) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward64(&index, value);
+	return index;
+#else
+	return __builtin_ctzll(value);
+#endif
+}
+
+static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment) {
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+class MemoryBlock
+{
+public:
+	static constexpr uint32_t SL_LOG2 = 4;
+	static constexpr uint32_t SL_COUNT = 1 << SL_LOG2;
+	static constexpr uint32_t FL_COUNT = 64;
+	static constexpr uint32_t NONE = UINT32_MAX;
+	static constexpr VkDeviceSize MIN_ALIGNMENT = 256;
+
+	MemoryBlock(VkDeviceMemory memory, VkDeviceSize size, void* mapped) {
+		this->m_Memory = memory;
+		this->m_Size = size;
+		this->m_Mapped = mapped;
+
+		for (uint32_t fl = 0; fl < FL_COUNT; fl++) {
+			for (uint32_t sl = 0; sl < SL_COUNT; sl++) {
+				this->m_FreeHeads[fl][sl] = NONE;
+			}
+		}
+
+		uint32_t whole = NewChunk();
+		this->m_Chunks[whole].offset = 0;
+		this->m_Chunks[whole].size = size;
+		InsertFree(whole);
+	}
+
+	bool Allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset, uint32_t& chunkIndex) {
+		size = AlignUp(std::max<VkDeviceSize>(size, 1), MIN_ALIGNMENT);
+		alignment = std::max(alignment, MIN_ALIGNMENT);
+
+		// Every chunk offset is a multiple of MIN_ALIGNMENT, so this much slack always covers the padding
+		VkDeviceSize searchSize = size + alignment - MIN_ALIGNMENT;
+		uint32_t index = FindSuitable(searchSize);
+
+		if (index == NONE) {
+			return false;
+		}
+
+		RemoveFree(index);
+
+		VkDeviceSize alignedOffset = AlignUp(this->m_Chunks[index].offset, alignment);
+		VkDeviceSize padding = alignedOffset - this->m_Chunks[index].offset;
+
+		if (padding > 0) {
+			uint32_t front = NewChunk();
+			Chunk& chunk = this->m_Chunks[index];
+
+			this->m_Chunks[front].offset = chunk.offset;
+			this->m_Chunks[front].size = padding;
+			this->m_Chunks[front].prevPhys = chunk.prevPhys;
+			this->m_Chunks[front].nextPhys = index;
+
+			if (chunk.prevPhys != NONE) {
+				this->m_Chunks[chunk.prevPhys].nextPhys = front;
+			}
+
+			chunk.prevPhys = front;
+			chunk.offset = alignedOffset;
+			chunk.size -= padding;
+			InsertFree(front);
+		}
+
+		if (this->m_Chunks[index].size - size >= MIN_ALIGNMENT) {
+			uint32_t back = NewChunk();
+			Chunk& chunk = this->m_Chunks[index];
+
+			this->m_Chunks[back].offset = chunk.offset + size;
+			this->m_Chunks[back].size = chunk.size - size;
+			this->m_Chunks[back].prevPhys = index;
+			this->m_Chunks[back].nextPhys = chunk.nextPhys;
+
+			if (chunk.nextPhys != NONE) {
+				this->m_Chunks[chunk.nextPhys].prevPhys = back;
+			}
+
+			chunk.nextPhys = back;
+			chunk.size = size;
+			InsertFree(back);
+		}
+
+		Chunk& chunk = this->m_Chunks[index];
+		chunk.free = false;
+		this->m_Used += chunk.size;
+		this->m_AllocationCount++;
+
+		offset = chunk.offset;
+		chunkIndex = index;
+
+		return true;
+	}
+
+	void Free(uint32_t index) {
+		this->m_Chunks[index].free = true;
+		this->m_Used -= this->m_Chunks[index].size;
+		this->m_AllocationCount--;
+
+		uint32_t next = this->m_Chunks[index].nextPhys;
+
+		if (next != NONE && this->m_Chunks[next].free) {
+			RemoveFree(next);
+			Absorb(index, next);
+		}
+
+		uint32_t prev = this->m_Chunks[index].prevPhys;
+
+		if (prev != NONE && this->m_Chunks[prev].free) {
+			RemoveFree(prev);
+			Absorb(prev, index);
+			index = prev;
+		}
+
+		InsertFree(index);
+	}
+
+	VkDeviceMemory GetMemory() const { return this->m_Memory; }
+	VkDeviceSize GetSize() const { return this->m_Size; }
+	VkDeviceSize GetUsed() const { return this->m_Used; }
+	void* GetMapped() const { return this->m_Mapped; }
+	size_t GetAllocationCount() const { return this->m_AllocationCount; }
+
+private:
+	struct Chunk {
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		uint32_t prevPhys = NONE;
+		uint32_t nextPhys = NONE;
+		uint32_t prevFree = NONE;
+		uint32_t nextFree = NONE;
+		bool free = true;
+	};
+
+	static void Mapping(VkDeviceSize size, uint32_t& fl, uint32_t& sl) {
+		fl = BitScanReverse64(size);
+		sl = static_cast<uint32_t>(size >> (fl - SL_LOG2)) - SL_COUNT;
+	}
+
+	uint32_t FindSuitable(VkDeviceSize size) {
+		uint32_t fl;
+		uint32_t sl;
+
+		// Round up to the next list boundary so any chunk found is guaranteed to be big enough
+		size += (VkDeviceSize(1) << (BitScanReverse64(size) - SL_LOG2)) - 1;
+		Mapping(size, fl, sl);
+
+		uint32_t slMap = this->m_SlBitmap[fl] & (~0u << sl);
+
+		if (slMap == 0) {
+			uint64_t flMap = fl + 1 < FL_COUNT ? this->m_FlBitmap & (~0ull << (fl + 1)) : 0;
+
+			if (flMap == 0) {
+				return NONE;
+			}
+
+			fl = BitScanForward64(flMap);
+			slMap = this->m_SlBitmap[fl];
+		}
+
+		sl = BitScanForward64(slMap);
+
+		return this->m_FreeHeads[fl][sl];
+	}
+
+	void InsertFree(uint32_t index) {
+		uint32_t fl;
+		uint32_t sl;
+		Chunk& chunk = this->m_Chunks[index];
+
+		Mapping(chunk.size, fl, sl);
+		chunk.free = true;
+		chunk.prevFree = NONE;
+		chunk.nextFree = this->m_FreeHeads[fl][sl];
+
+		if (chunk.nextFree != NONE) {
+			this->m_Chunks[chunk.nextFree].prevFree = index;
+		}
+
+		this->m_FreeHeads[fl][sl] = index;
+		this->m_FlBitmap |= 1ull << fl;
+		this->m_SlBitmap[fl] |= 1u << sl;
+	}
+
+	void RemoveFree(uint32_t index) {
+		uint32_t fl;
+		uint32_t sl;
+		Chunk& chunk = this->m_Chunks[index];
+
+		Mapping(chunk.size, fl, sl);
+
+		if (chunk.prevFree != NONE) {
+			this->m_Chunks[chunk.prevFree].nextFree = chunk.nextFree;
+		}
+		else {
+			this->m_FreeHeads[fl][sl] = chunk.nextFree;
+		}
+
+		if (chunk.nextFree != NONE) {
+			this->m_Chunks[chunk.nextFree].prevFree = chunk.prevFree;
+		}
+
+		if (this->m_FreeHeads[fl][sl] == NONE) {
+			this->m_SlBitmap[fl] &= ~(1u << sl);
+
+			if (this->m_SlBitmap[fl] == 0) {
+				this->m_FlBitmap &= ~(1ull << fl);
+			}
+		}
+
+		chunk.prevFree = NONE;
+		chunk.nextFree = NONE;
+	}
+
+	// Merges the physically following chunk into the first one and recycles its node
+	void Absorb(uint32_t first, uint32_t second) {
+		Chunk& a = this->m_Chunks[first];
+		Chunk& b = this->m_Chunks[second];
+
+		a.size += b.size;
+		a.nextPhys = b.nextPhys;
+
+		if (b.nextPhys != NONE) {
+			this->m_Chunks[b.nextPhys].prevPhys = first;
+		}
+
+		this->m_UnusedChunks.push_back(second);
+	}
+
+	uint32_t NewChunk() {
+		if (!this->m_UnusedChunks.empty()) {
+			uint32_t index = this->m_UnusedChunks.back();
+			this->m_UnusedChunks.pop_back();
+			this->m_Chunks[index] = Chunk();
+			return index;
+		}
+
+		this->m_Chunks.emplace_back();
+		return static_cast<uint32_t>(this->m_Chunks.size() - 1);
+	}
+
+	VkDeviceMemory m_Memory;
+	VkDeviceSize m_Size;
+	VkDeviceSize m_Used = 0;
+	void* m_Mapped;
+	size_t m_AllocationCount = 0;
+	std::vector<Chunk> m_Chunks;
+	std::vector<uint32_t> m_UnusedChunks;
+	uint64_t m_FlBitmap = 0;
+	uint32_t m_SlBitmap[FL_COUNT] = {};
+	uint32_t m_FreeHeads[FL_COUNT][SL_COUNT];
+};
+
+MemoryAllocator::MemoryAllocator()
+{
+}
+
+MemoryAllocator::~MemoryAllocator()
+{
+	this->Destroy();
+}
+
+void MemoryAllocator::Init(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize blockSize) {
+	this->m_PhysicalDevice = physicalDevice;
+	this->m_Device = device;
+	this->m_BlockSize = blockSize;
+
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &this->m_MemoryProperties);
+
+	// Two pools per memory type: index * 2 for optimal images, index * 2 + 1 for buffers and linear images
+	this->m_Pools.resize(this->m_MemoryProperties.memoryTypeCount * 2);
+
+	for (uint32_t i = 0; i < this->m_MemoryProperties.memoryTypeCount; i++) {
+		VkDeviceSize heapSize = this->m_MemoryProperties.memoryHeaps[this->m_MemoryProperties.memoryTypes[i].heapIndex].size;
+		VkDeviceSize poolBlockSize = blockSize;
+
+		// Small heaps (e.g. the 256MB device local + host visible window) get proportionally smaller blocks
+		while (poolBlockSize > MemoryBlock::MIN_ALIGNMENT * 1024 && poolBlockSize > heapSize / 8) {
+			poolBlockSize /= 2;
+		}
+
+		for (uint32_t linear = 0; linear < 2; linear++) {
+			Pool& pool = this->m_Pools[i * 2 + linear];
+
+			pool.memoryType = i;
+			pool.linear = linear != 0;
+			pool.blockSize = poolBlockSize;
+			pool.stats.memoryType = i;
+			pool.stats.linear = pool.linear;
+			pool.stats.blockSize = poolBlockSize;
+		}
+	}
+}
+
+void MemoryAllocator::Destroy() {
+	if (this->m_Device == VK_NULL_HANDLE) {
+		return;
+	}
+
+	for (auto& pool : this->m_Pools) {
+		if (pool.stats.allocationCount > 0) {
+			printf("Memory type %u still has %zu live allocations at shutdown\n", pool.memoryType, pool.stats.allocationCount);
+		}
+
+		for (auto& block : pool.blocks) {
+			FreeDeviceMemory(pool, block->GetMemory());
+		}
+
+		pool.blocks.clear();
+	}
+
+	this->m_Pools.clear();
+	this->m_Device = VK_NULL_HANDLE;
+}
+
+MemoryAllocator::Pool& MemoryAllocator::GetPool(uint32_t memoryType, bool linear) {
+	return this->m_Pools[memoryType * 2 + (linear ? 1 : 0)];
+}
+
+bool MemoryAllocator::AllocateDeviceMemory(Pool& pool, VkDeviceSize size, VkDeviceMemory& memory, void*& mapped) {
+	VkMemoryAllocateInfo allocInfo = {};
+
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = size;
+	allocInfo.memoryTypeIndex = pool.memoryType;
+
+	if (vkAllocateMemory(this->m_Device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+		return false;
+	}
+
+	mapped = nullptr;
+
+	if (this->m_MemoryProperties.memoryTypes[pool.memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+		if (vkMapMemory(this->m_Device, memory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS) {
+			vkFreeMemory(this->m_Device, memory, nullptr);
+			return false;
+		}
+	}
+
+	pool.stats.driverAllocations++;
+
+	return true;
+}
+
+void MemoryAllocator::FreeDeviceMemory(Pool& pool, VkDeviceMemory memory) {
+	vkFreeMemory(this->m_Device, memory, nullptr);
+	pool.stats.driverFrees++;
+}
+
+bool MemoryAllocator::Allocate(const VkMemoryRequirements& requirements, uint32_t memoryType, bool linear, bool dedicated, Allocation& allocation) {
+	std::lock_guard<std::mutex> lock(this->m_Mutex);
+	Pool& pool = GetPool(memoryType, linear);
+
+	allocation = Allocation();
+	allocation.memoryType = memoryType;
+	allocation.pool = memoryType * 2 + (linear ? 1 : 0);
+	allocation.size = requirements.size;
+
+	if (dedicated || requirements.size > pool.blockSize / 2) {
+		if (!AllocateDeviceMemory(pool, requirements.size, allocation.memory, allocation.mapped)) {
+			return false;
+		}
+
+		allocation.dedicated = true;
+		pool.stats.dedicatedCount++;
+		pool.stats.dedicatedBytes += requirements.size;
+
+		return true;
+	}
+
+	for (auto& block : pool.blocks) {
+		if (block->GetSize() - block->GetUsed() < requirements.size) {
+			continue;
+		}
+
+		if (block->Allocate(requirements.size, requirements.alignment, allocation.offset, allocation.chunk)) {
+			allocation.block = block.get();
+			break;
+		}
+	}
+
+	if (allocation.block == nullptr) {
+		VkDeviceMemory memory;
+		void* mapped;
+
+		if (!AllocateDeviceMemory(pool, pool.blockSize, memory, mapped)) {
+			return false;
+		}
+
+		pool.blocks.push_back(std::make_unique<MemoryBlock>(memory, pool.blockSize, mapped));
+		pool.stats.blockCount++;
+		pool.stats.reservedBytes += pool.blockSize;
+
+		MemoryBlock* block = pool.blocks.back().get();
+
+		if (!block->Allocate(requirements.size, requirements.alignment, allocation.offset, allocation.chunk)) {
+			return false;
+		}
+
+		allocation.block = block;
+	}
+
+	allocation.memory = allocation.block->GetMemory();
+
+	if (allocation.block->GetMapped() != nullptr) {
+		allocation.mapped = static_cast<char*>(allocation.block->GetMapped()) + allocation.offset;
+	}
+
+	pool.stats.allocationCount++;
+	pool.stats.usedBytes += requirements.size;
+
+	return true;
+}
+
+void MemoryAllocator::Free(Allocation& allocation) {
+	if (allocation.memory == VK_NULL_HANDLE) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(this->m_Mutex);
+
+	if (allocation.dedicated) {
+		Pool& pool = this->m_Pools[allocation.pool];
+
+		pool.stats.dedicatedCount--;
+		pool.stats.dedicatedBytes -= allocation.size;
+		FreeDeviceMemory(pool, allocation.memory);
+	}
+	else {
+		MemoryBlock* block = allocation.block;
+		Pool& pool = this->m_Pools[allocation.pool];
+
+		block->Free(allocation.chunk);
+		pool.stats.allocationCount--;
+		pool.stats.usedBytes -= allocation.size;
+
+		// Keep one empty block around so alloc/free patterns at a block boundary don't hit the driver
+		if (block->GetAllocationCount() == 0) {
+			size_t emptyBlocks = 0;
+
+			for (auto& other : pool.blocks) {
+				if (other->GetAllocationCount() == 0) {
+					emptyBlocks++;
+				}
+			}
+
+			if (emptyBlocks > 1) {
+				auto it = std::find_if(pool.blocks.begin(), pool.blocks.end(), [block](const std::unique_ptr<MemoryBlock>& b) { return b.get() == block; });
+
+				FreeDeviceMemory(pool, block->GetMemory());
+				pool.stats.blockCount--;
+				pool.stats.reservedBytes -= block->GetSize();
+				pool.blocks.erase(it);
+			}
+		}
+	}
+
+	allocation = Allocation();
+}
+
+std::vector<PoolStatistics> MemoryAllocator::GetStatistics() {
+	std::lock_guard<std::mutex> lock(this->m_Mutex);
+	std::vector<PoolStatistics> stats;
+
+	for (const auto& pool : this->m_Pools) {
+		if (pool.stats.driverAllocations > 0) {
+			stats.push_back(pool.stats);
+		}
+	}
+
+	return stats;
+}
+
+void MemoryAllocator::PrintStatistics() {
+	printf("Memory Pools\n");
+	printf("------------\n");
+
+	for (const auto& stats : GetStatistics()) {
+		printf("type %u %s: %zu blocks (%llu KB reserved, %llu KB used), %zu allocations, %zu dedicated (%llu KB), %llu driver allocations, %llu driver frees\n",
+			stats.memoryType,
+			stats.linear ? "linear" : "optimal",
+			stats.blockCount,
+			(unsigned long long)(stats.reservedBytes / 1024),
+			(unsigned long long)(stats.usedBytes / 1024),
+			stats.allocationCount,
+			stats.dedicatedCount,
+			(unsigned long long)(stats.dedicatedBytes / 1024),
+			(unsigned long long)stats.driverAllocations,
+			(unsigned long long)stats.driverFrees);
+	}
+
+	printf("\n");
+}
+
+// Shared device queries, every subsystem that creates its own buffers and images goes through these
+uint32_t MemoryAllocator::FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
+	for (uint32_t i = 0; i < this->m_MemoryProperties.memoryTypeCount; i++) {
+		if (typeFilter & (1 << i) && (this->m_MemoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+			return i;
+		}
+	}
+
+	throw std::runtime_error("Failed to find suitable memory type!");
+}
+
+bool MemoryAllocator::IsFormatSupported(VkFormat format, VkImageTiling tiling, VkFormatFeatureFlags features) {
+	VkFormatProperties props;
+	vkGetPhysicalDeviceFormatProperties(this->m_PhysicalDevice, format, &props);
+
+	if (tiling == VK_IMAGE_TILING_LINEAR) {
+		return (props.linearTilingFeatures & features) == features;
+	}
+
+	return (props.optimalTilingFeatures & features) == features;
+}
+
+VkImageView MemoryAllocator::CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels) {
+	VkImageViewCreateInfo viewInfo = {};
+
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = image;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = format;
+	viewInfo.subresourceRange.aspectMask = aspectFlags;
+	viewInfo.subresourceRange.baseMipLevel = 0;
+	viewInfo.subresourceRange.levelCount = mipLevels;
+	viewInfo.subresourceRange.baseArrayLayer = 0;
+	viewInfo.subresourceRange.layerCount = 1;
+
+	VkImageView imageView;
+
+	if (vkCreateImageView(this->m_Device, &viewInfo, nullptr, &imageView) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to Create Texture Image View!");
+	}
+
+	return imageView;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <memory>
+#include <mutex>
+
+class MemoryBlock;
+
+struct Allocation {
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+	void* mapped = nullptr;
+	uint32_t memoryType = 0;
+	uint32_t pool = 0;
+	bool dedicated = false;
+	MemoryBlock* block = nullptr;
+	uint32_t chunk = 0;
+};
+
+struct PoolStatistics {
+	uint32_t memoryType = 0;
+	bool linear = false;
+	VkDeviceSize blockSize = 0;
+	size_t blockCount = 0;
+	size_t allocationCount = 0;
+	VkDeviceSize reservedBytes = 0;
+	VkDeviceSize usedBytes = 0;
+	size_t dedicatedCount = 0;
+	VkDeviceSize dedicatedBytes = 0;
+	uint64_t driverAllocations = 0;
+	uint64_t driverFrees = 0;
+};
+
+// Sub-allocates buffers and images out of large VkDeviceMemory blocks. There is one pool per memory
+// type and resource kind (linear buffers / optimal images, which keeps bufferImageGranularity out of
+// the picture), and each block hands out ranges with a two level segregated fit (TLSF) free list.
+class MemoryAllocator
+{
+public:
+	static constexpr VkDeviceSize DefaultBlockSize = 64ull * 1024 * 1024;
+	static constexpr VkDeviceSize DedicatedImageThreshold = 16ull * 1024 * 1024;
+
+	MemoryAllocator();
+	~MemoryAllocator();
+
+	void Init(VkPhysicalDevice, VkDevice, VkDeviceSize blockSize = DefaultBlockSize);
+	void Destroy();
+	bool Allocate(const VkMemoryRequirements&, uint32_t, bool, bool, Allocation&);
+	void Free(Allocation&);
+	std::vector<PoolStatistics> GetStatistics();
+	void PrintStatistics();
+	uint32_t FindMemoryType(uint32_t, VkMemoryPropertyFlags);
+	bool IsFormatSupported(VkFormat, VkImageTiling, VkFormatFeatureFlags);
+	VkImageView CreateImageView(VkImage, VkFormat, VkImageAspectFlags, uint32_t);
+
+private:
+	struct Pool {
+		uint32_t memoryType = 0;
+		bool linear = false;
+		VkDeviceSize blockSize = 0;
+		std::vector<std::unique_ptr<MemoryBlock>> blocks;
+		PoolStatistics stats;
+	};
+
+	bool AllocateDeviceMemory(Pool&, VkDeviceSize, VkDeviceMemory&, void*&);
+	void FreeDeviceMemory(Pool&, VkDeviceMemory);
+	Pool& GetPool(uint32_t, bool);
+
+	VkPhysicalDevice m_PhysicalDevice = VK_NULL_HANDLE;
+	VkDevice m_Device = VK_NULL_HANDLE;
+	VkPhysicalDeviceMemoryProperties m_MemoryProperties = {};
+	VkDeviceSize m_BlockSize = DefaultBlockSize;
+	std::vector<Pool> m_Pools;
+	std::mutex m_Mutex;
+};
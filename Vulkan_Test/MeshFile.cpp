@@ -0,0 +1,457 @@
+
+#include "MeshFile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+static const uint8_t MESH_IDENTIFIER[8] = { 'V', 'T', 'M', 'E', 'S', 'H', 0x0D, 0x0A };
+static const uint32_t MESH_VERSION = 2;
+static const uint64_t MESH_SECTION_ALIGNMENT = 16;
+
+// Vertices are encoded through this much scratch at a time, so writing never holds a second copy of the stream
+static const size_t MESH_WRITE_BATCH = 64 * 1024;
+
+struct MeshFileHeader {
+	uint8_t identifier[8];
+	uint32_t version;
+	uint32_t vertexFormat;
+	uint32_t vertexStride;
+	uint32_t indexSize;
+	uint32_t submeshCount;
+	uint32_t reserved;
+	uint64_t vertexCount;
+	uint64_t indexCount;
+	uint64_t submeshOffset;
+	uint64_t vertexOffset;
+	uint64_t indexOffset;
+	float boundingSphere[4];
+};
+
+static_assert(sizeof(MeshFileHeader) == 88, "Mesh header layout mismatch");
+static_assert(sizeof(MeshSubmesh) == 16, "Mesh submesh layout mismatch");
+
+static uint64_t AlignSection(uint64_t offset) {
+	return (offset + MESH_SECTION_ALIGNMENT - 1) & ~(MESH_SECTION_ALIGNMENT - 1);
+}
+
+// True when [offset, offset + count * elementSize) lies inside a file of fileSize bytes, without overflowing
+static bool SectionFits(uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t fileSize) {
+	return offset <= fileSize && (elementSize == 0 || count <= (fileSize - offset) / elementSize);
+}
+
+// True when every index the submesh draws lands inside the vertex stream once vertexOffset is added
+static bool SubmeshIndicesFit(const uint8_t* indexData, uint32_t indexSize, const MeshSubmesh& submesh, uint64_t vertexCount) {
+	uint32_t lowest = UINT32_MAX;
+	uint32_t highest = 0;
+
+	if (submesh.indexCount == 0) {
+		return true;
+	}
+
+	for (uint64_t i = submesh.firstIndex; i < static_cast<uint64_t>(submesh.firstIndex) + submesh.indexCount; i++) {
+		uint32_t index = 0;
+
+		memcpy(&index, indexData + i * indexSize, indexSize);
+		lowest = std::min(lowest, index);
+		highest = std::max(highest, index);
+	}
+
+	return static_cast<int64_t>(lowest) + submesh.vertexOffset >= 0 && static_cast<int64_t>(highest) + submesh.vertexOffset < static_cast<int64_t>(vertexCount);
+}
+
+// OBJ indices are 1 based and negative values count back from the end of the list read so far
+static int64_t ResolveObjIndex(long index, size_t count) {
+	return index < 0 ? static_cast<int64_t>(count) + index : static_cast<int64_t>(index) - 1;
+}
+
+MeshFile::MeshFile()
+{
+}
+
+MeshFile::~MeshFile()
+{
+	Close();
+}
+
+bool MeshFile::Open(const std::string& path) {
+	Close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	LARGE_INTEGER fileSize;
+
+	if (file == INVALID_HANDLE_VALUE) {
+		printf("Failed to open %s\n", path.c_str());
+		return false;
+	}
+
+	this->m_File = file;
+
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart < static_cast<LONGLONG>(sizeof(MeshFileHeader))) {
+		printf("%s is not a mesh file\n", path.c_str());
+		Close();
+		return false;
+	}
+
+	this->m_Mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	this->m_Data = this->m_Mapping ? static_cast<const uint8_t*>(MapViewOfFile(this->m_Mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+	this->m_Size = static_cast<size_t>(fileSize.QuadPart);
+#else
+	struct stat fileInfo;
+
+	this->m_File = open(path.c_str(), O_RDONLY);
+
+	if (this->m_File < 0) {
+		printf("Failed to open %s\n", path.c_str());
+		return false;
+	}
+
+	if (fstat(this->m_File, &fileInfo) != 0 || fileInfo.st_size < static_cast<off_t>(sizeof(MeshFileHeader))) {
+		printf("%s is not a mesh file\n", path.c_str());
+		Close();
+		return false;
+	}
+
+	void* mapping = mmap(nullptr, static_cast<size_t>(fileInfo.st_size), PROT_READ, MAP_PRIVATE, this->m_File, 0);
+
+	this->m_Data = mapping == MAP_FAILED ? nullptr : static_cast<const uint8_t*>(mapping);
+	this->m_Size = static_cast<size_t>(fileInfo.st_size);
+
+	// The streams are read front to back exactly once, so ask for aggressive read-ahead
+	if (this->m_Data) {
+		madvise(mapping, this->m_Size, MADV_SEQUENTIAL);
+		madvise(mapping, this->m_Size, MADV_WILLNEED);
+	}
+#endif
+
+	if (!this->m_Data) {
+		printf("Failed to map %s\n", path.c_str());
+		Close();
+		return false;
+	}
+
+	MeshFileHeader header;
+	memcpy(&header, this->m_Data, sizeof(header));
+
+	if (memcmp(header.identifier, MESH_IDENTIFIER, sizeof(MESH_IDENTIFIER)) != 0 || header.version != MESH_VERSION) {
+		printf("%s is not a version %u mesh file\n", path.c_str(), MESH_VERSION);
+		Close();
+		return false;
+	}
+
+	VertexFormat format = static_cast<VertexFormat>(header.vertexFormat);
+
+	if ((format != VertexFormat::Float && format != VertexFormat::Packed) || header.vertexStride != Vertex::GetStride(format) || (header.indexSize != 2 && header.indexSize != 4)) {
+		printf("%s uses an unknown vertex or index layout\n", path.c_str());
+		Close();
+		return false;
+	}
+
+	if (!SectionFits(header.submeshOffset, header.submeshCount, sizeof(MeshSubmesh), this->m_Size) ||
+		!SectionFits(header.vertexOffset, header.vertexCount, header.vertexStride, this->m_Size) ||
+		!SectionFits(header.indexOffset, header.indexCount, header.indexSize, this->m_Size)) {
+		printf("%s is truncated\n", path.c_str());
+		Close();
+		return false;
+	}
+
+	this->m_Submeshes.resize(header.submeshCount);
+	memcpy(this->m_Submeshes.data(), this->m_Data + header.submeshOffset, sizeof(MeshSubmesh) * header.submeshCount);
+
+	for (const MeshSubmesh& submesh : this->m_Submeshes) {
+		if (static_cast<uint64_t>(submesh.firstIndex) + submesh.indexCount > header.indexCount) {
+			printf("%s has a submesh outside the index stream\n", path.c_str());
+			Close();
+			return false;
+		}
+
+		// Checked once here, an index past the vertex stream would otherwise be fetched by the GPU every frame
+		if (!SubmeshIndicesFit(this->m_Data + header.indexOffset, header.indexSize, submesh, header.vertexCount)) {
+			printf("%s has indices outside the vertex stream\n", path.c_str());
+			Close();
+			return false;
+		}
+	}
+
+	this->m_VertexFormat = format;
+	this->m_VertexCount = header.vertexCount;
+	this->m_VertexOffset = header.vertexOffset;
+	this->m_IndexSize = header.indexSize;
+	this->m_IndexCount = header.indexCount;
+	this->m_IndexOffset = header.indexOffset;
+	this->m_BoundingSphere = glm::vec4(header.boundingSphere[0], header.boundingSphere[1], header.boundingSphere[2], header.boundingSphere[3]);
+
+	return true;
+}
+
+void MeshFile::Close() {
+#ifdef _WIN32
+	if (this->m_Data) {
+		UnmapViewOfFile(this->m_Data);
+	}
+
+	if (this->m_Mapping) {
+		CloseHandle(this->m_Mapping);
+	}
+
+	if (this->m_File) {
+		CloseHandle(this->m_File);
+	}
+
+	this->m_Mapping = nullptr;
+	this->m_File = nullptr;
+#else
+	if (this->m_Data) {
+		munmap(const_cast<uint8_t*>(this->m_Data), this->m_Size);
+	}
+
+	if (this->m_File >= 0) {
+		close(this->m_File);
+	}
+
+	this->m_File = -1;
+#endif
+
+	this->m_Data = nullptr;
+	this->m_Size = 0;
+	this->m_VertexCount = 0;
+	this->m_IndexCount = 0;
+	this->m_Submeshes.clear();
+}
+
+bool MeshFile::IsOpen() {
+	return this->m_Data != nullptr;
+}
+
+// Reads positions, optional per-vertex colors (the common "v x y z r g b" extension) and texture
+// coordinates. Faces are fan triangulated and every o/g/usemtl statement starts a new submesh.
+// Normals are skipped since the renderer has no lighting.
+bool MeshFile::ImportObj(const std::string& path, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, std::vector<MeshSubmesh>& submeshes) {
+	std::ifstream file(path);
+
+	if (!file.is_open()) {
+		printf("Failed to open %s\n", path.c_str());
+		return false;
+	}
+
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> colors;
+	std::vector<glm::vec2> texCoords;
+	std::unordered_map<uint64_t, uint32_t> uniqueVertices;
+	std::vector<uint32_t> face;
+	std::string line;
+	size_t lineNumber = 0;
+
+	vertices.clear();
+	indices.clear();
+	submeshes.clear();
+	submeshes.push_back({ 0, 0, 0, 0 });
+
+	while (std::getline(file, line)) {
+		std::istringstream tokens(line);
+		std::string keyword;
+
+		lineNumber++;
+		tokens >> keyword;
+
+		if (keyword == "v") {
+			glm::vec3 position(0.0f);
+			glm::vec3 color(1.0f);
+
+			tokens >> position.x >> position.y >> position.z;
+
+			if (!(tokens >> color.r >> color.g >> color.b)) {
+				color = glm::vec3(1.0f);
+			}
+
+			positions.push_back(position);
+			colors.push_back(color);
+		}
+		else if (keyword == "vt") {
+			glm::vec2 texCoord(0.0f);
+
+			tokens >> texCoord.x >> texCoord.y;
+
+			// OBJ puts v = 0 at the bottom of the image, Vulkan samples row 0 first
+			texCoords.push_back(glm::vec2(texCoord.x, 1.0f - texCoord.y));
+		}
+		else if (keyword == "o" || keyword == "g" || keyword == "usemtl") {
+			if (submeshes.back().indexCount > 0) {
+				submeshes.push_back({ static_cast<uint32_t>(indices.size()), 0, 0, 0 });
+			}
+		}
+		else if (keyword == "f") {
+			std::string corner;
+
+			face.clear();
+
+			while (tokens >> corner) {
+				const char* text = corner.c_str();
+				char* end = nullptr;
+				int64_t position = ResolveObjIndex(strtol(text, &end, 10), positions.size());
+				int64_t texCoord = -1;
+				bool hasTexCoord = *end == '/' && end[1] != '/';
+
+				if (hasTexCoord) {
+					texCoord = ResolveObjIndex(strtol(end + 1, &end, 10), texCoords.size());
+				}
+
+				if (position < 0 || position >= static_cast<int64_t>(positions.size()) ||
+					(hasTexCoord && (texCoord < 0 || texCoord >= static_cast<int64_t>(texCoords.size())))) {
+					printf("%s:%zu: face references a missing vertex\n", path.c_str(), lineNumber);
+					return false;
+				}
+
+				// Corners that share both a position and a texture coordinate become one vertex
+				uint64_t key = (static_cast<uint64_t>(position) << 32) | static_cast<uint32_t>(texCoord + 1);
+				auto found = uniqueVertices.find(key);
+
+				if (found == uniqueVertices.end()) {
+					Vertex vertex = {};
+
+					vertex.pos = positions[position];
+					vertex.color = colors[position];
+					vertex.texCoord = texCoord >= 0 ? texCoords[texCoord] : glm::vec2(0.0f);
+
+					found = uniqueVertices.emplace(key, static_cast<uint32_t>(vertices.size())).first;
+					vertices.push_back(vertex);
+				}
+
+				face.push_back(found->second);
+			}
+
+			for (size_t i = 2; i < face.size(); i++) {
+				indices.push_back(face[0]);
+				indices.push_back(face[i - 1]);
+				indices.push_back(face[i]);
+			}
+
+			submeshes.back().indexCount = static_cast<uint32_t>(indices.size()) - submeshes.back().firstIndex;
+		}
+	}
+
+	if (submeshes.back().indexCount == 0) {
+		submeshes.pop_back();
+	}
+
+	if (indices.empty()) {
+		printf("%s has no faces\n", path.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+bool MeshFile::Write(const std::string& path, VertexFormat format, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, const std::vector<MeshSubmesh>& submeshes) {
+	MeshFileHeader header = {};
+	uint32_t stride = Vertex::GetStride(format);
+
+	memcpy(header.identifier, MESH_IDENTIFIER, sizeof(MESH_IDENTIFIER));
+	header.version = MESH_VERSION;
+	header.vertexFormat = static_cast<uint32_t>(format);
+	header.vertexStride = stride;
+	header.indexSize = vertices.size() <= 65536 ? 2 : 4;
+	header.submeshCount = static_cast<uint32_t>(submeshes.size());
+	header.vertexCount = vertices.size();
+	header.indexCount = indices.size();
+	header.submeshOffset = AlignSection(sizeof(header));
+	header.vertexOffset = AlignSection(header.submeshOffset + sizeof(MeshSubmesh) * submeshes.size());
+	header.indexOffset = AlignSection(header.vertexOffset + static_cast<uint64_t>(stride) * vertices.size());
+
+	glm::vec4 sphere = Vertex::ComputeBoundingSphere(vertices.data(), vertices.size());
+
+	for (int i = 0; i < 4; i++) {
+		header.boundingSphere[i] = sphere[i];
+	}
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+
+	if (!file.is_open()) {
+		printf("Failed to open %s for writing\n", path.c_str());
+		return false;
+	}
+
+	const char padding[MESH_SECTION_ALIGNMENT] = {};
+	std::vector<uint8_t> scratch(stride * MESH_WRITE_BATCH);
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(padding, static_cast<std::streamsize>(header.submeshOffset - sizeof(header)));
+	file.write(reinterpret_cast<const char*>(submeshes.data()), sizeof(MeshSubmesh) * submeshes.size());
+	file.write(padding, static_cast<std::streamsize>(header.vertexOffset - header.submeshOffset - sizeof(MeshSubmesh) * submeshes.size()));
+
+	for (size_t first = 0; first < vertices.size(); first += MESH_WRITE_BATCH) {
+		size_t count = std::min(MESH_WRITE_BATCH, vertices.size() - first);
+
+		Vertex::Encode(vertices.data() + first, count, format, scratch.data());
+		file.write(reinterpret_cast<const char*>(scratch.data()), static_cast<std::streamsize>(stride * count));
+	}
+
+	file.write(padding, static_cast<std::streamsize>(header.indexOffset - header.vertexOffset - static_cast<uint64_t>(stride) * vertices.size()));
+
+	if (header.indexSize == 2) {
+		std::vector<uint16_t> shortIndices(indices.begin(), indices.end());
+
+		file.write(reinterpret_cast<const char*>(shortIndices.data()), sizeof(uint16_t) * shortIndices.size());
+	}
+	else {
+		file.write(reinterpret_cast<const char*>(indices.data()), sizeof(uint32_t) * indices.size());
+	}
+
+	return static_cast<bool>(file);
+}
+
+VertexFormat MeshFile::GetVertexFormat() {
+	return this->m_VertexFormat;
+}
+
+uint64_t MeshFile::GetVertexCount() {
+	return this->m_VertexCount;
+}
+
+const void* MeshFile::GetVertexData() {
+	return this->m_Data + this->m_VertexOffset;
+}
+
+VkDeviceSize MeshFile::GetVertexDataSize() {
+	return this->m_VertexCount * Vertex::GetStride(this->m_VertexFormat);
+}
+
+VkIndexType MeshFile::GetIndexType() {
+	return this->m_IndexSize == 2 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+}
+
+uint64_t MeshFile::GetIndexCount() {
+	return this->m_IndexCount;
+}
+
+const void* MeshFile::GetIndexData() {
+	return this->m_Data + this->m_IndexOffset;
+}
+
+VkDeviceSize MeshFile::GetIndexDataSize() {
+	return this->m_IndexCount * this->m_IndexSize;
+}
+
+glm::vec4 MeshFile::GetBoundingSphere() {
+	return this->m_BoundingSphere;
+}
+
+const std::vector<MeshSubmesh>& MeshFile::GetSubmeshes() {
+	return this->m_Submeshes;
+}
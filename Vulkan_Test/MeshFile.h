@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+#include <string>
+#include <vector>
+
+#include "ApplicationStructs.h"
+
+// A range of the index buffer drawn as one indirect command, vertexOffset is added to every index
+struct MeshSubmesh {
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	int32_t vertexOffset;
+	uint32_t reserved;
+};
+
+// Binary mesh container (.vtmesh): a fixed header with the bounding sphere, the submesh table, one
+// interleaved vertex stream already encoded in a GPU VertexFormat and a 16 or 32 bit index stream,
+// each section 16 byte aligned.
+// Open() maps the file read-only instead of reading it, so GetVertexData()/GetIndexData() point into
+// the mapping and uploads copy straight from the page cache into staging memory. ImportObj() and
+// Write() are used by the offline converter.
+class MeshFile
+{
+public:
+	MeshFile();
+	~MeshFile();
+
+	bool Open(const std::string&);
+	void Close();
+	bool IsOpen();
+	static bool ImportObj(const std::string&, std::vector<Vertex>&, std::vector<uint32_t>&, std::vector<MeshSubmesh>&);
+	static bool Write(const std::string&, VertexFormat, const std::vector<Vertex>&, const std::vector<uint32_t>&, const std::vector<MeshSubmesh>&);
+
+	VertexFormat GetVertexFormat();
+	uint64_t GetVertexCount();
+	const void* GetVertexData();
+	VkDeviceSize GetVertexDataSize();
+	VkIndexType GetIndexType();
+	uint64_t GetIndexCount();
+	const void* GetIndexData();
+	VkDeviceSize GetIndexDataSize();
+	glm::vec4 GetBoundingSphere();
+	const std::vector<MeshSubmesh>& GetSubmeshes();
+
+private:
+	const uint8_t* m_Data = nullptr;
+	size_t m_Size = 0;
+#ifdef _WIN32
+	void* m_File = nullptr;
+	void* m_Mapping = nullptr;
+#else
+	int m_File = -1;
+#endif
+
+	VertexFormat m_VertexFormat = VertexFormat::Float;
+	uint64_t m_VertexCount = 0;
+	uint64_t m_VertexOffset = 0;
+	uint32_t m_IndexSize = 0;
+	uint64_t m_IndexCount = 0;
+	uint64_t m_IndexOffset = 0;
+	glm::vec4 m_BoundingSphere = glm::vec4(0.0f);
+	std::vector<MeshSubmesh> m_Submeshes;
+};
@@ -0,0 +1,84 @@
+
+#include "MipChain.h"
+
+#include <string.h>
+#include <algorithm>
+
+MipChain::MipChain()
+{
+}
+
+MipChain::~MipChain()
+{
+}
+
+uint32_t MipChain::CountLevels(uint32_t width, uint32_t height) {
+	uint32_t levels = 1;
+	uint32_t size = std::max(width, height);
+
+	while (size > 1) {
+		size >>= 1;
+		levels++;
+	}
+
+	return levels;
+}
+
+void MipChain::Build(const uint8_t* pixels, uint32_t width, uint32_t height, ThreadPool& threadPool) {
+	uint32_t levelCount = CountLevels(width, height);
+	size_t totalSize = 0;
+
+	this->m_Levels.resize(levelCount);
+
+	for (uint32_t i = 0; i < levelCount; i++) {
+		MipLevel& level = this->m_Levels[i];
+
+		level.width = std::max(width >> i, 1u);
+		level.height = std::max(height >> i, 1u);
+		level.offset = totalSize;
+		level.size = static_cast<size_t>(level.width) * level.height * 4;
+		totalSize += level.size;
+	}
+
+	this->m_Data.resize(totalSize);
+	memcpy(this->m_Data.data(), pixels, this->m_Levels[0].size);
+
+	// Levels depend on each other, so only the rows within a level run in parallel
+	for (uint32_t i = 1; i < levelCount; i++) {
+		const MipLevel& source = this->m_Levels[i - 1];
+		const MipLevel& destination = this->m_Levels[i];
+
+		threadPool.ParallelFor(destination.height, [this, &source, &destination](size_t firstRow, size_t lastRow) {
+			Downsample(source, destination, firstRow, lastRow);
+		});
+	}
+}
+
+const std::vector<uint8_t>& MipChain::GetData() {
+	return this->m_Data;
+}
+
+const std::vector<MipLevel>& MipChain::GetLevels() {
+	return this->m_Levels;
+}
+
+void MipChain::Downsample(const MipLevel& source, const MipLevel& destination, size_t firstRow, size_t lastRow) {
+	const uint8_t* src = this->m_Data.data() + source.offset;
+	uint8_t* dst = this->m_Data.data() + destination.offset;
+	size_t srcPitch = static_cast<size_t>(source.width) * 4;
+
+	for (size_t y = firstRow; y < lastRow; y++) {
+		const uint8_t* row0 = src + std::min<size_t>(y * 2, source.height - 1) * srcPitch;
+		const uint8_t* row1 = src + std::min<size_t>(y * 2 + 1, source.height - 1) * srcPitch;
+		uint8_t* out = dst + y * destination.width * 4;
+
+		for (size_t x = 0; x < destination.width; x++) {
+			size_t x0 = std::min<size_t>(x * 2, source.width - 1) * 4;
+			size_t x1 = std::min<size_t>(x * 2 + 1, source.width - 1) * 4;
+
+			for (size_t c = 0; c < 4; c++) {
+				out[x * 4 + c] = static_cast<uint8_t>((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+			}
+		}
+	}
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#include "ThreadPool.h"
+
+// Where one mip level sits inside a tightly packed image buffer
+struct MipLevel {
+	size_t offset = 0;
+	size_t size = 0;
+	uint32_t width = 0;
+	uint32_t height = 0;
+};
+
+// Builds a full RGBA8 mip chain on the CPU, for formats the device cannot blit with a linear filter.
+// Each level is a 2x2 box filter of the one above it (edge texels are repeated on odd sizes), and the
+// rows of a level are split across the thread pool.
+class MipChain
+{
+public:
+	MipChain();
+	~MipChain();
+
+	static uint32_t CountLevels(uint32_t, uint32_t);
+
+	void Build(const uint8_t*, uint32_t, uint32_t, ThreadPool&);
+	const std::vector<uint8_t>& GetData();
+	const std::vector<MipLevel>& GetLevels();
+
+private:
+	void Downsample(const MipLevel&, const MipLevel&, size_t, size_t);
+
+	std::vector<uint8_t> m_Data;
+	std::vector<MipLevel> m_Levels;
+};
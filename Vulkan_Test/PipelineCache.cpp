@@ -0,0 +1,242 @@
+
+#include "PipelineCache.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <fstream>
+#include <filesystem>
+
+PipelineCache::PipelineCache()
+{
+}
+
+PipelineCache::~PipelineCache()
+{
+	this->Destroy();
+}
+
+bool PipelineCache::Init(VkPhysicalDevice physicalDevice, VkDevice device, const std::string& path, bool enabled, bool feedbackSupported) {
+	this->m_Device = device;
+	this->m_Path = path;
+	this->m_Enabled = enabled;
+	this->m_FeedbackSupported = feedbackSupported;
+
+	vkGetPhysicalDeviceProperties(physicalDevice, &this->m_DeviceProperties);
+
+	if (!enabled) {
+		return true;
+	}
+
+	std::vector<char> initialData;
+	VkPipelineCacheCreateInfo cacheInfo = {};
+
+	this->m_LoadedFromDisk = LoadFromDisk(initialData);
+
+	cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	cacheInfo.initialDataSize = this->m_LoadedFromDisk ? initialData.size() : 0;
+	cacheInfo.pInitialData = this->m_LoadedFromDisk ? initialData.data() : nullptr;
+
+	if (vkCreatePipelineCache(this->m_Device, &cacheInfo, nullptr, &this->m_Cache) != VK_SUCCESS) {
+		// A driver may still reject data that passed the header check, start empty rather than fail
+		cacheInfo.initialDataSize = 0;
+		cacheInfo.pInitialData = nullptr;
+		this->m_LoadedFromDisk = false;
+
+		if (vkCreatePipelineCache(this->m_Device, &cacheInfo, nullptr, &this->m_Cache) != VK_SUCCESS) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void PipelineCache::Destroy() {
+	if (this->m_Device == VK_NULL_HANDLE) {
+		return;
+	}
+
+	if (this->m_Cache != VK_NULL_HANDLE) {
+		Save();
+		vkDestroyPipelineCache(this->m_Device, this->m_Cache, nullptr);
+		this->m_Cache = VK_NULL_HANDLE;
+	}
+
+	this->m_Device = VK_NULL_HANDLE;
+}
+
+VkPipelineCache PipelineCache::GetHandle() {
+	return this->m_Cache;
+}
+
+bool PipelineCache::LoadFromDisk(std::vector<char>& data) {
+	std::ifstream file(this->m_Path, std::ios::ate | std::ios::binary);
+
+	if (!file.is_open()) {
+		return false;
+	}
+
+	size_t fileSize = (size_t)file.tellg();
+
+	data.resize(fileSize);
+	file.seekg(0);
+	file.read(data.data(), fileSize);
+
+	if (!file || !ValidateHeader(data)) {
+		printf("Discarding pipeline cache %s, it was written by a different device or driver\n", this->m_Path.c_str());
+		data.clear();
+		return false;
+	}
+
+	return true;
+}
+
+bool PipelineCache::ValidateHeader(const std::vector<char>& data) {
+	uint32_t headerSize;
+	uint32_t headerVersion;
+	uint32_t vendorID;
+	uint32_t deviceID;
+	const size_t minimumSize = 4 * sizeof(uint32_t) + VK_UUID_SIZE;
+
+	if (data.size() < minimumSize) {
+		return false;
+	}
+
+	memcpy(&headerSize, data.data(), sizeof(uint32_t));
+	memcpy(&headerVersion, data.data() + 4, sizeof(uint32_t));
+	memcpy(&vendorID, data.data() + 8, sizeof(uint32_t));
+	memcpy(&deviceID, data.data() + 12, sizeof(uint32_t));
+
+	if (headerSize < minimumSize || headerSize > data.size() || headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE) {
+		return false;
+	}
+
+	if (vendorID != this->m_DeviceProperties.vendorID || deviceID != this->m_DeviceProperties.deviceID) {
+		return false;
+	}
+
+	return memcmp(data.data() + 16, this->m_DeviceProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+size_t PipelineCache::GetDataSize() {
+	size_t dataSize = 0;
+
+	if (this->m_Cache != VK_NULL_HANDLE) {
+		vkGetPipelineCacheData(this->m_Device, this->m_Cache, &dataSize, nullptr);
+	}
+
+	return dataSize;
+}
+
+bool PipelineCache::Save() {
+	if (this->m_Cache == VK_NULL_HANDLE) {
+		return false;
+	}
+
+	size_t dataSize = GetDataSize();
+	std::vector<char> data(dataSize);
+
+	if (dataSize == 0 || vkGetPipelineCacheData(this->m_Device, this->m_Cache, &dataSize, data.data()) != VK_SUCCESS) {
+		return false;
+	}
+
+	std::string tempPath = this->m_Path + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+
+		if (!file.is_open()) {
+			printf("Failed to open %s for writing\n", tempPath.c_str());
+			return false;
+		}
+
+		file.write(data.data(), dataSize);
+
+		if (!file) {
+			printf("Failed to write %s\n", tempPath.c_str());
+			return false;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(tempPath, this->m_Path, error);
+
+	if (error) {
+		printf("Failed to replace %s: %s\n", this->m_Path.c_str(), error.message().c_str());
+		std::filesystem::remove(tempPath, error);
+		return false;
+	}
+
+	return true;
+}
+
+VkResult PipelineCache::CreateGraphicsPipeline(const VkGraphicsPipelineCreateInfo& createInfo, VkPipeline& pipeline) {
+	return CreatePipeline(createInfo, createInfo.stageCount, pipeline, [this](const VkGraphicsPipelineCreateInfo* info, VkPipeline* created) {
+		return vkCreateGraphicsPipelines(this->m_Device, this->m_Cache, 1, info, nullptr, created);
+	});
+}
+
+VkResult PipelineCache::CreateComputePipeline(const VkComputePipelineCreateInfo& createInfo, VkPipeline& pipeline) {
+	return CreatePipeline(createInfo, 1, pipeline, [this](const VkComputePipelineCreateInfo* info, VkPipeline* created) {
+		return vkCreateComputePipelines(this->m_Device, this->m_Cache, 1, info, nullptr, created);
+	});
+}
+
+template <typename CreateInfo, typename CreateFunction>
+VkResult PipelineCache::CreatePipeline(const CreateInfo& createInfo, uint32_t stageCount, VkPipeline& pipeline, CreateFunction create) {
+	CreateInfo pipelineInfo = createInfo;
+	size_t sizeBefore = 0;
+	bool hit = false;
+
+#ifdef VK_EXT_pipeline_creation_feedback
+	VkPipelineCreationFeedbackEXT pipelineFeedback = {};
+	std::vector<VkPipelineCreationFeedbackEXT> stageFeedback(stageCount);
+	VkPipelineCreationFeedbackCreateInfoEXT feedbackInfo = {};
+
+	if (this->m_FeedbackSupported) {
+		feedbackInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT;
+		feedbackInfo.pNext = pipelineInfo.pNext;
+		feedbackInfo.pPipelineCreationFeedback = &pipelineFeedback;
+		feedbackInfo.pipelineStageCreationFeedbackCount = stageCount;
+		feedbackInfo.pPipelineStageCreationFeedbacks = stageFeedback.data();
+		pipelineInfo.pNext = &feedbackInfo;
+	}
+#endif
+
+	if (!this->m_FeedbackSupported) {
+		sizeBefore = GetDataSize();
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	VkResult result = create(&pipelineInfo, &pipeline);
+	auto end = std::chrono::high_resolution_clock::now();
+
+	this->m_CreationMilliseconds += std::chrono::duration<double, std::milli>(end - start).count();
+
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+
+#ifdef VK_EXT_pipeline_creation_feedback
+	if (this->m_FeedbackSupported) {
+		hit = (pipelineFeedback.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT_EXT) && (pipelineFeedback.flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT_EXT);
+	}
+#endif
+
+	if (!this->m_FeedbackSupported) {
+		hit = this->m_Cache != VK_NULL_HANDLE && GetDataSize() == sizeBefore;
+	}
+
+	if (hit) {
+		this->m_Hits++;
+	}
+	else {
+		this->m_Misses++;
+	}
+
+	return result;
+}
+
+void PipelineCache::PrintStatistics() {
+	printf("Pipeline cache: %s, %s\n", this->m_Enabled ? (this->m_LoadedFromDisk ? "loaded from disk" : "cold") : "disabled", this->m_FeedbackSupported ? "creation feedback" : "estimated from cache growth");
+	printf("  hits %u, misses %u, %.2f ms spent creating pipelines\n", this->m_Hits, this->m_Misses, this->m_CreationMilliseconds);
+}
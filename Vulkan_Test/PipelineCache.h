@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <string>
+#include <vector>
+
+// Owns the VkPipelineCache every pipeline is created through. The cache is seeded from disk when the
+// stored header matches this device (vendor, device ID and pipeline cache UUID) and is written back
+// through a temporary file so a crash mid-save never leaves a truncated cache behind. Hits and misses
+// come from VK_EXT_pipeline_creation_feedback when the device has it, otherwise they are estimated
+// from whether the cache grew during creation.
+class PipelineCache
+{
+public:
+	PipelineCache();
+	~PipelineCache();
+
+	bool Init(VkPhysicalDevice, VkDevice, const std::string&, bool, bool);
+	void Destroy();
+	bool Save();
+	VkPipelineCache GetHandle();
+	VkResult CreateGraphicsPipeline(const VkGraphicsPipelineCreateInfo&, VkPipeline&);
+	VkResult CreateComputePipeline(const VkComputePipelineCreateInfo&, VkPipeline&);
+	void PrintStatistics();
+
+private:
+	bool LoadFromDisk(std::vector<char>&);
+	bool ValidateHeader(const std::vector<char>&);
+	size_t GetDataSize();
+
+	template <typename CreateInfo, typename CreateFunction>
+	VkResult CreatePipeline(const CreateInfo&, uint32_t, VkPipeline&, CreateFunction);
+
+	VkDevice m_Device = VK_NULL_HANDLE;
+	VkPhysicalDeviceProperties m_DeviceProperties = {};
+	VkPipelineCache m_Cache = VK_NULL_HANDLE;
+	std::string m_Path;
+	bool m_Enabled = true;
+	bool m_FeedbackSupported = false;
+	bool m_LoadedFromDisk = false;
+
+	uint32_t m_Hits = 0;
+	uint32_t m_Misses = 0;
+	double m_CreationMilliseconds = 0.0;
+};
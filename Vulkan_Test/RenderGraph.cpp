@@ -0,0 +1,460 @@
+
+#include "RenderGraph.h"
+
+#include <stdio.h>
+#include <algorithm>
+
+struct UsageInfo {
+	VkPipelineStageFlags stages;
+	VkAccessFlags access;
+	VkImageLayout layout;
+	VkImageUsageFlags imageUsage;
+	bool write;
+};
+
+// Indexed by RenderUsage
+static const UsageInfo s_UsageInfo[] = {
+	{ VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED, 0, false },
+	// A freshly acquired swap chain image, the acquire semaphore is waited on at color output
+	{ VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED, 0, false },
+	{ VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, true },
+	{ VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, true },
+	{ VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, false },
+	{ VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT, false },
+	{ VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT, false },
+	{ VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT, true },
+	{ VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, 0, false },
+	{ VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, 0, false },
+	{ VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT, false },
+	{ VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT, true },
+	{ VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, 0, false },
+	// Presentation is ordered by the render finished semaphore, the barrier only has to change the layout
+	{ VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, 0, false }
+};
+
+static_assert(sizeof(s_UsageInfo) / sizeof(s_UsageInfo[0]) == static_cast<size_t>(RenderUsage::Count), "Every RenderUsage needs a UsageInfo entry");
+
+static const UsageInfo& GetUsageInfo(RenderUsage usage) {
+	return s_UsageInfo[static_cast<uint32_t>(usage)];
+}
+
+static bool HasStencil(VkFormat format) {
+	return format == VK_FORMAT_D16_UNORM_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+}
+
+RenderGraph::RenderGraph()
+{
+}
+
+RenderGraph::~RenderGraph()
+{
+	this->Destroy();
+}
+
+void RenderGraph::Init(VkDevice device, MemoryAllocator* allocator) {
+	this->m_Device = device;
+	this->m_Allocator = allocator;
+}
+
+// Frees the transients and forgets every pass, the graph is declared again after a swap chain change
+void RenderGraph::Destroy() {
+	for (auto& resource : this->m_Resources) {
+		if (!resource.transient) {
+			continue;
+		}
+
+		if (resource.view != VK_NULL_HANDLE) {
+			vkDestroyImageView(this->m_Device, resource.view, nullptr);
+		}
+
+		if (resource.imageHandle != VK_NULL_HANDLE) {
+			vkDestroyImage(this->m_Device, resource.imageHandle, nullptr);
+		}
+	}
+
+	for (auto& slot : this->m_Slots) {
+		if (slot.memory.memory != VK_NULL_HANDLE) {
+			this->m_Allocator->Free(slot.memory);
+		}
+	}
+
+	this->m_Resources.clear();
+	this->m_Passes.clear();
+	this->m_Slots.clear();
+	this->m_FinalBarriers = BarrierBatch();
+}
+
+// initial is the state the image is in when Execute() starts, final the one it is left in (Undefined leaves the last use)
+RenderResource RenderGraph::ImportImage(const char* name, VkImageAspectFlags aspect, RenderUsage initial, RenderUsage final) {
+	Resource resource;
+
+	resource.name = name;
+	resource.image = true;
+	resource.desc.aspect = aspect;
+	resource.barrierAspect = aspect;
+	resource.initialUsage = initial;
+	resource.finalUsage = final;
+	this->m_Resources.push_back(resource);
+
+	return static_cast<RenderResource>(this->m_Resources.size() - 1);
+}
+
+RenderResource RenderGraph::ImportBuffer(const char* name, RenderUsage initial, RenderUsage final) {
+	Resource resource;
+
+	resource.name = name;
+	resource.initialUsage = initial;
+	resource.finalUsage = final;
+	this->m_Resources.push_back(resource);
+
+	return static_cast<RenderResource>(this->m_Resources.size() - 1);
+}
+
+// The image and its memory are only created in Compile(), the usage flags come from the passes that touch it
+RenderResource RenderGraph::CreateImage(const char* name, const RenderImageDesc& desc) {
+	Resource resource;
+
+	resource.name = name;
+	resource.image = true;
+	resource.transient = true;
+	resource.desc = desc;
+	resource.barrierAspect = desc.aspect | (HasStencil(desc.format) ? VK_IMAGE_ASPECT_STENCIL_BIT : 0);
+	this->m_Resources.push_back(resource);
+
+	return static_cast<RenderResource>(this->m_Resources.size() - 1);
+}
+
+void RenderGraph::AddPass(const char* name, const std::vector<RenderAccess>& accesses, RenderPassCallback callback) {
+	Pass pass;
+
+	pass.name = name;
+	pass.accesses = accesses;
+	pass.callback = callback;
+	this->m_Passes.push_back(pass);
+}
+
+bool RenderGraph::Compile() {
+	for (int i = 0; i < static_cast<int>(this->m_Passes.size()); i++) {
+		for (const auto& access : this->m_Passes[i].accesses) {
+			Resource& resource = this->m_Resources[access.resource];
+
+			if (resource.firstPass < 0) {
+				resource.firstPass = i;
+			}
+
+			resource.lastPass = i;
+			resource.lastUsage = access.usage;
+			resource.imageUsage |= GetUsageInfo(access.usage).imageUsage;
+		}
+	}
+
+	if (!AllocateTransients()) {
+		return false;
+	}
+
+	PlanBarriers();
+
+	size_t barrierCount = this->m_FinalBarriers.barriers.size();
+	VkDeviceSize transientBytes = 0;
+	VkDeviceSize slotBytes = 0;
+
+	for (const auto& pass : this->m_Passes) {
+		barrierCount += pass.barriers.barriers.size();
+	}
+
+	for (const auto& resource : this->m_Resources) {
+		if (resource.transient && resource.imageHandle != VK_NULL_HANDLE) {
+			VkMemoryRequirements requirements;
+
+			vkGetImageMemoryRequirements(this->m_Device, resource.imageHandle, &requirements);
+			transientBytes += requirements.size;
+		}
+	}
+
+	for (const auto& slot : this->m_Slots) {
+		slotBytes += slot.requirements.size;
+	}
+
+	printf("Render graph: %zu passes, %zu barriers, %zu transient memory slots (%llu KB, %llu KB without aliasing)\n",
+		this->m_Passes.size(),
+		barrierCount,
+		this->m_Slots.size(),
+		(unsigned long long)(slotBytes / 1024),
+		(unsigned long long)(transientBytes / 1024));
+
+	return true;
+}
+
+// Greedy interval packing: transients are visited in the order they start and take the first slot whose
+// last occupant is done by then, so the memory of a transient is reused as soon as its last pass has run
+bool RenderGraph::AllocateTransients() {
+	std::vector<RenderResource> order;
+
+	for (RenderResource i = 0; i < this->m_Resources.size(); i++) {
+		Resource& resource = this->m_Resources[i];
+
+		if (!resource.transient || resource.firstPass < 0) {
+			continue;
+		}
+
+		VkImageCreateInfo imageInfo = {};
+
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.extent = { resource.desc.extent.width, resource.desc.extent.height, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.format = resource.desc.format;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageInfo.usage = resource.imageUsage;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		if (vkCreateImage(this->m_Device, &imageInfo, nullptr, &resource.imageHandle) != VK_SUCCESS) {
+			printf("Render graph: failed to create transient image %s\n", resource.name.c_str());
+			return false;
+		}
+
+		order.push_back(i);
+	}
+
+	std::sort(order.begin(), order.end(), [this](RenderResource a, RenderResource b) {
+		return this->m_Resources[a].firstPass < this->m_Resources[b].firstPass;
+	});
+
+	for (RenderResource index : order) {
+		Resource& resource = this->m_Resources[index];
+		VkMemoryRequirements requirements;
+		size_t slot = 0;
+
+		vkGetImageMemoryRequirements(this->m_Device, resource.imageHandle, &requirements);
+
+		for (; slot < this->m_Slots.size(); slot++) {
+			if (this->m_Slots[slot].lastPass < resource.firstPass && (this->m_Slots[slot].requirements.memoryTypeBits & requirements.memoryTypeBits) != 0) {
+				break;
+			}
+		}
+
+		if (slot == this->m_Slots.size()) {
+			MemorySlot newSlot;
+
+			newSlot.requirements.memoryTypeBits = requirements.memoryTypeBits;
+			newSlot.requirements.alignment = 1;
+			this->m_Slots.push_back(newSlot);
+		}
+
+		MemorySlot& target = this->m_Slots[slot];
+
+		target.requirements.size = std::max(target.requirements.size, requirements.size);
+		target.requirements.alignment = std::max(target.requirements.alignment, requirements.alignment);
+		target.requirements.memoryTypeBits &= requirements.memoryTypeBits;
+		target.lastPass = resource.lastPass;
+		resource.previousOccupant = target.lastOccupant;
+		resource.slot = static_cast<uint32_t>(slot);
+		target.lastOccupant = static_cast<int>(index);
+	}
+
+	// The first occupant of a slot follows the last one from the previous execution
+	for (RenderResource index : order) {
+		Resource& resource = this->m_Resources[index];
+
+		if (resource.previousOccupant < 0) {
+			resource.previousOccupant = this->m_Slots[resource.slot].lastOccupant;
+		}
+	}
+
+	for (auto& slot : this->m_Slots) {
+		uint32_t memoryType = this->m_Allocator->FindMemoryType(slot.requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		if (!this->m_Allocator->Allocate(slot.requirements, memoryType, false, false, slot.memory)) {
+			printf("Render graph: failed to allocate %llu KB of transient memory\n", (unsigned long long)(slot.requirements.size / 1024));
+			return false;
+		}
+	}
+
+	for (RenderResource index : order) {
+		Resource& resource = this->m_Resources[index];
+		const Allocation& memory = this->m_Slots[resource.slot].memory;
+		VkImageViewCreateInfo viewInfo = {};
+
+		vkBindImageMemory(this->m_Device, resource.imageHandle, memory.memory, memory.offset);
+
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = resource.imageHandle;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = resource.desc.format;
+		viewInfo.subresourceRange.aspectMask = resource.desc.aspect;
+		viewInfo.subresourceRange.levelCount = 1;
+		viewInfo.subresourceRange.layerCount = 1;
+
+		if (vkCreateImageView(this->m_Device, &viewInfo, nullptr, &resource.view) != VK_SUCCESS) {
+			printf("Render graph: failed to create view for %s\n", resource.name.c_str());
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void RenderGraph::PlanBarriers() {
+	std::vector<State> states(this->m_Resources.size());
+
+	for (size_t i = 0; i < this->m_Resources.size(); i++) {
+		const Resource& resource = this->m_Resources[i];
+		RenderUsage previous = resource.initialUsage;
+
+		// A transient starts with whatever was last done to its memory, by an alias or by itself a frame earlier
+		if (resource.transient && resource.previousOccupant >= 0) {
+			previous = this->m_Resources[resource.previousOccupant].lastUsage;
+		}
+
+		const UsageInfo& info = GetUsageInfo(previous);
+
+		if (info.write) {
+			states[i].writeStages = info.stages;
+			states[i].writeAccess = info.access;
+			states[i].written = true;
+		}
+		else {
+			states[i].readStages = info.stages;
+			states[i].readAccess = info.access;
+		}
+
+		states[i].layout = resource.transient ? VK_IMAGE_LAYOUT_UNDEFINED : info.layout;
+	}
+
+	for (auto& pass : this->m_Passes) {
+		for (const auto& access : pass.accesses) {
+			Transition(states[access.resource], access.resource, access.usage, pass.barriers);
+		}
+	}
+
+	for (size_t i = 0; i < this->m_Resources.size(); i++) {
+		if (this->m_Resources[i].finalUsage != RenderUsage::Undefined) {
+			Transition(states[i], static_cast<RenderResource>(i), this->m_Resources[i].finalUsage, this->m_FinalBarriers);
+		}
+	}
+}
+
+// Adds what it takes to go from state to usage into batch: nothing for a read after reads or for a read
+// already made visible in the same layout, an execution dependency for a write after reads, a memory barrier otherwise
+void RenderGraph::Transition(State& state, RenderResource index, RenderUsage usage, BarrierBatch& batch) {
+	const Resource& resource = this->m_Resources[index];
+	const UsageInfo& info = GetUsageInfo(usage);
+	VkImageLayout layout = resource.image ? info.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+	bool layoutChange = resource.image && layout != state.layout;
+
+	if (!info.write && !layoutChange) {
+		if (!state.written || ((info.stages & ~state.readStages) == 0 && (info.access & ~state.readAccess) == 0)) {
+			state.readStages |= info.stages;
+			state.readAccess |= info.access;
+			return;
+		}
+
+		if (state.writeAccess != 0) {
+			batch.barriers.push_back({ index, state.writeAccess, info.access, layout, layout });
+		}
+
+		batch.srcStages |= state.writeStages;
+		batch.dstStages |= info.stages;
+		state.readStages |= info.stages;
+		state.readAccess |= info.access;
+		return;
+	}
+
+	// Write after read only has to wait for the readers, a buffer needs no barrier struct for that
+	if (layoutChange || state.writeAccess != 0) {
+		batch.barriers.push_back({ index, state.writeAccess, info.access, state.layout, layout });
+	}
+
+	batch.srcStages |= state.writeStages | state.readStages;
+	batch.dstStages |= info.stages;
+
+	// Later readers chain onto this barrier's destination stages, the layout transition counts as a write
+	state.writeStages = info.stages;
+	state.writeAccess = info.write ? info.access : 0;
+	state.readStages = info.write ? 0 : info.stages;
+	state.readAccess = info.write ? 0 : info.access;
+	state.layout = layout;
+	state.written = true;
+}
+
+void RenderGraph::SetImage(RenderResource resource, VkImage image) {
+	this->m_Resources[resource].imageHandle = image;
+}
+
+void RenderGraph::SetBuffer(RenderResource resource, VkBuffer buffer) {
+	this->m_Resources[resource].bufferHandle = buffer;
+}
+
+VkImage RenderGraph::GetImage(RenderResource resource) {
+	return this->m_Resources[resource].imageHandle;
+}
+
+VkImageView RenderGraph::GetImageView(RenderResource resource) {
+	return this->m_Resources[resource].view;
+}
+
+void RenderGraph::Execute(VkCommandBuffer commandBuffer, size_t frame, uint32_t imageIndex) {
+	for (const auto& pass : this->m_Passes) {
+		RecordBarriers(commandBuffer, pass.barriers);
+		pass.callback(commandBuffer, frame, imageIndex);
+	}
+
+	RecordBarriers(commandBuffer, this->m_FinalBarriers);
+}
+
+void RenderGraph::RecordBarriers(VkCommandBuffer commandBuffer, const BarrierBatch& batch) {
+	if (batch.dstStages == 0) {
+		return;
+	}
+
+	this->m_ImageBarriers.clear();
+	this->m_BufferBarriers.clear();
+
+	for (const auto& barrier : batch.barriers) {
+		const Resource& resource = this->m_Resources[barrier.resource];
+
+		if (resource.image) {
+			VkImageMemoryBarrier imageBarrier = {};
+
+			imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			imageBarrier.srcAccessMask = barrier.srcAccess;
+			imageBarrier.dstAccessMask = barrier.dstAccess;
+			imageBarrier.oldLayout = barrier.oldLayout;
+			imageBarrier.newLayout = barrier.newLayout;
+			imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			imageBarrier.image = resource.imageHandle;
+			imageBarrier.subresourceRange.aspectMask = resource.barrierAspect;
+			imageBarrier.subresourceRange.levelCount = 1;
+			imageBarrier.subresourceRange.layerCount = 1;
+			this->m_ImageBarriers.push_back(imageBarrier);
+		}
+		else {
+			VkBufferMemoryBarrier bufferBarrier = {};
+
+			bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			bufferBarrier.srcAccessMask = barrier.srcAccess;
+			bufferBarrier.dstAccessMask = barrier.dstAccess;
+			bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			bufferBarrier.buffer = resource.bufferHandle;
+			bufferBarrier.offset = 0;
+			bufferBarrier.size = VK_WHOLE_SIZE;
+			this->m_BufferBarriers.push_back(bufferBarrier);
+		}
+	}
+
+	VkPipelineStageFlags srcStages = batch.srcStages;
+
+	if (srcStages == 0) {
+		srcStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+	}
+
+	vkCmdPipelineBarrier(commandBuffer, srcStages, batch.dstStages, 0,
+		0, nullptr,
+		static_cast<uint32_t>(this->m_BufferBarriers.size()), this->m_BufferBarriers.data(),
+		static_cast<uint32_t>(this->m_ImageBarriers.size()), this->m_ImageBarriers.data());
+}
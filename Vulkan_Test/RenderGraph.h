@@ -0,0 +1,143 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <string>
+#include <functional>
+
+#include "MemoryAllocator.h"
+
+typedef uint32_t RenderResource;
+
+// How a pass touches a resource. Each usage maps to one pipeline stage, access mask and (for images)
+// layout, so passes only say what they do and the graph works out the barriers between them.
+enum class RenderUsage : uint32_t {
+	Undefined,
+	Acquired,
+	ColorAttachment,
+	DepthAttachment,
+	DepthRead,
+	Sampled,
+	StorageRead,
+	StorageWrite,
+	VertexBuffer,
+	IndirectBuffer,
+	TransferSrc,
+	TransferDst,
+	HostRead,
+	Present,
+	Count
+};
+
+struct RenderImageDesc {
+	VkFormat format;
+	VkExtent2D extent;
+	VkImageAspectFlags aspect;
+};
+
+struct RenderAccess {
+	RenderResource resource;
+	RenderUsage usage;
+};
+
+// Called with the command buffer, frame in flight and swap chain image index
+typedef std::function<void(VkCommandBuffer, size_t, uint32_t)> RenderPassCallback;
+
+// Frame graph built once per swap chain: passes declare the resources they read and write, Compile()
+// turns that into one batched vkCmdPipelineBarrier per pass and Execute() replays it into a command
+// buffer. Imported resources (swap chain images, vertex buffers) are owned elsewhere and bound with
+// SetImage()/SetBuffer() before each Execute(). Transient images are owned by the graph and placed
+// in shared memory slots, two transients whose pass ranges don't overlap alias the same memory.
+class RenderGraph
+{
+public:
+	RenderGraph();
+	~RenderGraph();
+
+	void Init(VkDevice, MemoryAllocator*);
+	void Destroy();
+	RenderResource ImportImage(const char*, VkImageAspectFlags, RenderUsage, RenderUsage);
+	RenderResource ImportBuffer(const char*, RenderUsage, RenderUsage);
+	RenderResource CreateImage(const char*, const RenderImageDesc&);
+	void AddPass(const char*, const std::vector<RenderAccess>&, RenderPassCallback);
+	bool Compile();
+	void SetImage(RenderResource, VkImage);
+	void SetBuffer(RenderResource, VkBuffer);
+	VkImage GetImage(RenderResource);
+	VkImageView GetImageView(RenderResource);
+	void Execute(VkCommandBuffer, size_t, uint32_t);
+
+private:
+	struct Resource {
+		std::string name;
+		bool image = false;
+		bool transient = false;
+		RenderImageDesc desc = {};
+		VkImageAspectFlags barrierAspect = 0;
+		RenderUsage initialUsage = RenderUsage::Undefined;
+		RenderUsage finalUsage = RenderUsage::Undefined;
+		VkImage imageHandle = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+		VkBuffer bufferHandle = VK_NULL_HANDLE;
+		VkImageUsageFlags imageUsage = 0;
+		int firstPass = -1;
+		int lastPass = -1;
+		RenderUsage lastUsage = RenderUsage::Undefined;
+		int previousOccupant = -1;
+		uint32_t slot = 0;
+	};
+
+	// Where a resource stands while the barriers are planned
+	struct State {
+		VkPipelineStageFlags writeStages = 0;
+		VkAccessFlags writeAccess = 0;
+		VkPipelineStageFlags readStages = 0;
+		VkAccessFlags readAccess = 0;
+		VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		bool written = false;
+	};
+
+	struct Barrier {
+		RenderResource resource;
+		VkAccessFlags srcAccess;
+		VkAccessFlags dstAccess;
+		VkImageLayout oldLayout;
+		VkImageLayout newLayout;
+	};
+
+	struct BarrierBatch {
+		VkPipelineStageFlags srcStages = 0;
+		VkPipelineStageFlags dstStages = 0;
+		std::vector<Barrier> barriers;
+	};
+
+	struct Pass {
+		std::string name;
+		std::vector<RenderAccess> accesses;
+		RenderPassCallback callback;
+		BarrierBatch barriers;
+	};
+
+	struct MemorySlot {
+		VkMemoryRequirements requirements = {};
+		int lastPass = -1;
+		int lastOccupant = -1;
+		Allocation memory;
+	};
+
+	bool AllocateTransients();
+	void PlanBarriers();
+	void Transition(State&, RenderResource, RenderUsage, BarrierBatch&);
+	void RecordBarriers(VkCommandBuffer, const BarrierBatch&);
+
+	VkDevice m_Device = VK_NULL_HANDLE;
+	MemoryAllocator* m_Allocator = nullptr;
+
+	std::vector<Resource> m_Resources;
+	std::vector<Pass> m_Passes;
+	std::vector<MemorySlot> m_Slots;
+	BarrierBatch m_FinalBarriers;
+
+	std::vector<VkImageMemoryBarrier> m_ImageBarriers;
+	std::vector<VkBufferMemoryBarrier> m_BufferBarriers;
+};
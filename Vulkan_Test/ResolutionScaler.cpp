@@ -0,0 +1,109 @@
+#include "ResolutionScaler.h"
+
+#include <math.h>
+#include <algorithm>
+
+// Frames the smoothed time has to stay over budget (or under the headroom band) before the scale moves
+static const uint32_t OverBudgetFrames = 3;
+static const uint32_t UnderBudgetFrames = 60;
+static const uint32_t CooldownFrames = 8;
+static const float Smoothing = 0.2f;
+// Growing only below this fraction of the target keeps the scale from oscillating around the budget
+static const float HeadroomBand = 0.8f;
+// Changes aim a little under the target so the next frame has some slack
+static const float AimFraction = 0.9f;
+static const float MaxIncrease = 0.1f;
+
+ResolutionScaler::ResolutionScaler()
+{
+}
+
+ResolutionScaler::~ResolutionScaler()
+{
+}
+
+void ResolutionScaler::Init(float minScale, float maxScale, float targetTime) {
+	// The range is snapped inwards onto the step grid, so quantizing a clamped scale keeps it in range
+	this->m_MinScale = std::max(ceilf(minScale / ScaleStep - 0.001f) * ScaleStep, ScaleStep);
+	this->m_MaxScale = std::max(Quantize(maxScale), this->m_MinScale);
+	this->m_TargetTime = targetTime;
+	this->m_Scale = this->m_MaxScale;
+	this->m_AverageTime = 0.0f;
+	this->m_OverBudgetFrames = 0;
+	this->m_UnderBudgetFrames = 0;
+	this->m_Cooldown = 0;
+}
+
+// Returns true when the scale changed and the scene has to be recorded at the new render extent
+bool ResolutionScaler::Update(float gpuTime) {
+	if (this->m_Cooldown > 0) {
+		this->m_Cooldown--;
+		return false;
+	}
+
+	this->m_AverageTime = this->m_AverageTime == 0.0f ? gpuTime : this->m_AverageTime + (gpuTime - this->m_AverageTime) * Smoothing;
+
+	if (this->m_AverageTime > this->m_TargetTime) {
+		this->m_OverBudgetFrames++;
+		this->m_UnderBudgetFrames = 0;
+	}
+	else if (this->m_AverageTime < this->m_TargetTime * HeadroomBand) {
+		this->m_UnderBudgetFrames++;
+		this->m_OverBudgetFrames = 0;
+	}
+	else {
+		this->m_OverBudgetFrames = 0;
+		this->m_UnderBudgetFrames = 0;
+	}
+
+	if (this->m_OverBudgetFrames < OverBudgetFrames && this->m_UnderBudgetFrames < UnderBudgetFrames) {
+		return false;
+	}
+
+	// GPU time mostly follows the pixel count, which goes with the square of the scale
+	float scale = this->m_Scale * sqrtf(this->m_TargetTime * AimFraction / std::max(this->m_AverageTime, 0.001f));
+
+	scale = std::min(scale, this->m_Scale + MaxIncrease);
+	scale = Quantize(std::min(std::max(scale, this->m_MinScale), this->m_MaxScale));
+
+	this->m_OverBudgetFrames = 0;
+	this->m_UnderBudgetFrames = 0;
+
+	if (scale == this->m_Scale) {
+		return false;
+	}
+
+	this->m_Scale = scale;
+	this->m_AverageTime = 0.0f;
+	this->m_Cooldown = CooldownFrames;
+
+	return true;
+}
+
+float ResolutionScaler::GetScale() {
+	return this->m_Scale;
+}
+
+VkExtent2D ResolutionScaler::GetRenderExtent(VkExtent2D outputExtent) {
+	return ScaleExtent(outputExtent, this->m_Scale);
+}
+
+// The scene targets are sized for the largest scale, lower scales render into their top left corner
+VkExtent2D ResolutionScaler::GetMaxExtent(VkExtent2D outputExtent) {
+	return ScaleExtent(outputExtent, this->m_MaxScale);
+}
+
+float ResolutionScaler::Quantize(float scale) {
+	float quantized = floorf(scale / ScaleStep + 0.001f) * ScaleStep;
+
+	return std::max(quantized, ScaleStep);
+}
+
+VkExtent2D ResolutionScaler::ScaleExtent(VkExtent2D extent, float scale) {
+	VkExtent2D scaled;
+
+	scaled.width = std::max(static_cast<uint32_t>(extent.width * scale + 0.5f), 1u);
+	scaled.height = std::max(static_cast<uint32_t>(extent.height * scale + 0.5f), 1u);
+
+	return scaled;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+
+// Picks the render resolution scale from measured GPU frame times so a frame stays within a fixed budget.
+// Samples are smoothed, the scale drops after a few frames over budget and only rises after a longer run
+// with headroom, and every change is followed by a cooldown while frames recorded at the old scale drain.
+// Scales are quantized to ScaleStep so the command buffers are re-recorded only when the step changes.
+class ResolutionScaler
+{
+public:
+	ResolutionScaler();
+	~ResolutionScaler();
+
+	void Init(float, float, float);
+	bool Update(float);
+	float GetScale();
+	VkExtent2D GetRenderExtent(VkExtent2D);
+	VkExtent2D GetMaxExtent(VkExtent2D);
+
+	static constexpr float ScaleStep = 0.05f;
+
+private:
+	float Quantize(float);
+	static VkExtent2D ScaleExtent(VkExtent2D, float);
+
+	float m_MinScale = 0.5f;
+	float m_MaxScale = 1.0f;
+	float m_TargetTime = 16.0f;
+	float m_Scale = 1.0f;
+	float m_AverageTime = 0.0f;
+	uint32_t m_OverBudgetFrames = 0;
+	uint32_t m_UnderBudgetFrames = 0;
+	uint32_t m_Cooldown = 0;
+};
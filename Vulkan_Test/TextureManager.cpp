@@ -0,0 +1,463 @@
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include "TextureManager.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdexcept>
+#include <filesystem>
+#include <chrono>
+#include <array>
+
+TextureManager::TextureManager()
+{
+}
+
+TextureManager::~TextureManager()
+{
+	this->Destroy();
+}
+
+bool TextureManager::Init(VkDevice device, MemoryAllocator* allocator, UploadManager* uploadManager, ThreadPool* threadPool, uint32_t bindlessCapacity) {
+	this->m_Device = device;
+	this->m_Allocator = allocator;
+	this->m_UploadManager = uploadManager;
+	this->m_ThreadPool = threadPool;
+	this->m_CanBlitRgba = allocator->IsFormatSupported(VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT);
+
+	if (bindlessCapacity > 0 && !CreateBindlessTable(bindlessCapacity)) {
+		return false;
+	}
+
+	// The placeholder is a single grey texel, it goes out with the first upload batch so it is usable from the first frame
+	DecodedImage placeholder;
+	const uint8_t grey[4] = { 128, 128, 128, 255 };
+
+	placeholder.format = VK_FORMAT_R8G8B8A8_UNORM;
+	placeholder.width = 1;
+	placeholder.height = 1;
+	placeholder.levels.resize(1);
+	placeholder.levels[0].size = sizeof(grey);
+	placeholder.levels[0].width = 1;
+	placeholder.levels[0].height = 1;
+	placeholder.data.assign(grey, grey + sizeof(grey));
+
+	this->m_Textures.resize(1);
+	this->m_Textures[PlaceholderTexture].path = "placeholder";
+
+	CreateTextureImage(this->m_Textures[PlaceholderTexture], placeholder);
+	this->m_Textures[PlaceholderTexture].view = this->m_Allocator->CreateImageView(this->m_Textures[PlaceholderTexture].image, this->m_Textures[PlaceholderTexture].format, VK_IMAGE_ASPECT_COLOR_BIT, this->m_Textures[PlaceholderTexture].mipLevels);
+	this->m_Textures[PlaceholderTexture].state = TextureState::Resident;
+	WriteBindlessSlot(PlaceholderTexture);
+
+	return true;
+}
+
+void TextureManager::Destroy() {
+	if (this->m_Device == VK_NULL_HANDLE) {
+		return;
+	}
+
+	// Workers hold a pointer back to this manager, and in-flight uploads still write the images
+	for (auto& job : this->m_Jobs) {
+		job.wait();
+	}
+
+	for (TextureHandle handle : this->m_Uploading) {
+		this->m_UploadManager->Wait(this->m_Textures[handle].uploadTicket);
+	}
+
+	for (auto& texture : this->m_Textures) {
+		if (texture.view != VK_NULL_HANDLE) {
+			vkDestroyImageView(this->m_Device, texture.view, nullptr);
+		}
+
+		if (texture.image != VK_NULL_HANDLE) {
+			vkDestroyImage(this->m_Device, texture.image, nullptr);
+			this->m_Allocator->Free(texture.memory);
+		}
+	}
+
+	if (this->m_BindlessPool != VK_NULL_HANDLE) {
+		vkDestroyDescriptorPool(this->m_Device, this->m_BindlessPool, nullptr);
+		vkDestroyDescriptorSetLayout(this->m_Device, this->m_BindlessSetLayout, nullptr);
+	}
+
+	this->m_BindlessPool = VK_NULL_HANDLE;
+	this->m_BindlessSetLayout = VK_NULL_HANDLE;
+	this->m_BindlessSet = VK_NULL_HANDLE;
+	this->m_BindlessCapacity = 0;
+	this->m_Jobs.clear();
+	this->m_Uploading.clear();
+	this->m_Textures.clear();
+	this->m_Decoded.clear();
+	this->m_Device = VK_NULL_HANDLE;
+}
+
+TextureHandle TextureManager::Load(const std::string& path) {
+	TextureHandle handle = static_cast<TextureHandle>(this->m_Textures.size());
+
+	this->m_Textures.emplace_back();
+	this->m_Textures[handle].path = path;
+
+	this->m_Jobs.push_back(this->m_ThreadPool->Submit([this, handle, path]() {
+		Decode(handle, path);
+	}));
+
+	return handle;
+}
+
+void TextureManager::Decode(TextureHandle handle, const std::string& path) {
+	DecodedImage decoded;
+
+	decoded.handle = handle;
+
+	if (std::filesystem::path(path).extension() == ".ktx2") {
+		decoded.failed = !DecodeKtx(path, decoded);
+	}
+	else {
+		decoded.failed = !DecodeImage(path, decoded);
+	}
+
+	std::lock_guard<std::mutex> lock(this->m_DecodedMutex);
+	this->m_Decoded.push_back(std::move(decoded));
+}
+
+bool TextureManager::DecodeKtx(const std::string& path, DecodedImage& decoded) {
+	KtxTexture texture;
+
+	if (!texture.Load(path)) {
+		return false;
+	}
+
+	// BC, ETC2 and ASTC are each optional, the format properties only report them when the feature exists
+	if (!this->m_Allocator->IsFormatSupported(texture.GetFormat(), VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) {
+		printf("%s uses format %d which this device cannot sample\n", path.c_str(), static_cast<int>(texture.GetFormat()));
+		return false;
+	}
+
+	decoded.format = texture.GetFormat();
+	decoded.width = texture.GetWidth();
+	decoded.height = texture.GetHeight();
+	decoded.levels = texture.GetLevels();
+	decoded.data = texture.GetData();
+	decoded.mipLevels = static_cast<uint32_t>(decoded.levels.size());
+
+	return true;
+}
+
+bool TextureManager::DecodeImage(const std::string& path, DecodedImage& decoded) {
+	int width;
+	int height;
+	int channels;
+	stbi_uc* pixels = stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+
+	if (!pixels) {
+		printf("Failed to decode %s\n", path.c_str());
+		return false;
+	}
+
+	decoded.format = VK_FORMAT_R8G8B8A8_UNORM;
+	decoded.width = static_cast<uint32_t>(width);
+	decoded.height = static_cast<uint32_t>(height);
+	decoded.mipLevels = MipChain::CountLevels(decoded.width, decoded.height);
+
+	// With linear blits only level 0 is uploaded and the GPU fills in the rest of the chain
+	if (this->m_CanBlitRgba) {
+		decoded.blitMips = true;
+		decoded.levels.resize(1);
+		decoded.levels[0].size = static_cast<size_t>(width) * height * 4;
+		decoded.levels[0].width = decoded.width;
+		decoded.levels[0].height = decoded.height;
+		decoded.data.assign(pixels, pixels + decoded.levels[0].size);
+	}
+	else {
+		MipChain mipChain;
+
+		mipChain.Build(pixels, decoded.width, decoded.height, *this->m_ThreadPool);
+		decoded.levels = mipChain.GetLevels();
+		decoded.data = mipChain.GetData();
+	}
+
+	stbi_image_free(pixels);
+
+	return true;
+}
+
+bool TextureManager::Update() {
+	std::deque<DecodedImage> ready;
+	VkDeviceSize budget = 0;
+	bool becameResident = false;
+
+	// At least one image goes out per call so a texture larger than the budget still makes progress
+	{
+		std::lock_guard<std::mutex> lock(this->m_DecodedMutex);
+
+		while (!this->m_Decoded.empty() && (ready.empty() || budget + this->m_Decoded.front().data.size() <= UploadBudgetPerUpdate)) {
+			budget += this->m_Decoded.front().data.size();
+			ready.push_back(std::move(this->m_Decoded.front()));
+			this->m_Decoded.pop_front();
+		}
+	}
+
+	std::vector<TextureHandle> submitted;
+
+	for (auto& decoded : ready) {
+		Texture& texture = this->m_Textures[decoded.handle];
+
+		if (decoded.failed) {
+			texture.state = TextureState::Failed;
+			continue;
+		}
+
+		CreateTextureImage(texture, decoded);
+		texture.state = TextureState::Uploading;
+		submitted.push_back(decoded.handle);
+	}
+
+	if (!submitted.empty()) {
+		uint64_t ticket = this->m_UploadManager->Submit();
+
+		for (TextureHandle handle : submitted) {
+			this->m_Textures[handle].uploadTicket = ticket;
+			this->m_Uploading.push_back(handle);
+		}
+	}
+
+	for (size_t i = 0; i < this->m_Jobs.size();) {
+		if (this->m_Jobs[i].wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+			i++;
+			continue;
+		}
+
+		this->m_Jobs[i] = std::move(this->m_Jobs.back());
+		this->m_Jobs.pop_back();
+	}
+
+	for (size_t i = 0; i < this->m_Uploading.size();) {
+		Texture& texture = this->m_Textures[this->m_Uploading[i]];
+
+		if (!this->m_UploadManager->IsComplete(texture.uploadTicket)) {
+			i++;
+			continue;
+		}
+
+		texture.view = this->m_Allocator->CreateImageView(texture.image, texture.format, VK_IMAGE_ASPECT_COLOR_BIT, texture.mipLevels);
+		texture.state = TextureState::Resident;
+		WriteBindlessSlot(this->m_Uploading[i]);
+		becameResident = true;
+
+		this->m_Uploading[i] = this->m_Uploading.back();
+		this->m_Uploading.pop_back();
+	}
+
+	return becameResident;
+}
+
+VkImageView TextureManager::GetImageView(TextureHandle handle) {
+	if (handle >= this->m_Textures.size() || this->m_Textures[handle].state != TextureState::Resident) {
+		return this->m_Textures[PlaceholderTexture].view;
+	}
+
+	return this->m_Textures[handle].view;
+}
+
+uint32_t TextureManager::GetBindlessIndex(TextureHandle handle) {
+	if (handle >= this->m_BindlessCapacity || this->m_Textures[handle].state != TextureState::Resident) {
+		return PlaceholderTexture;
+	}
+
+	return handle;
+}
+
+bool TextureManager::IsBindless() {
+	return this->m_BindlessSet != VK_NULL_HANDLE;
+}
+
+VkDescriptorSetLayout TextureManager::GetBindlessSetLayout() {
+	return this->m_BindlessSetLayout;
+}
+
+VkDescriptorSet TextureManager::GetBindlessSet() {
+	return this->m_BindlessSet;
+}
+
+TextureState TextureManager::GetState(TextureHandle handle) {
+	return this->m_Textures[handle].state;
+}
+
+size_t TextureManager::GetTextureCount() {
+	return this->m_Textures.size();
+}
+
+void TextureManager::CreateTextureImage(Texture& texture, const DecodedImage& decoded) {
+	VkImageCreateInfo imageInfo = {};
+	VkMemoryRequirements memRequirements;
+
+	texture.format = decoded.format;
+	texture.mipLevels = decoded.mipLevels;
+
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.extent.width = decoded.width;
+	imageInfo.extent.height = decoded.height;
+	imageInfo.extent.depth = 1;
+	imageInfo.mipLevels = decoded.mipLevels;
+	imageInfo.arrayLayers = 1;
+	imageInfo.format = decoded.format;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | (decoded.blitMips ? VK_IMAGE_USAGE_TRANSFER_SRC_BIT : 0);
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	if (vkCreateImage(this->m_Device, &imageInfo, nullptr, &texture.image) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create image!");
+	}
+
+	vkGetImageMemoryRequirements(this->m_Device, texture.image, &memRequirements);
+
+	uint32_t memoryType = this->m_Allocator->FindMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	bool dedicated = memRequirements.size >= MemoryAllocator::DedicatedImageThreshold;
+
+	if (!this->m_Allocator->Allocate(memRequirements, memoryType, false, dedicated, texture.memory)) {
+		throw std::runtime_error("failed to allocate image memory!");
+	}
+
+	vkBindImageMemory(this->m_Device, texture.image, texture.memory.memory, texture.memory.offset);
+
+	if (decoded.blitMips) {
+		this->m_UploadManager->UploadImageAndBlitMips(texture.image, decoded.width, decoded.height, decoded.mipLevels, decoded.data.data(), decoded.data.size(), VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+	}
+	else {
+		this->m_UploadManager->UploadImage(texture.image, decoded.levels, decoded.data.data(), decoded.data.size(), VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+	}
+}
+
+// Binding 0 is the texture array, binding 1 the one sampler every slot is read with
+bool TextureManager::CreateBindlessTable(uint32_t capacity) {
+#ifdef VK_EXT_descriptor_indexing
+	std::array<VkDescriptorSetLayoutBinding, 2> bindings = {};
+
+	bindings[0].binding = 0;
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+	bindings[0].descriptorCount = capacity;
+	bindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	bindings[1].binding = 1;
+	bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+	bindings[1].descriptorCount = 1;
+	bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	// Slots are filled as textures arrive and may be written while other frames are still executing
+	std::array<VkDescriptorBindingFlagsEXT, 2> bindingFlags = {};
+
+	bindingFlags[0] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT;
+	bindingFlags[1] = 0;
+
+	VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsInfo = {};
+
+	bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+	bindingFlagsInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+	bindingFlagsInfo.pBindingFlags = bindingFlags.data();
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.pNext = &bindingFlagsInfo;
+	layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+
+	if (vkCreateDescriptorSetLayout(this->m_Device, &layoutInfo, nullptr, &this->m_BindlessSetLayout) != VK_SUCCESS) {
+		return false;
+	}
+
+	std::array<VkDescriptorPoolSize, 2> poolSizes = {};
+
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+	poolSizes[0].descriptorCount = capacity;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_SAMPLER;
+	poolSizes[1].descriptorCount = 1;
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+	poolInfo.maxSets = 1;
+
+	if (vkCreateDescriptorPool(this->m_Device, &poolInfo, nullptr, &this->m_BindlessPool) != VK_SUCCESS) {
+		return false;
+	}
+
+	VkDescriptorSetAllocateInfo allocInfo = {};
+
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = this->m_BindlessPool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &this->m_BindlessSetLayout;
+
+	if (vkAllocateDescriptorSets(this->m_Device, &allocInfo, &this->m_BindlessSet) != VK_SUCCESS) {
+		return false;
+	}
+
+	this->m_BindlessCapacity = capacity;
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+void TextureManager::SetBindlessSampler(VkSampler sampler) {
+	if (!IsBindless()) {
+		return;
+	}
+
+	VkDescriptorImageInfo imageInfo = {};
+
+	imageInfo.sampler = sampler;
+
+	VkWriteDescriptorSet descriptorWrite = {};
+
+	descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrite.dstSet = this->m_BindlessSet;
+	descriptorWrite.dstBinding = 1;
+	descriptorWrite.dstArrayElement = 0;
+	descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+	descriptorWrite.descriptorCount = 1;
+	descriptorWrite.pImageInfo = &imageInfo;
+
+	vkUpdateDescriptorSets(this->m_Device, 1, &descriptorWrite, 0, nullptr);
+}
+
+void TextureManager::WriteBindlessSlot(TextureHandle handle) {
+	if (!IsBindless()) {
+		return;
+	}
+
+	if (handle >= this->m_BindlessCapacity) {
+		printf("%s does not fit in the %u slot texture table and will draw as the placeholder\n", this->m_Textures[handle].path.c_str(), this->m_BindlessCapacity);
+		return;
+	}
+
+	VkDescriptorImageInfo imageInfo = {};
+
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	imageInfo.imageView = this->m_Textures[handle].view;
+
+	VkWriteDescriptorSet descriptorWrite = {};
+
+	descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrite.dstSet = this->m_BindlessSet;
+	descriptorWrite.dstBinding = 0;
+	descriptorWrite.dstArrayElement = handle;
+	descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+	descriptorWrite.descriptorCount = 1;
+	descriptorWrite.pImageInfo = &imageInfo;
+
+	vkUpdateDescriptorSets(this->m_Device, 1, &descriptorWrite, 0, nullptr);
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <future>
+
+#include "MemoryAllocator.h"
+#include "UploadManager.h"
+#include "ThreadPool.h"
+#include "MipChain.h"
+#include "KtxTexture.h"
+
+typedef uint32_t TextureHandle;
+
+enum class TextureState : uint32_t {
+	Decoding,
+	Uploading,
+	Resident,
+	Failed
+};
+
+// Loads textures in the background. Load() returns a handle at once and queues the file on the
+// thread pool, where it is decoded (stb_image or KTX2) and, if the device cannot blit the format,
+// given a CPU mip chain. Update() runs on the render thread: it hands finished decodes to the
+// UploadManager within a per-call byte budget and promotes textures whose upload has completed.
+// Until then GetImageView() returns the placeholder, so callers can bind a handle straight away.
+// With a bindless capacity the manager also owns one update-after-bind table of sampled images:
+// slot N holds texture handle N once it is resident, and GetBindlessIndex() resolves to slot 0
+// (the placeholder) before that, so a slot is never rewritten while a recorded draw can read it.
+class TextureManager
+{
+public:
+	static constexpr TextureHandle PlaceholderTexture = 0;
+	static constexpr VkDeviceSize UploadBudgetPerUpdate = 32ull * 1024 * 1024;
+
+	TextureManager();
+	~TextureManager();
+
+	bool Init(VkDevice, MemoryAllocator*, UploadManager*, ThreadPool*, uint32_t bindlessCapacity = 0);
+	void Destroy();
+	TextureHandle Load(const std::string&);
+	bool Update();
+	void SetBindlessSampler(VkSampler);
+	VkImageView GetImageView(TextureHandle);
+	uint32_t GetBindlessIndex(TextureHandle);
+	bool IsBindless();
+	VkDescriptorSetLayout GetBindlessSetLayout();
+	VkDescriptorSet GetBindlessSet();
+	TextureState GetState(TextureHandle);
+	size_t GetTextureCount();
+
+private:
+	struct Texture {
+		std::string path;
+		TextureState state = TextureState::Decoding;
+		VkImage image = VK_NULL_HANDLE;
+		Allocation memory;
+		VkImageView view = VK_NULL_HANDLE;
+		VkFormat format = VK_FORMAT_UNDEFINED;
+		uint32_t mipLevels = 1;
+		uint64_t uploadTicket = 0;
+	};
+
+	struct DecodedImage {
+		TextureHandle handle = 0;
+		bool failed = false;
+		bool blitMips = false;
+		VkFormat format = VK_FORMAT_UNDEFINED;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t mipLevels = 1;
+		std::vector<MipLevel> levels;
+		std::vector<uint8_t> data;
+	};
+
+	void Decode(TextureHandle, const std::string&);
+	bool DecodeKtx(const std::string&, DecodedImage&);
+	bool DecodeImage(const std::string&, DecodedImage&);
+	void CreateTextureImage(Texture&, const DecodedImage&);
+	bool CreateBindlessTable(uint32_t);
+	void WriteBindlessSlot(TextureHandle);
+
+	VkDevice m_Device = VK_NULL_HANDLE;
+	MemoryAllocator* m_Allocator = nullptr;
+	UploadManager* m_UploadManager = nullptr;
+	ThreadPool* m_ThreadPool = nullptr;
+	bool m_CanBlitRgba = false;
+
+	uint32_t m_BindlessCapacity = 0;
+	VkDescriptorSetLayout m_BindlessSetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool m_BindlessPool = VK_NULL_HANDLE;
+	VkDescriptorSet m_BindlessSet = VK_NULL_HANDLE;
+
+	// Only touched by the render thread
+	std::vector<Texture> m_Textures;
+	std::vector<TextureHandle> m_Uploading;
+	std::vector<std::future<void>> m_Jobs;
+
+	// Filled by the workers, drained by Update()
+	std::mutex m_DecodedMutex;
+	std::deque<DecodedImage> m_Decoded;
+};
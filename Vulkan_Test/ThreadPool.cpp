@@ -0,0 +1,167 @@
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+// Chunks are claimed from a shared counter by the caller and by helper jobs alike. The state is shared with
+// the helpers, so one that only starts after the call returned finds nothing left and never touches the body
+struct ParallelForState {
+	const std::function<void(size_t, size_t)>* body = nullptr;
+	size_t count = 0;
+	size_t chunkCount = 0;
+	size_t chunkSize = 0;
+	std::atomic<size_t> nextChunk{ 0 };
+	std::atomic<bool> cancelled{ false };
+	std::mutex mutex;
+	std::condition_variable finishedChunk;
+	size_t finished = 0;
+	std::exception_ptr error;
+};
+
+static void RunChunks(ParallelForState& state) {
+	for (size_t chunk = state.nextChunk++; chunk < state.chunkCount; chunk = state.nextChunk++) {
+		// After a throw the remaining chunks are still claimed and counted, only their bodies are skipped
+		if (!state.cancelled) {
+			try {
+				size_t begin = chunk * state.chunkSize;
+
+				(*state.body)(begin, std::min(begin + state.chunkSize, state.count));
+			}
+			catch (...) {
+				std::lock_guard<std::mutex> lock(state.mutex);
+
+				if (!state.error) {
+					state.error = std::current_exception();
+				}
+
+				state.cancelled = true;
+			}
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(state.mutex);
+			state.finished++;
+		}
+
+		state.finishedChunk.notify_all();
+	}
+}
+
+// The pool a worker thread belongs to, a nested ParallelFor on that pool runs inline rather than waiting on its own queue
+static thread_local ThreadPool* s_WorkerPool = nullptr;
+
+ThreadPool::ThreadPool()
+{
+}
+
+ThreadPool::~ThreadPool()
+{
+	this->Stop();
+}
+
+void ThreadPool::Start(size_t threadCount) {
+	// hardware_concurrency may report 0, one worker still lets Submit make progress
+	threadCount = std::max<size_t>(threadCount, 1);
+
+	this->m_Stopping = false;
+
+	for (size_t i = 0; i < threadCount; i++) {
+		this->m_Workers.emplace_back(&ThreadPool::WorkerLoop, this);
+	}
+}
+
+void ThreadPool::Stop() {
+	{
+		std::lock_guard<std::mutex> lock(this->m_Mutex);
+		this->m_Stopping = true;
+	}
+
+	this->m_JobAvailable.notify_all();
+
+	for (auto& worker : this->m_Workers) {
+		worker.join();
+	}
+
+	this->m_Workers.clear();
+}
+
+size_t ThreadPool::GetThreadCount() {
+	return this->m_Workers.size();
+}
+
+std::future<void> ThreadPool::Submit(std::function<void()> job) {
+	std::packaged_task<void()> task(std::move(job));
+	std::future<void> result = task.get_future();
+
+	// Without workers the job runs inline so callers never wait on a future that cannot complete
+	if (this->m_Workers.empty()) {
+		task();
+		return result;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(this->m_Mutex);
+		this->m_Jobs.push_back(std::move(task));
+	}
+
+	this->m_JobAvailable.notify_one();
+
+	return result;
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t, size_t)>& body) {
+	size_t chunkCount = std::min(count, std::max<size_t>(this->m_Workers.size(), 1));
+
+	if (chunkCount <= 1 || s_WorkerPool == this) {
+		body(0, count);
+		return;
+	}
+
+	auto state = std::make_shared<ParallelForState>();
+
+	state->body = &body;
+	state->count = count;
+	state->chunkSize = (count + chunkCount - 1) / chunkCount;
+	state->chunkCount = (count + state->chunkSize - 1) / state->chunkSize;
+
+	for (size_t i = 1; i < state->chunkCount; i++) {
+		Submit([state]() { RunChunks(*state); });
+	}
+
+	// The caller works through every chunk no worker has started, so jobs queued ahead of the helpers
+	// (texture decodes) never hold it up, it only waits for chunks that are already running
+	RunChunks(*state);
+
+	std::unique_lock<std::mutex> lock(state->mutex);
+
+	state->finishedChunk.wait(lock, [&state]() { return state->finished == state->chunkCount; });
+
+	if (state->error) {
+		std::rethrow_exception(state->error);
+	}
+}
+
+void ThreadPool::WorkerLoop() {
+	s_WorkerPool = this;
+
+	while (true) {
+		std::packaged_task<void()> job;
+
+		{
+			std::unique_lock<std::mutex> lock(this->m_Mutex);
+
+			this->m_JobAvailable.wait(lock, [this]() { return this->m_Stopping || !this->m_Jobs.empty(); });
+
+			if (this->m_Jobs.empty()) {
+				return;
+			}
+
+			job = std::move(this->m_Jobs.front());
+			this->m_Jobs.pop_front();
+		}
+
+		job();
+	}
+}
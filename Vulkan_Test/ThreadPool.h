@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+
+// A fixed set of worker threads fed from one shared queue. Submit() hands back a future for the job,
+// ParallelFor() splits an index range into one chunk per worker and blocks until every chunk is done; the
+// caller runs any chunk no worker has picked up yet, so it never waits behind unrelated queued jobs.
+// Called from one of the pool's own workers, ParallelFor() runs the whole range on that worker, since
+// waiting there on chunks queued behind it could deadlock once every worker is doing the same.
+class ThreadPool
+{
+public:
+	ThreadPool();
+	~ThreadPool();
+
+	void Start(size_t);
+	void Stop();
+	size_t GetThreadCount();
+	std::future<void> Submit(std::function<void()>);
+	void ParallelFor(size_t, const std::function<void(size_t, size_t)>&);
+
+private:
+	void WorkerLoop();
+
+	std::vector<std::thread> m_Workers;
+	std::deque<std::packaged_task<void()>> m_Jobs;
+	std::mutex m_Mutex;
+	std::condition_variable m_JobAvailable;
+	bool m_Stopping = false;
+};
@@ -0,0 +1,523 @@
+
+#include "UploadManager.h"
+
+#include <string.h>
+#include <stdexcept>
+#include <limits>
+
+UploadManager::UploadManager()
+{
+}
+
+UploadManager::~UploadManager()
+{
+	this->Destroy();
+}
+
+bool UploadManager::Init(VkDevice device, MemoryAllocator* allocator, uint32_t graphicsFamily, VkQueue graphicsQueue, uint32_t transferFamily, VkQueue transferQueue) {
+	this->m_Device = device;
+	this->m_Allocator = allocator;
+	this->m_GraphicsFamily = graphicsFamily;
+	this->m_GraphicsQueue = graphicsQueue;
+	this->m_TransferFamily = transferFamily;
+	this->m_TransferQueue = transferQueue;
+
+	VkCommandPoolCreateInfo poolInfo = {};
+
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.queueFamilyIndex = transferFamily;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+	if (vkCreateCommandPool(this->m_Device, &poolInfo, nullptr, &this->m_TransferPool) != VK_SUCCESS) {
+		return false;
+	}
+
+	if (HasDedicatedTransferQueue()) {
+		poolInfo.queueFamilyIndex = graphicsFamily;
+
+		if (vkCreateCommandPool(this->m_Device, &poolInfo, nullptr, &this->m_GraphicsPool) != VK_SUCCESS) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void UploadManager::Destroy() {
+	if (this->m_Device == VK_NULL_HANDLE) {
+		return;
+	}
+
+	for (auto batch : this->m_InFlight) {
+		vkWaitForFences(this->m_Device, 1, &batch->fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+	}
+
+	Update();
+
+	if (this->m_Open != nullptr) {
+		for (auto& staging : this->m_Open->staging) {
+			vkDestroyBuffer(this->m_Device, staging.buffer, nullptr);
+			this->m_Allocator->Free(staging.memory);
+		}
+	}
+
+	for (auto batch : this->m_All) {
+		vkDestroyFence(this->m_Device, batch->fence, nullptr);
+
+		if (batch->transferDone != VK_NULL_HANDLE) {
+			vkDestroySemaphore(this->m_Device, batch->transferDone, nullptr);
+		}
+
+		delete batch;
+	}
+
+	if (this->m_GraphicsPool != VK_NULL_HANDLE) {
+		vkDestroyCommandPool(this->m_Device, this->m_GraphicsPool, nullptr);
+	}
+
+	vkDestroyCommandPool(this->m_Device, this->m_TransferPool, nullptr);
+
+	this->m_All.clear();
+	this->m_Free.clear();
+	this->m_Open = nullptr;
+	this->m_Device = VK_NULL_HANDLE;
+}
+
+bool UploadManager::HasDedicatedTransferQueue() {
+	return this->m_TransferFamily != this->m_GraphicsFamily;
+}
+
+bool UploadManager::OpenBatch() {
+	if (this->m_Open != nullptr) {
+		return true;
+	}
+
+	if (!this->m_Free.empty()) {
+		this->m_Open = this->m_Free.back();
+		this->m_Free.pop_back();
+		return true;
+	}
+
+	Batch* batch = new Batch();
+	VkCommandBufferAllocateInfo allocInfo = {};
+	VkFenceCreateInfo fenceInfo = {};
+
+	this->m_All.push_back(batch);
+
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.commandPool = this->m_TransferPool;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandBufferCount = 1;
+
+	if (vkAllocateCommandBuffers(this->m_Device, &allocInfo, &batch->transferCommands) != VK_SUCCESS) {
+		return false;
+	}
+
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+	if (vkCreateFence(this->m_Device, &fenceInfo, nullptr, &batch->fence) != VK_SUCCESS) {
+		return false;
+	}
+
+	if (HasDedicatedTransferQueue()) {
+		VkSemaphoreCreateInfo semaphoreInfo = {};
+
+		allocInfo.commandPool = this->m_GraphicsPool;
+
+		if (vkAllocateCommandBuffers(this->m_Device, &allocInfo, &batch->graphicsCommands) != VK_SUCCESS) {
+			return false;
+		}
+
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+		if (vkCreateSemaphore(this->m_Device, &semaphoreInfo, nullptr, &batch->transferDone) != VK_SUCCESS) {
+			return false;
+		}
+	}
+
+	this->m_Open = batch;
+
+	return true;
+}
+
+UploadManager::Staging UploadManager::CreateStaging(const void* data, VkDeviceSize size) {
+	Staging staging = {};
+	VkBufferCreateInfo bufferInfo = {};
+	VkMemoryRequirements memRequirements;
+
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = size;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	if (vkCreateBuffer(this->m_Device, &bufferInfo, nullptr, &staging.buffer) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create staging buffer!");
+	}
+
+	vkGetBufferMemoryRequirements(this->m_Device, staging.buffer, &memRequirements);
+
+	if (!this->m_Allocator->Allocate(memRequirements, this->m_Allocator->FindMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT), true, false, staging.memory)) {
+		throw std::runtime_error("Failed to allocate staging memory!");
+	}
+
+	vkBindBufferMemory(this->m_Device, staging.buffer, staging.memory.memory, staging.memory.offset);
+	memcpy(staging.memory.mapped, data, static_cast<size_t>(size));
+
+	return staging;
+}
+
+void UploadManager::UploadBuffer(VkBuffer dst, VkDeviceSize dstOffset, const void* data, VkDeviceSize size, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+	if (!OpenBatch()) {
+		throw std::runtime_error("Failed to open upload batch!");
+	}
+
+	Staging staging = CreateStaging(data, size);
+	BufferCopy copy = {};
+	VkBufferMemoryBarrier barrier = {};
+
+	this->m_Open->staging.push_back(staging);
+
+	copy.src = staging.buffer;
+	copy.dst = dst;
+	copy.region.srcOffset = 0;
+	copy.region.dstOffset = dstOffset;
+	copy.region.size = size;
+	this->m_BufferCopies.push_back(copy);
+
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.buffer = dst;
+	barrier.offset = dstOffset;
+	barrier.size = size;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+	if (HasDedicatedTransferQueue()) {
+		barrier.srcQueueFamilyIndex = this->m_TransferFamily;
+		barrier.dstQueueFamilyIndex = this->m_GraphicsFamily;
+		barrier.dstAccessMask = 0;
+		this->m_ReleaseBufferBarriers.push_back(barrier);
+
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = dstAccess;
+		this->m_AcquireBufferBarriers.push_back(barrier);
+	}
+	else {
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstAccessMask = dstAccess;
+		this->m_ReleaseBufferBarriers.push_back(barrier);
+	}
+
+	this->m_DstStages |= dstStage;
+}
+
+void UploadManager::QueueImageCopies(VkImage image, const std::vector<MipLevel>& levels, const void* data, VkDeviceSize size) {
+	if (!OpenBatch()) {
+		throw std::runtime_error("Failed to open upload batch!");
+	}
+
+	Staging staging = CreateStaging(data, size);
+	VkImageMemoryBarrier barrier = {};
+
+	this->m_Open->staging.push_back(staging);
+
+	// Levels that are blitted later are moved to TRANSFER_DST here as well, they only leave it once written
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.image = image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	this->m_PreCopyBarriers.push_back(barrier);
+
+	for (uint32_t i = 0; i < levels.size(); i++) {
+		ImageCopy copy = {};
+
+		copy.src = staging.buffer;
+		copy.dst = image;
+		copy.region.bufferOffset = levels[i].offset;
+		copy.region.bufferRowLength = 0;
+		copy.region.bufferImageHeight = 0;
+		copy.region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		copy.region.imageSubresource.mipLevel = i;
+		copy.region.imageSubresource.baseArrayLayer = 0;
+		copy.region.imageSubresource.layerCount = 1;
+		copy.region.imageOffset = { 0, 0, 0 };
+		copy.region.imageExtent = { levels[i].width, levels[i].height, 1 };
+		this->m_ImageCopies.push_back(copy);
+	}
+}
+
+void UploadManager::UploadImage(VkImage image, const std::vector<MipLevel>& levels, const void* data, VkDeviceSize size, VkPipelineStageFlags dstStage) {
+	QueueImageCopies(image, levels, data, size);
+
+	VkImageMemoryBarrier barrier = {};
+
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.image = image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+	if (HasDedicatedTransferQueue()) {
+		barrier.srcQueueFamilyIndex = this->m_TransferFamily;
+		barrier.dstQueueFamilyIndex = this->m_GraphicsFamily;
+		barrier.dstAccessMask = 0;
+		this->m_ReleaseImageBarriers.push_back(barrier);
+
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		this->m_AcquireImageBarriers.push_back(barrier);
+	}
+	else {
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		this->m_ReleaseImageBarriers.push_back(barrier);
+	}
+
+	this->m_DstStages |= dstStage;
+}
+
+void UploadManager::UploadImageAndBlitMips(VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels, const void* data, VkDeviceSize size, VkPipelineStageFlags dstStage) {
+	std::vector<MipLevel> baseLevel(1);
+
+	baseLevel[0].size = static_cast<size_t>(size);
+	baseLevel[0].width = width;
+	baseLevel[0].height = height;
+
+	QueueImageCopies(image, baseLevel, data, size);
+
+	// The whole chain changes family still in TRANSFER_DST, the blits then happen after the acquire
+	if (HasDedicatedTransferQueue()) {
+		VkImageMemoryBarrier barrier = {};
+
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.image = image;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = mipLevels;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = 1;
+		barrier.srcQueueFamilyIndex = this->m_TransferFamily;
+		barrier.dstQueueFamilyIndex = this->m_GraphicsFamily;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = 0;
+		this->m_ReleaseImageBarriers.push_back(barrier);
+
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+		this->m_AcquireImageBarriers.push_back(barrier);
+	}
+
+	MipBlit blit = {};
+
+	blit.image = image;
+	blit.width = width;
+	blit.height = height;
+	blit.mipLevels = mipLevels;
+	blit.dstStage = dstStage;
+	this->m_MipBlits.push_back(blit);
+
+	this->m_DstStages |= dstStage | VK_PIPELINE_STAGE_TRANSFER_BIT;
+}
+
+void UploadManager::RecordMipBlits(VkCommandBuffer commandBuffer) {
+	for (const auto& mip : this->m_MipBlits) {
+		VkImageMemoryBarrier barrier = {};
+		int32_t mipWidth = static_cast<int32_t>(mip.width);
+		int32_t mipHeight = static_cast<int32_t>(mip.height);
+
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.image = mip.image;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.levelCount = 1;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = 1;
+
+		// Each level is read once to produce the next one and is handed to the shaders right after
+		for (uint32_t i = 1; i < mip.mipLevels; i++) {
+			VkImageBlit blit = {};
+
+			barrier.subresourceRange.baseMipLevel = i - 1;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+			blit.srcOffsets[0] = { 0, 0, 0 };
+			blit.srcOffsets[1] = { mipWidth, mipHeight, 1 };
+			blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			blit.srcSubresource.mipLevel = i - 1;
+			blit.srcSubresource.baseArrayLayer = 0;
+			blit.srcSubresource.layerCount = 1;
+
+			mipWidth = mipWidth > 1 ? mipWidth / 2 : 1;
+			mipHeight = mipHeight > 1 ? mipHeight / 2 : 1;
+
+			blit.dstOffsets[0] = { 0, 0, 0 };
+			blit.dstOffsets[1] = { mipWidth, mipHeight, 1 };
+			blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			blit.dstSubresource.mipLevel = i;
+			blit.dstSubresource.baseArrayLayer = 0;
+			blit.dstSubresource.layerCount = 1;
+
+			vkCmdBlitImage(commandBuffer, mip.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, mip.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+			barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, mip.dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+		}
+
+		barrier.subresourceRange.baseMipLevel = mip.mipLevels - 1;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, mip.dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	}
+}
+
+uint64_t UploadManager::Submit() {
+	if (this->m_Open == nullptr) {
+		return this->m_NextTicket - 1;
+	}
+
+	Batch* batch = this->m_Open;
+	VkCommandBufferBeginInfo beginInfo = {};
+	bool dedicated = HasDedicatedTransferQueue();
+
+	this->m_Open = nullptr;
+	batch->ticket = this->m_NextTicket++;
+
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	vkBeginCommandBuffer(batch->transferCommands, &beginInfo);
+
+	if (!this->m_PreCopyBarriers.empty()) {
+		vkCmdPipelineBarrier(batch->transferCommands, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(this->m_PreCopyBarriers.size()), this->m_PreCopyBarriers.data());
+	}
+
+	for (const auto& copy : this->m_BufferCopies) {
+		vkCmdCopyBuffer(batch->transferCommands, copy.src, copy.dst, 1, &copy.region);
+	}
+
+	for (const auto& copy : this->m_ImageCopies) {
+		vkCmdCopyBufferToImage(batch->transferCommands, copy.src, copy.dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy.region);
+	}
+
+	// On a dedicated transfer queue these are queue family releases, otherwise the final transitions
+	vkCmdPipelineBarrier(batch->transferCommands, VK_PIPELINE_STAGE_TRANSFER_BIT, dedicated ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : this->m_DstStages, 0,
+		0, nullptr,
+		static_cast<uint32_t>(this->m_ReleaseBufferBarriers.size()), this->m_ReleaseBufferBarriers.data(),
+		static_cast<uint32_t>(this->m_ReleaseImageBarriers.size()), this->m_ReleaseImageBarriers.data());
+
+	if (!dedicated) {
+		RecordMipBlits(batch->transferCommands);
+	}
+
+	vkEndCommandBuffer(batch->transferCommands);
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &batch->transferCommands;
+
+	if (dedicated) {
+		vkBeginCommandBuffer(batch->graphicsCommands, &beginInfo);
+		vkCmdPipelineBarrier(batch->graphicsCommands, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, this->m_DstStages, 0,
+			0, nullptr,
+			static_cast<uint32_t>(this->m_AcquireBufferBarriers.size()), this->m_AcquireBufferBarriers.data(),
+			static_cast<uint32_t>(this->m_AcquireImageBarriers.size()), this->m_AcquireImageBarriers.data());
+		RecordMipBlits(batch->graphicsCommands);
+		vkEndCommandBuffer(batch->graphicsCommands);
+
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &batch->transferDone;
+		vkQueueSubmit(this->m_TransferQueue, 1, &submitInfo, VK_NULL_HANDLE);
+
+		VkSubmitInfo acquireInfo = {};
+		acquireInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		acquireInfo.waitSemaphoreCount = 1;
+		acquireInfo.pWaitSemaphores = &batch->transferDone;
+		acquireInfo.pWaitDstStageMask = &this->m_DstStages;
+		acquireInfo.commandBufferCount = 1;
+		acquireInfo.pCommandBuffers = &batch->graphicsCommands;
+		vkQueueSubmit(this->m_GraphicsQueue, 1, &acquireInfo, batch->fence);
+	}
+	else {
+		vkQueueSubmit(this->m_GraphicsQueue, 1, &submitInfo, batch->fence);
+	}
+
+	this->m_BufferCopies.clear();
+	this->m_ImageCopies.clear();
+	this->m_MipBlits.clear();
+	this->m_PreCopyBarriers.clear();
+	this->m_ReleaseBufferBarriers.clear();
+	this->m_ReleaseImageBarriers.clear();
+	this->m_AcquireBufferBarriers.clear();
+	this->m_AcquireImageBarriers.clear();
+	this->m_DstStages = 0;
+	this->m_InFlight.push_back(batch);
+
+	return batch->ticket;
+}
+
+void UploadManager::Update() {
+	while (!this->m_InFlight.empty()) {
+		Batch* batch = this->m_InFlight.front();
+
+		if (vkGetFenceStatus(this->m_Device, batch->fence) != VK_SUCCESS) {
+			break;
+		}
+
+		for (auto& staging : batch->staging) {
+			vkDestroyBuffer(this->m_Device, staging.buffer, nullptr);
+			this->m_Allocator->Free(staging.memory);
+		}
+
+		batch->staging.clear();
+		vkResetFences(this->m_Device, 1, &batch->fence);
+
+		this->m_CompletedTicket = batch->ticket;
+		this->m_InFlight.pop_front();
+		this->m_Free.push_back(batch);
+	}
+}
+
+bool UploadManager::IsComplete(uint64_t ticket) {
+	Update();
+
+	return ticket <= this->m_CompletedTicket;
+}
+
+void UploadManager::Wait(uint64_t ticket) {
+	for (auto batch : this->m_InFlight) {
+		if (batch->ticket > ticket) {
+			break;
+		}
+
+		vkWaitForFences(this->m_Device, 1, &batch->fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+	}
+
+	Update();
+}
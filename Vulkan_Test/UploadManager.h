@@ -0,0 +1,98 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <deque>
+
+#include "MemoryAllocator.h"
+#include "MipChain.h"
+
+// Batches buffer and image uploads into one command buffer per submission. When the device has a
+// transfer-only queue family the copies run there and ownership is handed to the graphics family
+// with release/acquire barriers; otherwise everything is recorded on the graphics queue. Submit()
+// returns a ticket that can be polled with IsComplete() instead of waiting on the queue. Mip chains
+// can either be uploaded level by level or blitted from level 0, the blits always run on the graphics
+// queue since transfer-only queues cannot execute vkCmdBlitImage.
+class UploadManager
+{
+public:
+	UploadManager();
+	~UploadManager();
+
+	bool Init(VkDevice, MemoryAllocator*, uint32_t, VkQueue, uint32_t, VkQueue);
+	void Destroy();
+	void UploadBuffer(VkBuffer, VkDeviceSize, const void*, VkDeviceSize, VkPipelineStageFlags, VkAccessFlags);
+	void UploadImage(VkImage, const std::vector<MipLevel>&, const void*, VkDeviceSize, VkPipelineStageFlags);
+	void UploadImageAndBlitMips(VkImage, uint32_t, uint32_t, uint32_t, const void*, VkDeviceSize, VkPipelineStageFlags);
+	uint64_t Submit();
+	bool IsComplete(uint64_t);
+	void Wait(uint64_t);
+	void Update();
+	bool HasDedicatedTransferQueue();
+
+private:
+	struct Staging {
+		VkBuffer buffer;
+		Allocation memory;
+	};
+
+	struct Batch {
+		VkCommandBuffer transferCommands = VK_NULL_HANDLE;
+		VkCommandBuffer graphicsCommands = VK_NULL_HANDLE;
+		VkFence fence = VK_NULL_HANDLE;
+		VkSemaphore transferDone = VK_NULL_HANDLE;
+		uint64_t ticket = 0;
+		std::vector<Staging> staging;
+	};
+
+	struct BufferCopy {
+		VkBuffer src;
+		VkBuffer dst;
+		VkBufferCopy region;
+	};
+
+	struct ImageCopy {
+		VkBuffer src;
+		VkImage dst;
+		VkBufferImageCopy region;
+	};
+
+	struct MipBlit {
+		VkImage image;
+		uint32_t width;
+		uint32_t height;
+		uint32_t mipLevels;
+		VkPipelineStageFlags dstStage;
+	};
+
+	bool OpenBatch();
+	Staging CreateStaging(const void*, VkDeviceSize);
+	void QueueImageCopies(VkImage, const std::vector<MipLevel>&, const void*, VkDeviceSize);
+	void RecordMipBlits(VkCommandBuffer);
+
+	VkDevice m_Device = VK_NULL_HANDLE;
+	MemoryAllocator* m_Allocator = nullptr;
+	uint32_t m_GraphicsFamily = 0;
+	uint32_t m_TransferFamily = 0;
+	VkQueue m_GraphicsQueue = VK_NULL_HANDLE;
+	VkQueue m_TransferQueue = VK_NULL_HANDLE;
+	VkCommandPool m_TransferPool = VK_NULL_HANDLE;
+	VkCommandPool m_GraphicsPool = VK_NULL_HANDLE;
+
+	Batch* m_Open = nullptr;
+	std::deque<Batch*> m_InFlight;
+	std::vector<Batch*> m_Free;
+	std::vector<Batch*> m_All;
+	uint64_t m_NextTicket = 1;
+	uint64_t m_CompletedTicket = 0;
+
+	std::vector<BufferCopy> m_BufferCopies;
+	std::vector<ImageCopy> m_ImageCopies;
+	std::vector<MipBlit> m_MipBlits;
+	std::vector<VkImageMemoryBarrier> m_PreCopyBarriers;
+	std::vector<VkBufferMemoryBarrier> m_ReleaseBufferBarriers;
+	std::vector<VkImageMemoryBarrier> m_ReleaseImageBarriers;
+	std::vector<VkBufferMemoryBarrier> m_AcquireBufferBarriers;
+	std::vector<VkImageMemoryBarrier> m_AcquireImageBarriers;
+	VkPipelineStageFlags m_DstStages = 0;
+};
@@ -2,27 +2,94 @@
 //
 
 #include "Application.h"
+#include <stb_image.h>
 #include <iostream>
+#include <string.h>
+#include <stdlib.h>
+
+struct LaunchOptions {
+	bool vSync = true;
+	bool pipelineCache = true;
+	bool headless = false;
+	bool gpuAnimation = true;
+	bool bindlessTextures = true;
+	bool packedVertices = true;
+	bool frustumCulling = true;
+	bool depthPrepass = false;
+	bool dynamicResolution = false;
+	float minScale = 0.5f;
+	float maxScale = 1.0f;
+	float targetFrameTime = 16.0f;
+	VkPresentModeKHR presentMode = VK_PRESENT_MODE_MAX_ENUM_KHR;
+	uint32_t width = 1280;
+	uint32_t height = 720;
+	uint32_t frameCount = 1000;
+	uint32_t instanceCount = 1;
+	uint32_t recordingThreads = 0;
+	uint32_t framesInFlight = 2;
+	std::string dumpDirectory;
+	std::string profileJson;
+	std::vector<std::string> textures;
+	std::string convertInput;
+	std::string convertOutput;
+	std::string convertFormat;
+	std::string mesh;
+	std::string convertMeshInput;
+	std::string convertMeshOutput;
+};
+
 
 Application* CreateWindow(int, int);
 void MainLoop(GLFWwindow*, Application*);
+void RunHeadless(Application*, const LaunchOptions&);
+int ConvertTexture(const LaunchOptions&);
+int ConvertMesh(const LaunchOptions&);
 void CleanUp(GLFWwindow*, Application*);
 void SetupDebugMessenger(Application*);
 VkResult CreateDebugUtilsMessengerEXT(VkInstance, const VkDebugUtilsMessengerCreateInfoEXT*, const VkAllocationCallbacks*, VkDebugUtilsMessengerEXT*);
 static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT, VkDebugUtilsMessageTypeFlagsEXT, const VkDebugUtilsMessengerCallbackDataEXT*, void*);
 void DestroyDebugUtilsMessengerEXT(VkInstance, VkDebugUtilsMessengerEXT, const VkAllocationCallbacks*);
 static void FramebufferResizeCallback(GLFWwindow*, int, int);
+static void KeyCallback(GLFWwindow*, int, int, int, int);
 VkDebugUtilsMessengerEXT m_DebugMessenger;
 GLFWwindow* applicationWindowPointer;
-int RunVulkanStartUp(Application*, bool);
+int RunVulkanStartUp(Application*, const LaunchOptions&);
+LaunchOptions ParseLaunchOptions(int, char**);
+static VkPresentModeKHR ParsePresentMode(const char*);
+
+// The modes M cycles through, skipping the ones the surface does not offer
+static const VkPresentModeKHR PresentModes[] = { VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR };
 
-int main()
+int main(int argc, char** argv)
 {
-	Application* main = CreateWindow(1280, 720);	
-	int startRes = RunVulkanStartUp(main, true);	
+	LaunchOptions options = ParseLaunchOptions(argc, argv);
+
+	if (!options.convertInput.empty()) {
+		return ConvertTexture(options);
+	}
+
+	if (!options.convertMeshInput.empty()) {
+		return ConvertMesh(options);
+	}
+
+	Application* main = options.headless ? new Application(nullptr) : CreateWindow(options.width, options.height);	
+
+	auto start = std::chrono::high_resolution_clock::now();
+	int startRes = RunVulkanStartUp(main, options);	
+	auto end = std::chrono::high_resolution_clock::now();
+
+	printf("Startup took %.2f ms (pipeline cache %s)\n", std::chrono::duration<double, std::milli>(end - start).count(), options.pipelineCache ? "on" : "off");
 
 	if (startRes == 0) {
-		MainLoop(main->GetWindow(), main);
+		if (options.headless) {
+			RunHeadless(main, options);
+		}
+		else {
+			MainLoop(main->GetWindow(), main);
+		}
+
+		main->ReportProfile(options.profileJson);
+
 		CleanUp(main->GetWindow(), main);
 
 		return 0;
@@ -32,16 +99,128 @@ int main()
 	}
 }
 
-int RunVulkanStartUp(Application* main, bool vSync)
+LaunchOptions ParseLaunchOptions(int argc, char** argv)
+{
+	LaunchOptions options;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--no-pipeline-cache") == 0) {
+			options.pipelineCache = false;
+		}
+		else if (strcmp(argv[i], "--no-vsync") == 0) {
+			options.vSync = false;
+		}
+		else if (strcmp(argv[i], "--cpu-animation") == 0) {
+			options.gpuAnimation = false;
+		}
+		else if (strcmp(argv[i], "--no-bindless") == 0) {
+			options.bindlessTextures = false;
+		}
+		else if (strcmp(argv[i], "--float-vertices") == 0) {
+			options.packedVertices = false;
+		}
+		else if (strcmp(argv[i], "--no-culling") == 0) {
+			options.frustumCulling = false;
+		}
+		else if (strcmp(argv[i], "--depth-prepass") == 0) {
+			options.depthPrepass = true;
+		}
+		else if (strcmp(argv[i], "--present-mode") == 0 && i + 1 < argc) {
+			options.presentMode = ParsePresentMode(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--dynamic-resolution") == 0) {
+			options.dynamicResolution = true;
+		}
+		else if (strcmp(argv[i], "--min-scale") == 0 && i + 1 < argc) {
+			options.minScale = static_cast<float>(atof(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--max-scale") == 0 && i + 1 < argc) {
+			options.maxScale = static_cast<float>(atof(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--target-frame-ms") == 0 && i + 1 < argc) {
+			options.targetFrameTime = static_cast<float>(atof(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--headless") == 0) {
+			options.headless = true;
+		}
+		else if (strcmp(argv[i], "--width") == 0 && i + 1 < argc) {
+			options.width = static_cast<uint32_t>(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--height") == 0 && i + 1 < argc) {
+			options.height = static_cast<uint32_t>(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc) {
+			options.instanceCount = static_cast<uint32_t>(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc) {
+			options.framesInFlight = static_cast<uint32_t>(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--record-threads") == 0 && i + 1 < argc) {
+			options.recordingThreads = static_cast<uint32_t>(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+			options.frameCount = static_cast<uint32_t>(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--dump-frames") == 0 && i + 1 < argc) {
+			options.dumpDirectory = argv[++i];
+		}
+		else if (strcmp(argv[i], "--profile-json") == 0 && i + 1 < argc) {
+			options.profileJson = argv[++i];
+		}
+		else if (strcmp(argv[i], "--texture") == 0 && i + 1 < argc) {
+			options.textures.push_back(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--convert-texture") == 0 && i + 2 < argc) {
+			options.convertInput = argv[++i];
+			options.convertOutput = argv[++i];
+		}
+		else if (strcmp(argv[i], "--mesh") == 0 && i + 1 < argc) {
+			options.mesh = argv[++i];
+		}
+		else if (strcmp(argv[i], "--convert-mesh") == 0 && i + 2 < argc) {
+			options.convertMeshInput = argv[++i];
+			options.convertMeshOutput = argv[++i];
+		}
+		else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+			options.convertFormat = argv[++i];
+		}
+		else {
+			printf("Ignoring unknown option %s\n", argv[i]);
+		}
+	}
+
+	if (options.textures.empty()) {
+		options.textures.push_back("Textures/Abby Road.jpg");
+	}
+
+	return options;
+}
+
+static VkPresentModeKHR ParsePresentMode(const char* name)
+{
+	for (VkPresentModeKHR presentMode : PresentModes) {
+		if (strcmp(name, Application::GetPresentModeName(presentMode)) == 0) {
+			return presentMode;
+		}
+	}
+
+	printf("Unknown present mode %s, expected fifo, fifo_relaxed, mailbox or immediate\n", name);
+
+	return VK_PRESENT_MODE_MAX_ENUM_KHR;
+}
+
+int RunVulkanStartUp(Application* main, const LaunchOptions& options)
 {
 	if (main->InitVulkan() != VK_SUCCESS) {
 		printf("Failed to create Vulkan Instance");
 		return -1;
 	}
 
-	SetupDebugMessenger(main);
+	if (main->IsValidationEnabled()) {
+		SetupDebugMessenger(main);
+	}
 
-	if (!main->CreateSurface()) {
+	if (!options.headless && !main->CreateSurface()) {
 		printf("Failed to Create Window Surface!");
 		return -1;
 	}
@@ -49,16 +228,38 @@ int RunVulkanStartUp(Application* main, bool vSync)
 		printf("Failed to Find suitable GPU!");
 		return -1;
 	}
-	if (!main->CreateLogicalDevice()) {
+
+	// Everything sized per frame in flight is created from here on, starting with the profiler's query pool
+	main->SetFramesInFlight(options.framesInFlight);
+
+	if (!main->CreateLogicalDevice(options.bindlessTextures)) {
 		printf("Failed to Create Logical Device!");
 		return -1;
 	}
 
-	if (!main->CreateSwapChain(1280, 720, vSync)) {
-		printf("Failed to Create Swap Chain!");
+	if (!main->CreatePipelineCache(options.pipelineCache)) {
+		printf("Failed to Create Pipeline Cache!");
 		return -1;
 	}
 
+	if (options.headless) {
+		if (!main->CreateOffscreenTarget(options.width, options.height, options.dumpDirectory)) {
+			printf("Failed to Create Offscreen Target!");
+			return -1;
+		}
+	}
+	else {
+		// An unsupported --present-mode is reported and the vsync flag picks the mode instead
+		if (options.presentMode != VK_PRESENT_MODE_MAX_ENUM_KHR) {
+			main->SetPresentMode(options.presentMode);
+		}
+
+		if (!main->CreateSwapChain(options.width, options.height, options.vSync)) {
+			printf("Failed to Create Swap Chain!");
+			return -1;
+		}
+	}
+
 	if (!main->CreateImageViews()) {
 		printf("Failed to Create Image Views!");
 		return -1;
@@ -74,6 +275,14 @@ int RunVulkanStartUp(Application* main, bool vSync)
 		return -1;
 	}
 
+	if (options.mesh.empty()) {
+		main->SetVertexFormat(options.packedVertices ? VertexFormat::Packed : VertexFormat::Float);
+	}
+	else if (!main->LoadMesh(options.mesh)) {
+		printf("Failed to Load Mesh!");
+		return -1;
+	}
+
 	if (!main->CreateGraphicsPipeline()) {
 		printf("Failed to Create Graphics Pipeline!");
 		return -1;
@@ -84,38 +293,40 @@ int RunVulkanStartUp(Application* main, bool vSync)
 		return -1;
 	}
 
-	if (!main->CreateDepthImageResources()) {
-		printf("Failed to Create Depth Buffer!");
-		return -1;
+	for (const auto& texture : options.textures) {
+		if (!main->CreateTextureImage(texture.c_str())) {
+			printf("failed to Create Texture Image");
+			return -1;
+		}
 	}
 
-	if (!main->CreateFrameBuffers()) {
-		printf("Failed to Create Framebuffer!");
+	if (!main->CreateTextureSampler()) {
+		printf("Failed to Create Texture Sampler!");
 		return -1;
 	}
 
-	if (!main->CreateTextureImage("Textures/Abby Road.jpg")) {
-		printf("failed to Create Texture Image");
+	if (!main->CreateVertexBuffer(options.gpuAnimation)) {
+		printf("Failed to Create Vertex Buffer!");
 		return -1;
 	}
 
-	if (!main->CreateTextureImageViews()) {
-		printf("Failed to Create Texture Image Views!");
+	if (!main->CreateAnimationPipeline()) {
+		printf("Failed to Create Animation Pipeline!");
 		return -1;
 	}
 
-	if (!main->CreateTextureSampler()) {
-		printf("Failed to Create Texture Sampler!");
+	if (!main->CreateIndexBuffer()) {
+		printf("Failed to Create Index Buffer!");
 		return -1;
 	}
 
-	if (!main->CreateVertexBuffer()) {
-		printf("Failed to Create Vertex Buffer!");
+	if (!main->CreateInstanceBuffer(options.instanceCount)) {
+		printf("Failed to Create Instance Buffer!");
 		return -1;
 	}
 
-	if (!main->CreateIndexBuffer()) {
-		printf("Failed to Create Index Buffer!");
+	if (!main->CreateIndirectBuffer()) {
+		printf("Failed to Create Indirect Buffer!");
 		return -1;
 	}
 
@@ -134,6 +345,22 @@ int RunVulkanStartUp(Application* main, bool vSync)
 		return -1;
 	}
 
+	main->SetRecordingThreads(options.recordingThreads);
+	main->SetFrustumCulling(options.frustumCulling);
+	main->SetDepthPrepass(options.depthPrepass);
+	main->SetDynamicResolution(options.dynamicResolution, options.minScale, options.maxScale, options.targetFrameTime);
+
+	// The graph's passes depend on whether GPU animation ended up enabled, so it is declared last
+	if (!main->CreateRenderGraph()) {
+		printf("Failed to Create Render Graph!");
+		return -1;
+	}
+
+	if (!main->CreateFrameBuffers()) {
+		printf("Failed to Create Framebuffer!");
+		return -1;
+	}
+
 	if (!main->CreateCommandBuffers()) {
 		printf("Failed to Allocate Command Buffers!");
 		return -1;
@@ -159,6 +386,7 @@ Application* CreateWindow(int width, int height)
 
 	glfwSetWindowUserPointer(window, app);
 	glfwSetFramebufferSizeCallback(window, FramebufferResizeCallback);
+	glfwSetKeyCallback(window, KeyCallback);
 	
 	return app;
 }
@@ -168,23 +396,204 @@ static void FramebufferResizeCallback(GLFWwindow* window, int width, int height)
 	app->FrameResized(width, height);
 }
 
+// P toggles the depth pre-pass and M switches to the next present mode, so both can be compared on the same scene
+static void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+	auto app = reinterpret_cast<Application*>(glfwGetWindowUserPointer(window));
+	size_t modeCount = sizeof(PresentModes) / sizeof(PresentModes[0]);
+
+	if (key == GLFW_KEY_P && action == GLFW_PRESS) {
+		app->SetDepthPrepass(!app->IsDepthPrepassEnabled());
+		printf("Depth pre-pass %s\n", app->IsDepthPrepassEnabled() ? "on" : "off");
+	}
+	else if (key == GLFW_KEY_M && action == GLFW_PRESS) {
+		size_t current = std::find(PresentModes, PresentModes + modeCount, app->GetPresentMode()) - PresentModes;
+
+		for (size_t i = 1; i < modeCount; i++) {
+			if (app->SetPresentMode(PresentModes[(current + i) % modeCount])) {
+				break;
+			}
+		}
+	}
+}
+
 void MainLoop(GLFWwindow* window, Application* app)
 {
 	while (!glfwWindowShouldClose(window)) {
 		glfwPollEvents();
-		app->VertexTest();
-		app->DrawFrame();
+		app->AnimateVertices();
+
+		if (!app->DrawFrame()) {
+			printf("Frame failed to render, closing\n");
+			break;
+		}
 	}
 
 	vkDeviceWaitIdle(app->GetDevice());
 }
 
+void RunHeadless(Application* app, const LaunchOptions& options)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	uint32_t frame = 0;
+
+	for (; frame < options.frameCount; frame++) {
+		app->AnimateVertices();
+
+		if (!app->DrawFrame()) {
+			printf("Frame %u failed to render\n", frame);
+			break;
+		}
+	}
+
+	app->FlushFrameDumps();
+
+	auto end = std::chrono::high_resolution_clock::now();
+	double milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+
+	printf("Rendered %u frames at %ux%u in %.2f ms (%.1f frames/s)\n", frame, options.width, options.height, milliseconds, frame * 1000.0 / milliseconds);
+}
+
+// Offline conversion of a JPEG/PNG into a block compressed KTX2 with a full mip chain, no Vulkan device is needed
+int ConvertTexture(const LaunchOptions& options)
+{
+	int width;
+	int height;
+	int channels;
+	stbi_uc* pixels = stbi_load(options.convertInput.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+
+	if (!pixels) {
+		printf("Failed to load %s\n", options.convertInput.c_str());
+		return -1;
+	}
+
+	// Opaque inputs go to BC1, anything with an alpha channel needs BC3 unless asked otherwise
+	BlockFormat format = channels == 4 ? BlockFormat::BC3 : BlockFormat::BC1;
+
+	if (options.convertFormat == "bc1") {
+		format = BlockFormat::BC1;
+	}
+	else if (options.convertFormat == "bc3") {
+		format = BlockFormat::BC3;
+	}
+	else if (!options.convertFormat.empty()) {
+		printf("Unknown texture format %s, expected bc1 or bc3\n", options.convertFormat.c_str());
+		stbi_image_free(pixels);
+		return -1;
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	ThreadPool threadPool;
+	MipChain mipChain;
+	BlockCompressor compressor;
+	std::vector<MipLevel> levels;
+	std::vector<uint8_t> data;
+
+	threadPool.Start(std::thread::hardware_concurrency());
+	mipChain.Build(pixels, static_cast<uint32_t>(width), static_cast<uint32_t>(height), threadPool);
+	stbi_image_free(pixels);
+
+	for (const MipLevel& source : mipChain.GetLevels()) {
+		MipLevel level = source;
+
+		level.offset = data.size();
+		level.size = BlockCompressor::GetCompressedSize(format, source.width, source.height);
+		data.resize(data.size() + level.size);
+
+		compressor.Compress(mipChain.GetData().data() + source.offset, source.width, source.height, format, data.data() + level.offset, threadPool);
+		levels.push_back(level);
+	}
+
+	if (!KtxTexture::Write(options.convertOutput, format, levels, data)) {
+		printf("Failed to write %s\n", options.convertOutput.c_str());
+		return -1;
+	}
+
+	auto end = std::chrono::high_resolution_clock::now();
+
+	printf("Wrote %s: %dx%d %s, %zu levels, %.1f KiB (%.1f KiB as RGBA8) in %.2f ms\n", options.convertOutput.c_str(), width, height, format == BlockFormat::BC1 ? "BC1" : "BC3",
+		levels.size(), data.size() / 1024.0, mipChain.GetData().size() / 1024.0, std::chrono::duration<double, std::milli>(end - start).count());
+
+	return 0;
+}
+
+// Offline conversion of an OBJ into a .vtmesh, the vertex stream is encoded once here so loading is a plain copy
+int ConvertMesh(const LaunchOptions& options)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	std::vector<MeshSubmesh> submeshes;
+
+	if (!MeshFile::ImportObj(options.convertMeshInput, vertices, indices, submeshes)) {
+		return -1;
+	}
+
+	VertexFormat format = options.packedVertices ? VertexFormat::Packed : VertexFormat::Float;
+
+	// Packed texture coordinates are unorm, so tiling coordinates need the float layout
+	for (const Vertex& vertex : vertices) {
+		if (format == VertexFormat::Packed && (vertex.texCoord.x < 0.0f || vertex.texCoord.x > 1.0f || vertex.texCoord.y < 0.0f || vertex.texCoord.y > 1.0f)) {
+			printf("%s has texture coordinates outside [0, 1], writing float vertices\n", options.convertMeshInput.c_str());
+			format = VertexFormat::Float;
+			break;
+		}
+	}
+
+	// Half floats keep 11 significant bits, so positions far from the origin or large against the mesh get coarse
+	// (above 2048 the step is already 2 units, past 65504 they turn into inf)
+	if (format == VertexFormat::Packed && !vertices.empty()) {
+		glm::vec3 lower = vertices[0].pos;
+		glm::vec3 upper = vertices[0].pos;
+
+		for (const Vertex& vertex : vertices) {
+			lower = glm::min(lower, vertex.pos);
+			upper = glm::max(upper, vertex.pos);
+		}
+
+		glm::vec3 extent = upper - lower;
+		glm::vec3 farthest = glm::max(glm::abs(lower), glm::abs(upper));
+		float range = std::max(std::max(farthest.x, farthest.y), farthest.z);
+		float tolerance = std::max(std::max(extent.x, extent.y), extent.z) / 1024.0f;
+		float maxError = 0.0f;
+
+		for (const Vertex& vertex : vertices) {
+			glm::vec3 error = glm::abs(glm::vec3(glm::unpackHalf4x16(glm::packHalf4x16(glm::vec4(vertex.pos, 0.0f)))) - vertex.pos);
+
+			maxError = std::max(maxError, std::max(std::max(error.x, error.y), error.z));
+		}
+
+		if (range > 2048.0f) {
+			printf("%s has positions up to %.1f, beyond the range half floats keep precise, writing float vertices\n", options.convertMeshInput.c_str(), range);
+			format = VertexFormat::Float;
+		}
+		else if (maxError > tolerance) {
+			printf("%s loses up to %g units as half float positions, writing float vertices\n", options.convertMeshInput.c_str(), maxError);
+			format = VertexFormat::Float;
+		}
+	}
+
+	if (!MeshFile::Write(options.convertMeshOutput, format, vertices, indices, submeshes)) {
+		printf("Failed to write %s\n", options.convertMeshOutput.c_str());
+		return -1;
+	}
+
+	auto end = std::chrono::high_resolution_clock::now();
+
+	printf("Wrote %s: %zu vertices (%s), %zu indices, %zu submeshes in %.2f ms\n", options.convertMeshOutput.c_str(), vertices.size(), format == VertexFormat::Packed ? "packed" : "float",
+		indices.size(), submeshes.size(), std::chrono::duration<double, std::milli>(end - start).count());
+
+	return 0;
+}
+
 void CleanUp(GLFWwindow* window, Application* app)
 {
 	DestroyDebugUtilsMessengerEXT(app->GetInstance(), m_DebugMessenger, nullptr);
 	app->~Application();
-	glfwDestroyWindow(window);
-	glfwTerminate();
+
+	if (window != nullptr) {
+		glfwDestroyWindow(window);
+		glfwTerminate();
+	}
 }
 
 void SetupDebugMessenger(Application* app) {
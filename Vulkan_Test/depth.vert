@@ -0,0 +1,21 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Depth pre-pass: only the position stream and the instance transform are fetched and there is no
+// fragment stage. gl_Position is invariant here and in shader.vert, so the color pass can test with
+// VK_COMPARE_OP_EQUAL against the depth written by this one.
+
+layout(binding = 0) uniform UniformBufferObject {
+	mat4 model;
+	mat4 view;
+	mat4 proj;
+} ubo;
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 4) in mat4 inInstanceTransform;
+
+invariant gl_Position;
+
+void main() {
+	gl_Position = ubo.proj * ubo.view * ubo.model * inInstanceTransform * vec4(inPosition, 1.0);
+}
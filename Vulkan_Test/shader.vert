@@ -10,15 +10,26 @@ layout(binding = 0) uniform UniformBufferObject {
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec2 inTexCoord;
-layout(location = 3) in vec3 inDestColor;
+layout(location = 4) in mat4 inInstanceTransform;
+layout(location = 8) in vec4 inInstanceTint;
+layout(location = 9) in uint inTextureHandle;
+
+layout(binding = 2) readonly buffer TextureSlots {
+	uint slots[];
+} textureSlots;
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) flat out uint fragTextureIndex;
+
+// Matches depth.vert, the depth pre-pass relies on both producing bit identical positions
+invariant gl_Position;
 
 void main() {
 
-	gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
-	fragColor = inColor;
+	gl_Position = ubo.proj * ubo.view * ubo.model * inInstanceTransform * vec4(inPosition, 1.0);
+	fragColor = inColor * inInstanceTint.rgb;
 	fragTexCoord = inTexCoord;
+	fragTextureIndex = textureSlots.slots[inTextureHandle];
 }
 